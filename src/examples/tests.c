@@ -0,0 +1,1803 @@
+/*
+ * tests.c
+ *
+ * Behaviour tests of sxmlc features. Each test prints the checks that failed, 'main'
+ * returns the number of failed checks. Temporary files are written to 'TMPDIR' ("/tmp"
+ * by default).
+ * Build with e.g.: cc -o tests tests.c ../sxmlc.c ../sxmlsearch.c -lpthread
+ */
+
+#if defined(WIN32) || defined(WIN64)
+#pragma warning(disable : 4996)
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(WIN32) && !defined(WIN64) && !defined(SXMLC_NO_THREADS)
+#define TEST_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include "../sxmlc.h"
+#include "../sxmlsearch.h"
+
+static int n_checks = 0;
+static int n_failed = 0;
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+static void check(int ok, const char* cond, const char* file, int line)
+{
+	n_checks++;
+	if (!ok) {
+		n_failed++;
+		fprintf(stderr, "%s:%d: check failed: %s\n", file, line, cond);
+	}
+}
+
+/*
+ Store in 'path' (at least 'SXMLC_MAX_PATH' characters) the path of temporary file 'name'.
+ Return 'path'.
+ */
+static char* temp_path(char* path, const char* name)
+{
+	const char* dir = getenv("TMPDIR");
+
+#if defined(WIN32) || defined(WIN64)
+	if (dir == NULL)
+		dir = getenv("TEMP");
+	if (dir == NULL)
+		dir = ".";
+#else
+	if (dir == NULL || dir[0] == '\0')
+		dir = "/tmp";
+#endif
+	sprintf(path, "%.*s/%s", (int)(SXMLC_MAX_PATH - strlen(name) - 2), dir, name);
+
+	return path;
+}
+
+/*
+ Write 'n' bytes 'data' to file 'path'.
+ */
+static int write_file(const char* path, const void* data, size_t n)
+{
+	FILE* f = fopen(path, "wb");
+
+	if (f == NULL)
+		return false;
+	if (fwrite(data, 1, n, f) != n) {
+		fclose(f);
+		return false;
+	}
+
+	return fclose(f) == 0;
+}
+
+/*
+ Return the printout of 'doc' (to be freed), or NULL.
+ */
+static char* doc_print(const XMLDoc* doc)
+{
+	FILE* f = tmpfile();
+	char* s;
+	long n;
+
+	if (f == NULL)
+		return NULL;
+	XMLDoc_print(doc, f, C2SX("\n"), C2SX(""), false, 0, 1);
+	n = ftell(f);
+	s = (char*)malloc(n + 1);
+	if (s != NULL) {
+		rewind(f);
+		n = (long)fread(s, 1, n, f);
+		s[n] = '\0';
+	}
+	fclose(f);
+
+	return s;
+}
+
+/*
+ Return 'true' if printouts 's1' and 's2' are both NULL or equal.
+ */
+static int same_print(const char* s1, const char* s2)
+{
+	if (s1 == NULL || s2 == NULL)
+		return s1 == s2;
+
+	return strcmp(s1, s2) == 0;
+}
+
+/* Document covering most of the syntax, used by several tests */
+static const char* sample =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<!DOCTYPE root>\n"
+	"<!-- Comment with <tag> -->\n"
+	"<root a=\"1\" b='x > y'>\n"
+	"\t<child id=\"c1\">Some &lt;text&gt; &amp; more</child>\n"
+	"\t<empty/>\n"
+	"\t<data><![CDATA[raw <data> & ]]]]></data>\n"
+	"\t<deep><deeper><deepest x=\"&quot;q&quot;\"/></deeper></deep>\n"
+	"\t<?instr inside?>\n"
+	"</root>\n";
+
+/*
+ Return the printout of 'buffer' parsed as a DOM (to be freed), or NULL in case of error.
+ */
+static char* buffer_print(const SXML_CHAR* buffer)
+{
+	XMLDoc doc;
+	char* s;
+
+	XMLDoc_init(&doc);
+	s = (XMLDoc_parse_buffer_DOM(buffer, C2SX("buffer"), &doc) ? doc_print(&doc) : NULL);
+	XMLDoc_free(&doc);
+
+	return s;
+}
+
+/*
+ Return the printout of file 'path' parsed as a DOM (to be freed), or NULL in case of error.
+ */
+static char* file_print(const char* path)
+{
+	XMLDoc doc;
+	char* s;
+
+	XMLDoc_init(&doc);
+	s = (XMLDoc_parse_file_DOM(C2SX(path), &doc) ? doc_print(&doc) : NULL);
+	XMLDoc_free(&doc);
+
+	return s;
+}
+
+/*
+ Return a document (to be freed) made of a root node with 'n' children, each one on its own
+ indented line, which lengths vary so that they do not line up with blocks or chunks.
+ */
+static char* make_doc(const char* head, const char* tail, int n)
+{
+	char *doc, *p;
+	int i;
+
+	doc = (char*)malloc(strlen(head) + strlen(tail) + n * 96 + 1);
+	if (doc == NULL)
+		return NULL;
+	p = doc + sprintf(doc, "%s", head);
+	for (i = 0; i < n; i++)
+		p += sprintf(p, "\t<node id=\"%d\" a='x&amp;y'>text %*d<!-- <c> --></node>\n", i, i % 17, i);
+	sprintf(p, "%s", tail);
+
+	return doc;
+}
+
+/* --- Block input --- */
+
+static void test_block_input(void)
+{
+	char path[SXMLC_MAX_PATH];
+	XMLDoc doc;
+	DataSourceBuffer dsb;
+	SXML_CHAR* line = NULL;
+	char *big, *ref, *s;
+	int sz_line = 0, n;
+
+	temp_path(path, "sxmlc_block.xml");
+
+	/* Document smaller than a block */
+	ref = buffer_print(C2SX(sample));
+	CHECK(write_file(path, sample, strlen(sample)));
+	s = file_print(path);
+	CHECK(ref != NULL && same_print(s, ref));
+	free(s);
+	free(ref);
+
+	/* Document of several blocks */
+	big = make_doc("<root>\n", "</root>\n", 3 * SXMLC_BLOCK_SIZE / 40);
+	CHECK(big != NULL && strlen(big) > 2 * SXMLC_BLOCK_SIZE);
+	if (big == NULL)
+		return;
+	CHECK(write_file(path, big, strlen(big)));
+	ref = buffer_print(C2SX(big));
+	s = file_print(path);
+	CHECK(ref != NULL && same_print(s, ref));
+	free(s);
+	free(ref);
+	free(big);
+
+	/* '>' inside attribute values, non-quoted value followed by '>' */
+	XMLDoc_init(&doc);
+	CHECK(XMLDoc_parse_buffer_DOM(C2SX("<a b='x>y' c=\"/>\"><d e=1>t</d></a>"), C2SX("gt"), &doc));
+	if (doc.i_root >= 0) {
+		CHECK(XMLDoc_root(&doc)->n_attributes == 2);
+		CHECK(!sx_strcmp(XMLDoc_root(&doc)->attributes[0].value, C2SX("x>y")));
+		CHECK(!sx_strcmp(XMLDoc_root(&doc)->attributes[1].value, C2SX("/>")));
+		CHECK(XMLDoc_root(&doc)->n_children == 1 && !sx_strcmp(XMLDoc_root(&doc)->children[0]->attributes[0].value, C2SX("1")));
+	}
+	XMLDoc_free(&doc);
+
+	/* 'read_line_alloc' is kept for compatibility */
+	dsb.buf = C2SX("<a>\n<b>");
+	dsb.cur_pos = 0;
+	n = read_line_alloc(&dsb, DATA_SOURCE_BUFFER, &line, &sz_line, 0, NULC, C2SX('>'), true, C2SX('\n'), NULL);
+	CHECK(n == 3 && !sx_strcmp(line, C2SX("<a>")));
+	n = read_line_alloc(&dsb, DATA_SOURCE_BUFFER, &line, &sz_line, 0, C2SX('<'), C2SX('>'), false, C2SX('\n'), NULL);
+	CHECK(n == 1 && !sx_strcmp(line, C2SX("b")));
+	free(line);
+	remove(path);
+}
+
+/* --- Memory-mapped files --- */
+
+static void test_mmap(void)
+{
+	char path[SXMLC_MAX_PATH];
+	XMLDoc doc;
+	char *ref, *s;
+
+	temp_path(path, "sxmlc_mmap.xml");
+	ref = buffer_print(C2SX(sample));
+	CHECK(write_file(path, sample, strlen(sample)));
+
+	s = file_print(path);
+	CHECK(ref != NULL && same_print(s, ref));
+	free(s);
+
+	XMLDoc_init(&doc);
+	CHECK(XMLDoc_parse_file_mmap_DOM(C2SX(path), &doc));
+	s = doc_print(&doc);
+	CHECK(same_print(s, ref));
+	free(s);
+	XMLDoc_free(&doc);
+
+	/* Empty file */
+	CHECK(write_file(path, "", 0));
+	XMLDoc_init(&doc);
+	CHECK(XMLDoc_parse_file_mmap_DOM(C2SX(path), &doc));
+	CHECK(doc.n_nodes == 0);
+	XMLDoc_free(&doc);
+	remove(path);
+
+	/* Missing file */
+	XMLDoc_init(&doc);
+	CHECK(!XMLDoc_parse_file_mmap_DOM(C2SX(path), &doc));
+	XMLDoc_free(&doc);
+	free(ref);
+}
+
+/* --- Push parser --- */
+
+/*
+ Parse 'data' with a push parser fed with chunks of 'sz_chunk' characters and return the
+ printout of the resulting document (to be freed), or NULL in case of error.
+ */
+static char* push_print(const char* data, size_t sz_chunk)
+{
+	XMLDoc doc;
+	DOM_through_SAX dom;
+	SAX_Callbacks sax;
+	XMLParser* parser;
+	size_t len = strlen(data), i, n;
+	int ret = true;
+	char* s;
+
+	XMLDoc_init(&doc);
+	dom.doc = &doc;
+	dom.text_as_nodes = false;
+	SAX_Callbacks_init_DOM(&sax);
+	parser = XMLParser_create(&sax, C2SX("push"), &dom);
+	if (parser == NULL)
+		return NULL;
+	for (i = 0; i < len && ret; i += n) {
+		n = (len - i < sz_chunk ? len - i : sz_chunk);
+		ret = XMLParser_feed(parser, C2SX(data + i), n);
+	}
+	ret = XMLParser_finish(parser) && ret;
+	XMLParser_free(parser);
+	s = (ret ? doc_print(&doc) : NULL);
+	XMLDoc_free(&doc);
+
+	return s;
+}
+
+static void test_push(void)
+{
+	static const size_t sizes[] = { 1, 2, 3, 5, 7, 16, 64, 1000 };
+	const char* docs[] = { sample, "<root><child>text</child>", "<root><child a=\"1", "<root><!-- comm" };
+	char *ref, *s;
+	int i, j;
+
+	for (j = 0; j < (int)(sizeof(docs) / sizeof(docs[0])); j++) {
+		/* Truncated documents (the last ones) are errors */
+		ref = (j < 2 ? buffer_print(C2SX(docs[j])) : NULL);
+		CHECK(j >= 2 || ref != NULL);
+		for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+			s = push_print(docs[j], sizes[i]);
+			CHECK(same_print(s, ref));
+			free(s);
+		}
+		free(ref);
+	}
+}
+
+/* --- Pull parser --- */
+
+static void test_reader(void)
+{
+	XMLReader* reader;
+	XMLEvent event;
+	const XMLNode* node;
+	int depths[16];
+	int n = 0, n_nodes = 0, max_depth = 0, depth;
+
+	reader = XMLReader_open_buffer(C2SX(sample), C2SX("reader"));
+	CHECK(reader != NULL);
+	if (reader == NULL)
+		return;
+	while ((event = XMLReader_next(reader)) != XML_EVENT_END_DOC && event != XML_EVENT_ERROR) {
+		depth = XMLReader_depth(reader);
+		switch (event) {
+			case XML_EVENT_START_NODE:
+				node = XMLReader_node(reader);
+				CHECK(node != NULL && depth == n + 1);
+				/* Node depth is the same on start and end, with or without children */
+				if (node != NULL && !strcmp(node->tag, "deepest"))
+					CHECK(depth == 4);
+				if (n < 16)
+					depths[n++] = depth;
+				if (depth > max_depth)
+					max_depth = depth;
+				n_nodes++;
+				break;
+
+			case XML_EVENT_END_NODE:
+				CHECK(n > 0 && depths[n - 1] == depth);
+				n--;
+				break;
+
+			case XML_EVENT_TEXT:
+				CHECK(depth == n);
+				break;
+
+			default:
+				break;
+		}
+	}
+	CHECK(event == XML_EVENT_END_DOC);
+	CHECK(n == 0);
+	CHECK(n_nodes == 12);
+	CHECK(max_depth == 4);
+	XMLReader_free(reader);
+
+	/* Malformed document */
+	reader = XMLReader_open_buffer(C2SX("<a><b c=\"d></a>"), C2SX("reader"));
+	CHECK(reader != NULL);
+	while (reader != NULL && (event = XMLReader_next(reader)) != XML_EVENT_END_DOC && event != XML_EVENT_ERROR)
+		;
+	CHECK(event == XML_EVENT_ERROR);
+	XMLReader_free(reader);
+}
+
+/* --- Length-delimited buffers --- */
+
+static void test_buffer_len(void)
+{
+	XMLDoc doc;
+	SAX_Callbacks sax;
+	SXML_CHAR* buf;
+	char *ref, *s;
+	size_t len = strlen(sample);
+
+	ref = buffer_print(C2SX(sample));
+
+	/* Exact size buffer, without NUL */
+	buf = (SXML_CHAR*)malloc(len * sizeof(SXML_CHAR));
+	if (buf == NULL)
+		return;
+	memcpy(buf, C2SX(sample), len * sizeof(SXML_CHAR));
+	XMLDoc_init(&doc);
+	CHECK(XMLDoc_parse_buffer_len_DOM(buf, len, C2SX("len"), &doc));
+	s = doc_print(&doc);
+	CHECK(same_print(s, ref));
+	free(s);
+	XMLDoc_free(&doc);
+
+	/* Only the root node start */
+	XMLDoc_init(&doc);
+	CHECK(XMLDoc_parse_buffer_len_DOM(buf, strstr(sample, "\n\t<child") - sample, C2SX("len"), &doc));
+	CHECK(doc.i_root >= 0 && XMLDoc_root(&doc)->n_children == 0);
+	XMLDoc_free(&doc);
+
+	/* Truncated in a tag */
+	SAX_Callbacks_init(&sax);
+	CHECK(!XMLDoc_parse_buffer_len_SAX(buf, strstr(sample, "id=") - sample, C2SX("len"), &sax, NULL));
+	XMLDoc_init(&doc);
+	CHECK(!XMLDoc_parse_buffer_len_DOM(buf, strstr(sample, "id=") - sample, C2SX("len"), &doc));
+	XMLDoc_free(&doc);
+	free(buf);
+	free(ref);
+}
+
+/* --- User data sources --- */
+
+typedef struct _UserSource {
+	const char* data;
+	size_t len;
+	size_t pos;
+	int fail;	/* Stop returning data at the middle of 'data', without being at its end */
+} UserSource;
+
+/* Read at most 7 characters at once */
+static size_t user_read(void* ctx, SXML_CHAR* buf, size_t n)
+{
+	UserSource* us = (UserSource*)ctx;
+	size_t end = (us->fail ? us->len / 2 : us->len);
+
+	if (n > 7)
+		n = 7;
+	if (n > end - us->pos)
+		n = end - us->pos;
+	memcpy(buf, C2SX(us->data + us->pos), n * sizeof(SXML_CHAR));
+	us->pos += n;
+
+	return n;
+}
+
+static int user_eof(void* ctx)
+{
+	UserSource* us = (UserSource*)ctx;
+
+	return us->pos >= us->len;
+}
+
+static void user_source(DataSourceUser* source, UserSource* us, const char* data, int fail)
+{
+	us->data = data;
+	us->len = strlen(data);
+	us->pos = 0;
+	us->fail = fail;
+	source->read = user_read;
+	source->eof = user_eof;
+	source->ctx = us;
+}
+
+static void test_user_source(void)
+{
+	DataSourceUser source;
+	UserSource us;
+	XMLDoc doc;
+	XMLReader* reader;
+	XMLEvent event;
+	SXML_CHAR* line = NULL;
+	char *ref, *s;
+	int n_nodes = 0, sz_line = 0;
+
+	ref = buffer_print(C2SX(sample));
+	user_source(&source, &us, sample, false);
+	XMLDoc_init(&doc);
+	CHECK(XMLDoc_parse_source_DOM(&source, C2SX("user"), &doc));
+	s = doc_print(&doc);
+	CHECK(ref != NULL && same_print(s, ref));
+	free(s);
+	XMLDoc_free(&doc);
+	free(ref);
+
+	user_source(&source, &us, sample, false);
+	reader = XMLReader_open_source(&source, C2SX("user"));
+	CHECK(reader != NULL);
+	while (reader != NULL && (event = XMLReader_next(reader)) != XML_EVENT_END_DOC && event != XML_EVENT_ERROR) {
+		if (event == XML_EVENT_START_NODE)
+			n_nodes++;
+	}
+	CHECK(event == XML_EVENT_END_DOC && n_nodes == 12);
+	XMLReader_free(reader);
+
+	/* 'read' returning 0 before 'eof' is an error */
+	user_source(&source, &us, sample, true);
+	XMLDoc_init(&doc);
+	CHECK(!XMLDoc_parse_source_DOM(&source, C2SX("user"), &doc));
+	XMLDoc_free(&doc);
+
+	/* Without 'eof', 'read' returning 0 is the end of data */
+	user_source(&source, &us, "<a><b/></a>", false);
+	source.eof = NULL;
+	XMLDoc_init(&doc);
+	CHECK(XMLDoc_parse_source_DOM(&source, C2SX("user"), &doc));
+	CHECK(doc.i_root >= 0 && XMLDoc_root(&doc)->n_children == 1);
+	XMLDoc_free(&doc);
+
+	/* Errors found by the DOM callbacks fail the parse */
+	XMLDoc_init(&doc);
+	CHECK(!XMLDoc_parse_buffer_DOM(C2SX("<a></b>"), C2SX("user"), &doc));
+	CHECK(!XMLDoc_parse_buffer_len_DOM(C2SX("<a></b>"), 7, C2SX("user"), &doc));
+	user_source(&source, &us, "<a></b>", false);
+	CHECK(!XMLDoc_parse_source_DOM(&source, C2SX("user"), &doc));
+	CHECK(doc.i_root < 0);
+	XMLDoc_free(&doc);
+
+	user_source(&source, &us, "<a>\n<b>", false);
+	CHECK(read_line_alloc(&source, DATA_SOURCE_USER, &line, &sz_line, 0, NULC, C2SX('>'), true, C2SX('\n'), NULL) == 3);
+	CHECK(line != NULL && !sx_strcmp(line, C2SX("<a>")));
+	free(line);
+}
+
+/* --- Parallel parsing --- */
+
+/*
+ Write a document of 'n_lines' root node children with 'head' and 'tail' around them, then
+ check that the parallel DOM parse gives the same result and document as the sequential one.
+ */
+static void check_parallel(const char* head, const char* tail, int n_lines, const XMLContext* ctx)
+{
+	char path[SXMLC_MAX_PATH];
+	XMLDoc doc1, doc2;
+	char *buf, *s1, *s2;
+	int ret1, ret2;
+
+	temp_path(path, "sxmlc_parallel.xml");
+	buf = make_doc(head, tail, n_lines);
+	if (buf == NULL)
+		return;
+	CHECK(write_file(path, buf, strlen(buf)));
+	free(buf);
+
+	XMLDoc_init(&doc1);
+	XMLDoc_init(&doc2);
+	ret1 = XMLDoc_parse_file_DOM_ctx(C2SX(path), &doc1, false, ctx);
+	ret2 = XMLDoc_parse_file_parallel_DOM_ctx(C2SX(path), &doc2, false, 4, ctx);
+	CHECK(ret1 == ret2);
+	/* The document is only kept when the parse succeeds */
+	CHECK(ret1 == (doc1.i_root >= 0));
+	CHECK(doc1.n_nodes == doc2.n_nodes);
+	s1 = doc_print(&doc1);
+	s2 = doc_print(&doc2);
+	CHECK(s1 != NULL && s2 != NULL && strcmp(s1, s2) == 0);
+	free(s1);
+	free(s2);
+	XMLDoc_free(&doc1);
+	XMLDoc_free(&doc2);
+	remove(path);
+}
+
+static void test_parallel(void)
+{
+	XMLContext ctx;
+	/* Enough lines for several chunks */
+	int n = (int)(3 * SXMLC_PARALLEL_MIN_CHUNK / 48);
+
+	check_parallel("<?xml version=\"1.0\"?>\n<root>\n", "</root>\n", n, NULL);
+	check_parallel("<root>\n<![CDATA[ <a> ]]>\n", "<!-- </root> -->\n</root>\n", n, NULL);
+	/* Malformed documents */
+	check_parallel("<root>\n", "<a></b></root>\n", n, NULL);
+	check_parallel("<root>\n<a></b>", "</root>\n", n, NULL);
+	check_parallel("junk<root>\n", "</root>\n", n, NULL);
+	check_parallel("<root>\n", "</root>\njunk", n, NULL);
+	check_parallel("<root>\n", "<a", n, NULL);
+	check_parallel("<root>\n", "", n, NULL);
+
+	XMLContext_init(&ctx);
+	ctx.max_depth = 2;
+	check_parallel("<root>\n", "<a><b><c></c></b></a></root>\n", n, &ctx);
+	check_parallel("<root>\n", "<a><b><c/></b></a></root>\n", n, &ctx);
+	ctx.max_depth = 3;
+	check_parallel("<root>\n", "<a><b/></a></root>\n", n, &ctx);
+	check_parallel("<root>\n", "<a><b><c/></b></a></root>\n", n, &ctx);
+	XMLContext_free(&ctx);
+}
+
+#ifdef TEST_THREADS
+/* Allocations of parser memory (without previous memory) by thread */
+static pthread_mutex_t alloc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t alloc_threads[16];
+static int alloc_counts[16];
+static int n_alloc_threads = 0;
+
+static void* count_realloc(void* mem, size_t sz)
+{
+	int i;
+
+	if (mem == NULL) {
+		pthread_mutex_lock(&alloc_mutex);
+		for (i = 0; i < n_alloc_threads && !pthread_equal(alloc_threads[i], pthread_self()); i++) ;
+		if (i == n_alloc_threads && i < 16) {
+			alloc_threads[i] = pthread_self();
+			alloc_counts[i] = 0;
+			n_alloc_threads++;
+		}
+		if (i < 16)
+			alloc_counts[i]++;
+		pthread_mutex_unlock(&alloc_mutex);
+	}
+
+	return realloc(mem, sz);
+}
+
+/* Chunks of an indented document are not parsed again by the calling thread */
+static void test_parallel_indented(void)
+{
+	char path[SXMLC_MAX_PATH];
+	XMLContext ctx;
+	XMLDoc doc;
+	char *buf, *p;
+	int i, n = (int)(7 * SXMLC_PARALLEL_MIN_CHUNK / 200), i_main = -1, ok = true;
+
+	temp_path(path, "sxmlc_indented.xml");
+	buf = (char*)malloc(n * 256 + 32);
+	if (buf == NULL)
+		return;
+	/* Long tags, so that chunks limits are inside them */
+	p = buf + sprintf(buf, "<root>\n");
+	for (i = 0; i < n; i++)
+		p += sprintf(p, "\t<node id=\"%06d\" a=\"%080d\">\n\t\t<value b=\"%080d\"/>\n\t</node>\n", i, i, i);
+	p += sprintf(p, "</root>\n");
+	CHECK(write_file(path, buf, p - buf));
+	free(buf);
+
+	XMLContext_init(&ctx);
+	ctx.mem_realloc = count_realloc;
+	n_alloc_threads = 0;
+	XMLDoc_init(&doc);
+	CHECK(XMLDoc_parse_file_parallel_DOM_ctx(C2SX(path), &doc, false, 4, &ctx));
+	CHECK(doc.i_root >= 0 && XMLDoc_root(&doc)->n_children == n);
+	XMLDoc_free(&doc);
+	XMLContext_free(&ctx);
+	remove(path);
+
+	CHECK(n_alloc_threads > 2);
+	for (i = 0; i < n_alloc_threads; i++) {
+		if (pthread_equal(alloc_threads[i], pthread_self()))
+			i_main = i;
+	}
+	CHECK(i_main >= 0);
+	for (i = 0; i_main >= 0 && i < n_alloc_threads; i++)
+		ok = ok && alloc_counts[i_main] <= alloc_counts[i];
+	CHECK(ok);
+}
+#endif
+
+/* --- Context limits --- */
+
+static int on_error(ParseError error_num, int line_num, SAX_Data* sd)
+{
+	(void)line_num;
+	*(ParseError*)sd->user = error_num;
+
+	return false;
+}
+
+/*
+ Return the error found when parsing 'buffer' with 'ctx', 'PARSE_ERR_NONE' if none.
+ */
+static ParseError parse_error(const char* buffer, const XMLContext* ctx)
+{
+	SAX_Callbacks sax;
+	ParseError error = PARSE_ERR_NONE;
+
+	SAX_Callbacks_init(&sax);
+	sax.on_error = on_error;
+	(void)XMLDoc_parse_buffer_SAX_ctx(C2SX(buffer), C2SX("limits"), &sax, &error, ctx);
+
+	return error;
+}
+
+static void test_limits(void)
+{
+	XMLContext ctx;
+
+	XMLContext_init(&ctx);
+	ctx.max_depth = 3;
+	CHECK(parse_error("<a><b><c>text</c></b></a>", &ctx) == PARSE_ERR_NONE);
+	CHECK(parse_error("<a><b><c/></b><!-- <d/> --></a>", &ctx) == PARSE_ERR_NONE);
+	CHECK(parse_error("<a><b><c><d>text</d></c></b></a>", &ctx) == PARSE_ERR_LIMIT);
+	/* Self-closing nodes count as well */
+	CHECK(parse_error("<a><b><c><d/></c></b></a>", &ctx) == PARSE_ERR_LIMIT);
+	CHECK(parse_error("<a><b><c><d></d></c></b></a>", &ctx) == PARSE_ERR_LIMIT);
+	ctx.max_depth = 1;
+	CHECK(parse_error("<a/>", &ctx) == PARSE_ERR_NONE);
+	CHECK(parse_error("<a><b/></a>", &ctx) == PARSE_ERR_LIMIT);
+	ctx.max_depth = 0;
+
+	ctx.max_token_len = 16;
+	CHECK(parse_error("<a b=\"1\">0123456789</a>", &ctx) == PARSE_ERR_NONE);
+	CHECK(parse_error("<a b=\"0123456789abcdef\"/>", &ctx) == PARSE_ERR_LIMIT);
+	CHECK(parse_error("<a>0123456789abcdef0123</a>", &ctx) == PARSE_ERR_LIMIT);
+	XMLContext_free(&ctx);
+}
+
+/* --- Multi-file pool --- */
+
+#define N_POOL_FILES 10
+
+/*
+ Write 'N_POOL_FILES' files, the first one being the biggest, and fill 'paths' with their names.
+ */
+static void write_pool_files(char paths[N_POOL_FILES][SXMLC_MAX_PATH])
+{
+	char name[32];
+	char* buf;
+	int i;
+
+	for (i = 0; i < N_POOL_FILES; i++) {
+		sprintf(name, "sxmlc_pool%d.xml", i);
+		temp_path(paths[i], name);
+		buf = (i == 0 ? make_doc("<slow>\n", "</slow>\n", 2000) : make_doc("<root>\n", "</root>\n", i));
+		if (buf == NULL)
+			continue;
+		CHECK(write_file(paths[i], buf, strlen(buf)));
+		free(buf);
+	}
+}
+
+#ifdef TEST_THREADS
+typedef struct _PoolShared {
+	pthread_mutex_t mutex;
+	int n_done;		/* Number of small files parsed */
+	int timed_out;
+} PoolShared;
+
+typedef struct _PoolUser {
+	PoolShared* shared;
+	int n_docs;		/* Number of files parsed by the thread */
+} PoolUser;
+
+/* Wait in the biggest file until all small files are parsed */
+static int pool_start(const XMLNode* node, SAX_Data* sd)
+{
+	PoolUser* pu = (PoolUser*)sd->user;
+	int i, n_done = 0;
+
+	if (strcmp(node->tag, "slow"))
+		return true;
+	for (i = 0; i < 1000 && n_done < N_POOL_FILES - 1; i++) {
+		pthread_mutex_lock(&pu->shared->mutex);
+		n_done = pu->shared->n_done;
+		pthread_mutex_unlock(&pu->shared->mutex);
+		if (n_done < N_POOL_FILES - 1)
+			usleep(10000);
+	}
+	pu->shared->timed_out = (n_done < N_POOL_FILES - 1);
+
+	return true;
+}
+
+static int pool_end_doc(SAX_Data* sd)
+{
+	PoolUser* pu = (PoolUser*)sd->user;
+
+	pu->n_docs++;
+	pthread_mutex_lock(&pu->shared->mutex);
+	pu->shared->n_done++;
+	pthread_mutex_unlock(&pu->shared->mutex);
+
+	return true;
+}
+#endif
+
+static void test_files_pool(void)
+{
+	char paths[N_POOL_FILES + 1][SXMLC_MAX_PATH];
+	const SXML_CHAR* p[N_POOL_FILES + 1];
+	XMLDoc docs[N_POOL_FILES + 1];
+	int status[N_POOL_FILES + 1];
+	char *ref, *s;
+	int i;
+#ifdef TEST_THREADS
+	SAX_Callbacks sax;
+	PoolShared shared;
+	PoolUser pu[2];
+	void* users[2];
+#endif
+
+	write_pool_files(paths);
+	/* Malformed and missing files */
+	CHECK(write_file(paths[3], "<root><a", 8));
+	temp_path(paths[N_POOL_FILES], "sxmlc_pool_missing.xml");
+	remove(paths[N_POOL_FILES]);
+	for (i = 0; i <= N_POOL_FILES; i++) {
+		p[i] = C2SX(paths[i]);
+		XMLDoc_init(&docs[i]);
+		status[i] = -1;
+	}
+	CHECK(XMLDoc_parse_files_parallel(p, N_POOL_FILES + 1, docs, status, 3) == N_POOL_FILES - 1);
+	for (i = 0; i <= N_POOL_FILES; i++) {
+		CHECK(status[i] == (i != 3 && i != N_POOL_FILES));
+		if (status[i] == true) {
+			ref = file_print(paths[i]);
+			s = doc_print(&docs[i]);
+			CHECK(ref != NULL && same_print(s, ref));
+			free(ref);
+			free(s);
+		} else {
+			CHECK(docs[i].n_nodes == 0);
+		}
+		XMLDoc_free(&docs[i]);
+	}
+	write_pool_files(paths);
+
+#ifdef TEST_THREADS
+	/* While the calling thread is stuck on the biggest file, the other one takes all small files */
+	pthread_mutex_init(&shared.mutex, NULL);
+	shared.n_done = 0;
+	shared.timed_out = false;
+	for (i = 0; i < 2; i++) {
+		pu[i].shared = &shared;
+		pu[i].n_docs = 0;
+		users[i] = &pu[i];
+	}
+	SAX_Callbacks_init(&sax);
+	sax.start_node = pool_start;
+	sax.end_doc = pool_end_doc;
+	CHECK(XMLDoc_parse_files_parallel_SAX(p, N_POOL_FILES, &sax, users, status, 2) == N_POOL_FILES);
+	CHECK(!shared.timed_out);
+	CHECK(pu[0].n_docs + pu[1].n_docs == N_POOL_FILES && pu[1].n_docs >= N_POOL_FILES - 1);
+	for (i = 0; i < N_POOL_FILES; i++)
+		CHECK(status[i] == true);
+	pthread_mutex_destroy(&shared.mutex);
+#endif
+
+	for (i = 0; i < N_POOL_FILES; i++)
+		remove(paths[i]);
+}
+
+/* --- Record streaming --- */
+
+typedef struct _Records {
+	int n_records;
+	int n_ok;		/* Records with the expected content */
+	XMLNode* kept;	/* Detached record */
+} Records;
+
+static int on_record(XMLNode* record, SAX_Data* sd)
+{
+	RecordStream* rs = (RecordStream*)sd->user;
+	Records* r = (Records*)rs->user;
+
+	r->n_records++;
+	if (record->father != NULL && !sx_strcmp(record->father->tag, C2SX("list"))
+		&& record->father->father != NULL && !sx_strcmp(record->father->father->tag, C2SX("db"))
+		&& record->n_children == 1 && !sx_strcmp(record->children[0]->tag, C2SX("rec"))
+		&& !sx_strcmp(record->children[0]->text, C2SX("nested")))
+		r->n_ok++;
+	if (r->n_records == 2) {
+		r->kept = record;
+		rs->record = NULL;
+	}
+
+	return true;
+}
+
+static void test_records(void)
+{
+	static const char* doc = "<db><list><rec id='1'><rec>nested</rec></rec><rec id='2'><rec>nested</rec></rec>"
+		"<other/><rec id='3'><rec>nested</rec></rec></list></db>";
+	RecordStream rs;
+	SAX_Callbacks sax;
+	XMLSearch search;
+	Records r;
+
+	r.n_records = r.n_ok = 0;
+	r.kept = NULL;
+	CHECK(RecordStream_init(&rs, C2SX("rec"), on_record, &r));
+	SAX_Callbacks_init_records(&sax);
+	CHECK(XMLDoc_parse_buffer_SAX(C2SX(doc), C2SX("records"), &sax, &rs));
+	CHECK(rs.error == PARSE_ERR_NONE);
+	CHECK(r.n_records == 3 && r.n_ok == 3);
+	CHECK(r.kept != NULL && !sx_strcmp(r.kept->attributes[0].value, C2SX("2")));
+	if (r.kept != NULL) {
+		XMLNode_free(r.kept);
+		free(r.kept);
+	}
+
+	/* Records matching a search */
+	memset(&search, 0, sizeof(search)); /* 'XMLSearch_init' frees a search it finds initialized */
+	XMLSearch_init(&search);
+	XMLSearch_search_set_tag(&search, C2SX("rec"));
+	XMLSearch_search_add_attribute(&search, C2SX("id"), C2SX("3"), true);
+	r.n_records = r.n_ok = 0;
+	r.kept = NULL;
+	CHECK(RecordStream_init(&rs, NULL, on_record, &r));
+	rs.match = XMLSearch_record_matches;
+	rs.match_data = &search;
+	CHECK(XMLDoc_parse_buffer_SAX(C2SX(doc), C2SX("records"), &sax, &rs));
+	CHECK(r.n_records == 1 && r.n_ok == 1);
+	XMLSearch_free(&search, true);
+
+	/* Malformed record */
+	r.n_records = 0;
+	CHECK(RecordStream_init(&rs, C2SX("rec"), on_record, &r));
+	CHECK(XMLDoc_parse_buffer_SAX(C2SX("<db><rec><a></rec></db>"), C2SX("records"), &sax, &rs));
+	CHECK(rs.error == PARSE_ERR_UNEXPECTED_NODE_END && r.n_records == 0);
+}
+
+/* --- Event positions --- */
+
+typedef struct _Positions {
+	const char* doc;
+	int n_events;
+	int n_ok;			/* Events which positions point at their tag or text */
+	int64_t last_start;	/* Position of the last start event */
+	int64_t last_end;
+} Positions;
+
+/*
+ Return 'true' if 'sd' position and column are those of the 'n' characters of string 's'.
+ */
+static int check_position(const SAX_Data* sd, const char* s, size_t n)
+{
+	const char* doc = ((Positions*)sd->user)->doc;
+	const char* line;
+	int64_t i;
+
+	if (sd->start_pos < 0 || sd->end_pos - sd->start_pos != (int64_t)n || strncmp(doc + sd->start_pos, s, n))
+		return false;
+	for (i = sd->start_pos, line = doc + i; i > 0 && doc[i - 1] != '\n'; i--)
+		line--;
+
+	return sd->column == (int)(doc + sd->start_pos - line) + 1;
+}
+
+static int pos_start(const XMLNode* node, SAX_Data* sd)
+{
+	Positions* p = (Positions*)sd->user;
+	const char* doc = p->doc + sd->start_pos;
+	size_t n = (size_t)(sd->end_pos - sd->start_pos);
+
+	p->n_events++;
+	p->last_start = sd->start_pos;
+	p->last_end = sd->end_pos;
+	if (n > 1 && doc[0] == '<' && doc[n - 1] == '>' && check_position(sd, doc, n)
+		&& (node->tag_type == TAG_COMMENT || !strncmp(doc + 1, node->tag, strlen(node->tag))))
+		p->n_ok++;
+
+	return true;
+}
+
+static int pos_end(const XMLNode* node, SAX_Data* sd)
+{
+	Positions* p = (Positions*)sd->user;
+	const char* doc = p->doc + sd->start_pos;
+
+	p->n_events++;
+	/* End of a node without children has the same position as its start */
+	if ((sd->start_pos == p->last_start && sd->end_pos == p->last_end)
+		|| (!strncmp(doc, "</", 2) && !strncmp(doc + 2, node->tag, strlen(node->tag))
+			&& check_position(sd, doc, (size_t)(sd->end_pos - sd->start_pos))))
+		p->n_ok++;
+
+	return true;
+}
+
+static int pos_text(SXML_CHAR* text, SAX_Data* sd)
+{
+	Positions* p = (Positions*)sd->user;
+
+	p->n_events++;
+	if (check_position(sd, text, strlen(text)))
+		p->n_ok++;
+
+	return true;
+}
+
+static void test_positions(void)
+{
+	static const char* doc = "<root>\n  <a x='1'>t &amp; u</a>\n\t<b/><c\n y=\"2\"></c>\n</root>";
+	char path[SXMLC_MAX_PATH];
+	SAX_Callbacks sax;
+	Positions p;
+	XMLReader* reader;
+	XMLEvent event;
+	int64_t start, end;
+	char* big;
+
+	CHECK(sizeof(p.last_start) == 8);
+	SAX_Callbacks_init(&sax);
+	sax.start_node = pos_start;
+	sax.end_node = pos_end;
+	sax.new_text = pos_text;
+	p.doc = doc;
+	p.n_events = p.n_ok = 0;
+	CHECK(XMLDoc_parse_buffer_SAX(C2SX(doc), C2SX("positions"), &sax, &p));
+	CHECK(p.n_events == 12 && p.n_ok == 12);
+
+	reader = XMLReader_open_buffer(C2SX(doc), C2SX("positions"));
+	while (reader != NULL && (event = XMLReader_next(reader)) != XML_EVENT_END_DOC && event != XML_EVENT_ERROR) {
+		if (event == XML_EVENT_START_NODE && !strcmp(XMLReader_node(reader)->tag, "c")) {
+			CHECK(XMLReader_position(reader, &start, &end));
+			CHECK(start == strstr(doc, "<c") - doc && end == strstr(doc, "</c>") - doc);
+			CHECK(XMLReader_column(reader) == 6);
+		}
+	}
+	XMLReader_free(reader);
+
+	/* Positions over several blocks */
+	temp_path(path, "sxmlc_positions.xml");
+	big = make_doc("<root>\n", "</root>\n", 3 * SXMLC_BLOCK_SIZE / 40);
+	if (big == NULL)
+		return;
+	CHECK(write_file(path, big, strlen(big)));
+	p.doc = big;
+	p.n_events = p.n_ok = 0;
+	CHECK(XMLDoc_parse_file_SAX(C2SX(path), &sax, &p));
+	CHECK(p.n_events > 0 && p.n_ok == p.n_events);
+	free(big);
+	remove(path);
+}
+
+/* --- Names and values scan --- */
+
+static void test_scan(void)
+{
+	char name[128], value[128], buf[1024];
+	XMLDoc doc;
+	XMLNode* node;
+	int len, i, ok;
+
+	for (len = 1; len <= 80; len++) {
+		for (i = 0; i < len; i++) {
+			name[i] = (char)('a' + i % 26);
+			value[i] = (char)('A' + i % 26);
+		}
+		name[len] = value[len] = '\0';
+		/* Characters looked for by the scan inside a quoted value */
+		if (len > 4)
+			memcpy(value + len / 2, "> /=", 4);
+		sprintf(buf, "<%s %s=\"%s\" %s2 = '%s' u=%.*s\t%s3=x/>", name, name, value, name, value, len, name, name);
+		XMLDoc_init(&doc);
+		CHECK(XMLDoc_parse_buffer_DOM(C2SX(buf), C2SX("scan"), &doc));
+		ok = (doc.i_root >= 0);
+		if (ok) {
+			node = XMLDoc_root(&doc);
+			ok = (!strcmp(node->tag, name) && node->n_attributes == 4
+				&& !strcmp(node->attributes[0].name, name) && !strcmp(node->attributes[0].value, value)
+				&& !strncmp(node->attributes[1].name, name, len) && !strcmp(node->attributes[1].name + len, "2")
+				&& !strcmp(node->attributes[1].value, value)
+				&& !strcmp(node->attributes[2].name, "u") && !strcmp(node->attributes[2].value, name)
+				&& !strcmp(node->attributes[3].value, "x"));
+		}
+		CHECK(ok);
+		XMLDoc_free(&doc);
+	}
+}
+
+/* --- Tags split between blocks --- */
+
+static void test_split_tags(void)
+{
+	static const char* tags = "<a b='x>y'/><!-- c > d --><![CDATA[ <e> ]]><?pi f > g?><h i=\">\">j</h>";
+	char path[SXMLC_MAX_PATH];
+	char *doc, *ref, *s;
+	size_t len, i;
+	int k;
+
+	temp_path(path, "sxmlc_split.xml");
+	len = SXMLC_BLOCK_SIZE + strlen(tags) + 64;
+	doc = (char*)malloc(len + 1);
+	if (doc == NULL)
+		return;
+	/* Put each character of 'tags' at the end of the first block */
+	for (k = 0; k <= (int)strlen(tags); k++) {
+		i = sprintf(doc, "<root><p>");
+		memset(doc + i, 'x', SXMLC_BLOCK_SIZE - i - 4 - k);
+		i = SXMLC_BLOCK_SIZE - 4 - k;
+		i += sprintf(doc + i, "</p>%s</root>", tags);
+		CHECK(write_file(path, doc, i));
+		ref = buffer_print(C2SX(doc));
+		s = file_print(path);
+		CHECK(ref != NULL && same_print(s, ref));
+		free(ref);
+		free(s);
+	}
+	free(doc);
+	remove(path);
+}
+
+/* --- Node strings and attributes reused by the parser --- */
+
+static const int n_attrs[] = { 0, 3, 40, 1, 0, 17 };
+
+static int reuse_start(const XMLNode* node, SAX_Data* sd)
+{
+	XMLNode* root = (XMLNode*)sd->user;
+	XMLNode* dup;
+
+	if (!strcmp(node->tag, "r"))
+		return true;
+	/* Strings given to callbacks are only valid during the call */
+	dup = XMLNode_dup(node, true);
+
+	return dup != NULL && XMLNode_add_child(root, dup);
+}
+
+static void test_reuse(void)
+{
+	char buf[2048], tag[300];
+	XMLNode root;
+	XMLNode* node;
+	SAX_Callbacks sax;
+	char* p;
+	int i, j, ok;
+
+	/* Long tag first, then shorter ones with more or less attributes */
+	memset(tag, 't', sizeof(tag) - 1);
+	tag[sizeof(tag) - 1] = '\0';
+	p = buf + sprintf(buf, "<r><%s/>", tag);
+	for (i = 0; i < (int)(sizeof(n_attrs) / sizeof(n_attrs[0])); i++) {
+		p += sprintf(p, "<n%d", i);
+		for (j = 0; j < n_attrs[i]; j++)
+			p += sprintf(p, " a%d='%d%s'", j, i, (j % 2 ? "&amp;" : ""));
+		p += sprintf(p, "/>");
+	}
+	sprintf(p, "</r>");
+
+	XMLNode_init(&root);
+	SAX_Callbacks_init(&sax);
+	sax.start_node = reuse_start;
+	CHECK(XMLDoc_parse_buffer_SAX(C2SX(buf), C2SX("reuse"), &sax, &root));
+	CHECK(root.n_children == 1 + (int)(sizeof(n_attrs) / sizeof(n_attrs[0])));
+	if (root.n_children > 0)
+		CHECK(!strcmp(root.children[0]->tag, tag));
+	for (i = 1; i < root.n_children; i++) {
+		node = root.children[i];
+		ok = (node->n_attributes == n_attrs[i - 1] && node->tag[0] == 'n' && atoi(node->tag + 1) == i - 1);
+		for (j = 0; ok && j < node->n_attributes; j++) {
+			sprintf(buf, "%d%s", i - 1, (j % 2 ? "&" : ""));
+			ok = (atoi(node->attributes[j].name + 1) == j && !strcmp(node->attributes[j].value, buf));
+		}
+		CHECK(ok);
+	}
+	XMLNode_free(&root);
+}
+
+/* --- Lazy attribute values --- */
+
+typedef struct _LazyValues {
+	int n_escaped;	/* Number of attribute values given with their escape sequences */
+	int n_ok;		/* Number of attribute values converted as expected */
+} LazyValues;
+
+static int lazy_values_start(const XMLNode* node, SAX_Data* sd)
+{
+	LazyValues* lv = (LazyValues*)sd->user;
+	XMLAttribute* attr;
+	int i;
+
+	for (i = 0; i < node->n_attributes; i++) {
+		attr = &node->attributes[i];
+		if (attr->escaped && !sx_strcmp(attr->value, C2SX("x&amp;&lt;y")))
+			lv->n_escaped++;
+		if (!sx_strcmp(XMLAttribute_get_value(attr), C2SX("x&<y")) && !attr->escaped)
+			lv->n_ok++;
+	}
+
+	return true;
+}
+
+static void test_lazy_attributes(void)
+{
+	static const char* doc = "<r v='x&amp;&lt;y'><a v=\"x&amp;&lt;y\"/></r>";
+	XMLContext ctx;
+	SAX_Callbacks sax;
+	LazyValues lv;
+	XMLDoc d;
+
+	XMLContext_init(&ctx);
+	SAX_Callbacks_init(&sax);
+	sax.start_node = lazy_values_start;
+	lv.n_escaped = lv.n_ok = 0;
+	CHECK(XMLDoc_parse_buffer_SAX_ctx(C2SX(doc), C2SX("lazy"), &sax, &lv, &ctx));
+	CHECK(lv.n_escaped == 0 && lv.n_ok == 2);
+
+	ctx.lazy_values = true;
+	lv.n_escaped = lv.n_ok = 0;
+	CHECK(XMLDoc_parse_buffer_SAX_ctx(C2SX(doc), C2SX("lazy"), &sax, &lv, &ctx));
+	CHECK(lv.n_escaped == 2 && lv.n_ok == 2);
+
+	/* DOM nodes always have converted values */
+	XMLDoc_init(&d);
+	CHECK(XMLDoc_parse_buffer_DOM_ctx(C2SX(doc), C2SX("lazy"), &d, false, &ctx));
+	CHECK(d.i_root >= 0 && !XMLDoc_root(&d)->attributes[0].escaped && !sx_strcmp(XMLDoc_root(&d)->attributes[0].value, C2SX("x&<y")));
+	XMLDoc_free(&d);
+	XMLContext_free(&ctx);
+}
+
+/* --- Searches on lazy attribute values --- */
+
+typedef struct _LazySearch {
+	XMLSearch search;
+	int n_matches;
+	int n_escaped;	/* Number of attribute values still escaped after the search */
+} LazySearch;
+
+static int lazy_start(const XMLNode* node, SAX_Data* sd)
+{
+	LazySearch* ls = (LazySearch*)sd->user;
+	int i;
+
+	if (XMLSearch_node_matches(node, &ls->search))
+		ls->n_matches++;
+	for (i = 0; i < node->n_attributes; i++) {
+		if (node->attributes[i].escaped && sx_strchr(node->attributes[i].value, C2SX('&')) != NULL)
+			ls->n_escaped++;
+	}
+
+	return true;
+}
+
+static void test_lazy_search(void)
+{
+	static const char* doc = "<r><a v=\"x&amp;y\"/><a v=\"x&amp;z\"/><a v='&lt;"
+		"0123456789012345678901234567890123456789012345678901234567890123456789"
+		"0123456789012345678901234567890123456789012345678901234567890123456789&gt;'/></r>";
+	XMLContext ctx;
+	SAX_Callbacks sax;
+	LazySearch ls;
+
+	XMLContext_init(&ctx);
+	ctx.lazy_values = true;
+	SAX_Callbacks_init(&sax);
+	sax.start_node = lazy_start;
+
+	/* Searches do not convert values of the searched nodes */
+	memset(&ls.search, 0, sizeof(ls.search)); /* 'XMLSearch_init' frees a search it finds initialized */
+	XMLSearch_init(&ls.search);
+	XMLSearch_search_set_tag(&ls.search, C2SX("a"));
+	XMLSearch_search_add_attribute(&ls.search, C2SX("v"), C2SX("x&y"), true);
+	ls.n_matches = ls.n_escaped = 0;
+	CHECK(XMLDoc_parse_buffer_SAX_ctx(C2SX(doc), C2SX("lazy"), &sax, &ls, &ctx));
+	CHECK(ls.n_matches == 1);
+	CHECK(ls.n_escaped == 3);
+	XMLSearch_free(&ls.search, true);
+
+	/* Long values */
+	XMLSearch_init(&ls.search);
+	XMLSearch_search_add_attribute(&ls.search, C2SX("v"), C2SX("<0123*>"), true);
+	ls.n_matches = ls.n_escaped = 0;
+	CHECK(XMLDoc_parse_buffer_SAX_ctx(C2SX(doc), C2SX("lazy"), &sax, &ls, &ctx));
+	CHECK(ls.n_matches == 1);
+	CHECK(ls.n_escaped == 3);
+	XMLSearch_free(&ls.search, true);
+	XMLContext_free(&ctx);
+}
+
+/* --- Escape sequences --- */
+
+static void test_entities(void)
+{
+	static const char* cases[][2] = {
+		{ "&lt;&gt;&amp;&quot;&apos;", "<>&\"'" },
+		{ "a&#65;&#x42;&#X43;z", "aABCz" },
+		{ "&#233;&#x20AC;&#x1F600;", "\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80" },
+		{ "&#0;&#xD800;&#x110000;&#;&#x;&#65&#xZ;", "&#0;&#xD800;&#x110000;&#;&#x;&#65&#xZ;" },
+		{ "&unknown;&amp&;", "&unknown;&amp&;" },
+		{ "&amp;lt;", "&lt;" }
+	};
+	SXML_CHAR html[64], buf[64];
+	XMLDoc doc;
+	int i;
+
+	for (i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+		sx_strcpy(html, C2SX(cases[i][0]));
+		CHECK(!sx_strcmp(html2str(html, buf), C2SX(cases[i][1])));
+		/* In place */
+		CHECK(!sx_strcmp(html2str(html, NULL), C2SX(cases[i][1])));
+	}
+
+	/* Attribute values */
+	XMLDoc_init(&doc);
+	CHECK(XMLDoc_parse_buffer_DOM(C2SX("<a v='&#x3C;&#233;&#xD800;'/>"), C2SX("entities"), &doc));
+	CHECK(doc.i_root >= 0 && !sx_strcmp(XMLDoc_root(&doc)->attributes[0].value, C2SX("<\xc3\xa9&#xD800;")));
+	XMLDoc_free(&doc);
+}
+
+/* --- User tags --- */
+
+typedef struct _UserTags {
+	char trace[128];
+} UserTags;
+
+static int user_tag_start(const XMLNode* node, SAX_Data* sd)
+{
+	char* trace = ((UserTags*)sd->user)->trace;
+
+	sprintf(trace + strlen(trace), "%d[%s]", node->tag_type, node->tag);
+
+	return true;
+}
+
+static void test_user_tags(void)
+{
+	static const char* doc = "<r><#[ a ]#><#( b )#><% c %><!-- d --></r>";
+	XMLContext ctx;
+	SAX_Callbacks sax;
+	UserTags ut;
+	char expected[128];
+	int i1, i2, i3;
+
+	XMLContext_init(&ctx);
+	i1 = XMLContext_register_user_tag(&ctx, TAG_USER + 1, C2SX("<#["), C2SX("]#>"));
+	i2 = XMLContext_register_user_tag(&ctx, TAG_USER + 2, C2SX("<#("), C2SX(")#>"));
+	i3 = XMLContext_register_user_tag(&ctx, TAG_USER + 3, C2SX("<%"), C2SX("%>"));
+	CHECK(i1 == 0 && i2 == 1 && i3 == 2);
+	CHECK(XMLContext_register_user_tag(&ctx, TAG_USER, C2SX("#"), C2SX(">")) == -1);
+	CHECK(XMLContext_get_registered_user_tag(&ctx, TAG_USER + 2) == i2);
+	SAX_Callbacks_init(&sax);
+	sax.start_node = user_tag_start;
+
+	ut.trace[0] = '\0';
+	CHECK(XMLDoc_parse_buffer_SAX_ctx(C2SX(doc), C2SX("user"), &sax, &ut, &ctx));
+	sprintf(expected, "%d[r]%d[ a ]%d[ b ]%d[ c ]%d[ d ]", TAG_FATHER, TAG_USER + 1, TAG_USER + 2, TAG_USER + 3, TAG_COMMENT);
+	CHECK(!strcmp(ut.trace, expected));
+
+	/* The other tags are still found once the first one is unregistered */
+	CHECK(XMLContext_unregister_user_tag(&ctx, i1) == 2);
+	CHECK(XMLContext_get_registered_user_tag(&ctx, TAG_USER + 1) == -1);
+	CHECK(XMLContext_get_registered_user_tag(&ctx, TAG_USER + 3) == 1);
+	ut.trace[0] = '\0';
+	CHECK(XMLDoc_parse_buffer_SAX_ctx(C2SX("<r><#( b )#><% c %></r>"), C2SX("user"), &sax, &ut, &ctx));
+	sprintf(expected, "%d[r]%d[ b ]%d[ c ]", TAG_FATHER, TAG_USER + 2, TAG_USER + 3);
+	CHECK(!strcmp(ut.trace, expected));
+	XMLContext_free(&ctx);
+}
+
+/* --- UTF-8 validation --- */
+
+static void test_utf8(void)
+{
+	static const char* invalid[] = {
+		"\xc0\xaf",				/* Overlong */
+		"\xe0\x80\xaf",			/* Overlong */
+		"\xed\xa0\x80",			/* Surrogate */
+		"\xf4\x90\x80\x80",		/* Above U+10FFFF */
+		"\xe2\x82",				/* Truncated */
+		"\x80",					/* Continuation byte */
+		"\xff"
+	};
+	static const char* valid = "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80";
+	XMLContext ctx;
+	char buf[64];
+	wchar_t wcs[16];
+	int i;
+
+	XMLContext_init(&ctx);
+	ctx.check_utf8 = true;
+	sprintf(buf, "<a b='%s'>%s</a>", valid, valid);
+	CHECK(parse_error(buf, &ctx) == PARSE_ERR_NONE);
+	for (i = 0; i < (int)(sizeof(invalid) / sizeof(invalid[0])); i++) {
+		CHECK(utf8_check(invalid[i], strlen(invalid[i])) == 0);
+		sprintf(buf, "<a>x%sy</a>", invalid[i]);
+		CHECK(parse_error(buf, &ctx) == PARSE_ERR_ENCODING);
+		sprintf(buf, "<a b='%s'/>", invalid[i]);
+		CHECK(parse_error(buf, &ctx) == PARSE_ERR_ENCODING);
+		sprintf(buf, "<a%s/>", invalid[i]);
+		CHECK(parse_error(buf, &ctx) == PARSE_ERR_ENCODING);
+	}
+	/* Not checked by default */
+	ctx.check_utf8 = false;
+	CHECK(parse_error("<a>\xff</a>", &ctx) == PARSE_ERR_NONE);
+	XMLContext_free(&ctx);
+
+	CHECK(utf8_check(valid, strlen(valid)) == strlen(valid));
+	CHECK(utf8_check("0123456789abcdef0123\xc3\xa9\xff", 23) == 22);
+	CHECK(utf8_wcslen(valid) == (sizeof(wchar_t) == 2 ? 9 : 8));
+	CHECK(utf8_to_wcs(valid, wcs) == wcs && wcs[3] == 0xe9 && wcs[5] == 0x20ac);
+	CHECK(utf8_wcslen("a\xffz") == 3);
+	CHECK(utf8_to_wcs("a\xffz", wcs) == wcs && wcs[1] == 0xfffd && wcs[3] == 0);
+}
+
+/* --- UTF-16 and UTF-32 input --- */
+
+/*
+ Return UTF-8 string 'utf8' encoded in UTF-16 ('unit' 2) or UTF-32 ('unit' 4), with a BOM
+ (to be freed). Its size in bytes is stored in 'n'.
+ */
+static unsigned char* encode(const char* utf8, int unit, int big_endian, size_t* n)
+{
+	const unsigned char* s = (const unsigned char*)utf8;
+	unsigned char* data;
+	unsigned long cp, units[2];
+	int i, j, n_units;
+
+	data = (unsigned char*)malloc((strlen(utf8) + 1) * 2 * unit);
+	if (data == NULL)
+		return NULL;
+	*n = 0;
+	for (cp = 0xfeff; ; ) {
+		if (unit == 2 && cp > 0xffff) {
+			units[0] = 0xd800 + ((cp - 0x10000) >> 10);
+			units[1] = 0xdc00 + ((cp - 0x10000) & 0x3ff);
+			n_units = 2;
+		} else {
+			units[0] = cp;
+			n_units = 1;
+		}
+		for (i = 0; i < n_units; i++) {
+			for (j = 0; j < unit; j++)
+				data[*n + j] = (unsigned char)(units[i] >> (8 * (big_endian ? unit - 1 - j : j)));
+			*n += unit;
+		}
+		if (*s == 0)
+			break;
+		if (*s < 0x80)
+			cp = *s++;
+		else if (*s < 0xe0) {
+			cp = ((s[0] & 0x1fUL) << 6) | (s[1] & 0x3f);
+			s += 2;
+		} else if (*s < 0xf0) {
+			cp = ((s[0] & 0x0fUL) << 12) | ((s[1] & 0x3fUL) << 6) | (s[2] & 0x3f);
+			s += 3;
+		} else {
+			cp = ((s[0] & 0x07UL) << 18) | ((s[1] & 0x3fUL) << 12) | ((s[2] & 0x3fUL) << 6) | (s[3] & 0x3f);
+			s += 4;
+		}
+	}
+	*n -= unit; /* No terminating NUL */
+
+	return data;
+}
+
+static void test_utf16_32(void)
+{
+	static const char* node = "\t<u t=\"caf\xc3\xa9\">\xf0\x9f\x98\x80 &#x1F600; \xe2\x82\xac<x y='\xc3\xa0'/></u>\n";
+	static const int units[] = { 2, 4 };
+	char path[SXMLC_MAX_PATH];
+	XMLDoc doc;
+	char *utf8, *p, *ref, *s;
+	unsigned char* data;
+	size_t n;
+	int i, big_endian;
+
+	temp_path(path, "sxmlc_utf16_32.xml");
+	/* Big enough to be read in several blocks */
+	utf8 = (char*)malloc(strlen(node) * 5000 + 16);
+	if (utf8 == NULL)
+		return;
+	p = utf8 + sprintf(utf8, "<root>\n");
+	for (i = 0; i < 5000; i++)
+		p += sprintf(p, "%s", node);
+	sprintf(p, "</root>\n");
+	ref = buffer_print(C2SX(utf8));
+	CHECK(ref != NULL);
+
+	for (i = 0; i < 2; i++) {
+		for (big_endian = 0; big_endian < 2; big_endian++) {
+			data = encode(utf8, units[i], big_endian, &n);
+			if (data == NULL)
+				continue;
+
+			XMLDoc_init(&doc);
+			CHECK(XMLDoc_parse_bytes_DOM(data, n, C2SX("bytes"), &doc));
+			s = doc_print(&doc);
+			CHECK(same_print(s, ref));
+			free(s);
+			XMLDoc_free(&doc);
+
+			CHECK(write_file(path, data, n));
+			s = file_print(path);
+			CHECK(same_print(s, ref));
+			free(s);
+			remove(path);
+
+			/* Truncated in the middle of a character */
+			XMLDoc_init(&doc);
+			CHECK(!XMLDoc_parse_bytes_DOM(data, n - 1, C2SX("bytes"), &doc));
+			XMLDoc_free(&doc);
+			free(data);
+		}
+	}
+	free(ref);
+	free(utf8);
+}
+
+/* --- Text spaces --- */
+
+static int spaces_text(SXML_CHAR* text, SAX_Data* sd)
+{
+	char* trace = (char*)sd->user;
+
+	strcat(trace, "[");
+	strcat(trace, text);
+	strcat(trace, "]");
+
+	return true;
+}
+
+static void test_text_spaces(void)
+{
+	static const char* doc = "<r>\n\t<a> x  y </a>\n\t<b>z</b> <c>\n</c><d><![CDATA[ ]]></d>\n</r>";
+	static const char* expected[] = {
+		"[\n\t][ x  y ][\n\t][z][ ][\n][\n]",	/* TEXT_SPACES_KEEP */
+		"[ x  y ][z]",							/* TEXT_SPACES_SKIP */
+		"[x  y][z]"								/* TEXT_SPACES_TRIM */
+	};
+	XMLContext ctx;
+	SAX_Callbacks sax;
+	XMLDoc d;
+	XMLNode* root;
+	char trace[128];
+	int i;
+
+	XMLContext_init(&ctx);
+	CHECK(ctx.text_spaces == TEXT_SPACES_KEEP);
+	SAX_Callbacks_init(&sax);
+	sax.new_text = spaces_text;
+	for (i = TEXT_SPACES_KEEP; i <= TEXT_SPACES_TRIM; i++) {
+		ctx.text_spaces = (TextSpaces)i;
+		trace[0] = '\0';
+		CHECK(XMLDoc_parse_buffer_SAX_ctx(C2SX(doc), C2SX("spaces"), &sax, trace, &ctx));
+		CHECK(!strcmp(trace, expected[i]));
+	}
+
+	/* Dropped texts are not stored in the DOM */
+	ctx.text_spaces = TEXT_SPACES_SKIP;
+	XMLDoc_init(&d);
+	CHECK(XMLDoc_parse_buffer_DOM_ctx(C2SX(doc), C2SX("spaces"), &d, false, &ctx));
+	if (d.i_root >= 0) {
+		root = XMLDoc_root(&d);
+		CHECK(root->n_children == 4 && !sx_strcmp(root->children[0]->text, C2SX(" x  y ")));
+		CHECK(root->children[2]->text == NULL);
+	}
+	XMLDoc_free(&d);
+	XMLContext_free(&ctx);
+}
+
+/* --- Namespaces --- */
+
+/*
+ Return 'true' if 'uri' is 'expected' (both can be NULL).
+ */
+static int same_uri(const SXML_CHAR* uri, const char* expected)
+{
+	if (uri == NULL || expected == NULL)
+		return uri == NULL && expected == NULL;
+
+	return sx_strcmp(uri, C2SX(expected)) == 0;
+}
+
+static void test_namespaces(void)
+{
+	static const char* doc = "<s:Envelope xmlns:s=\"urn:soap\" xmlns=\"urn:d\">"
+		"<s:Body><a x=\"1\" s:y=\"2\" xml:lang=\"fr\"/><b xmlns=\"\"><c/></b><s:Body xmlns:s=\"urn:other\"/><p:q/></s:Body>"
+		"<tail/></s:Envelope>";
+	XMLContext ctx;
+	XMLDoc d;
+	XMLSearch search;
+	XMLNode *root, *body, *a, *b, *node;
+	int n;
+
+	XMLContext_init(&ctx);
+	ctx.namespaces = true;
+	XMLDoc_init(&d);
+	CHECK(XMLDoc_parse_buffer_DOM_ctx(C2SX(doc), C2SX("ns"), &d, false, &ctx));
+	CHECK(d.ns_uris != NULL && d.i_root >= 0);
+	if (d.i_root < 0) {
+		XMLDoc_free(&d);
+		return;
+	}
+	root = XMLDoc_root(&d);
+	CHECK(same_uri(root->ns_uri, "urn:soap") && !sx_strcmp(root->local_name, C2SX("Envelope")));
+	CHECK(same_uri(root->attributes[0].ns_uri, "http://www.w3.org/2000/xmlns/"));
+	body = root->children[0];
+	/* Nodes of a document share their URIs */
+	CHECK(body->ns_uri == root->ns_uri);
+	a = body->children[0];
+	CHECK(same_uri(a->ns_uri, "urn:d") && !sx_strcmp(a->local_name, C2SX("a")));
+	CHECK(same_uri(a->attributes[0].ns_uri, NULL));
+	CHECK(same_uri(a->attributes[1].ns_uri, "urn:soap") && !sx_strcmp(a->attributes[1].local_name, C2SX("y")));
+	CHECK(same_uri(a->attributes[2].ns_uri, "http://www.w3.org/XML/1998/namespace"));
+	/* Default namespace undeclared */
+	b = body->children[1];
+	CHECK(same_uri(b->ns_uri, NULL) && same_uri(b->children[0]->ns_uri, NULL));
+	/* Prefix redeclared, then back to the outer declaration */
+	CHECK(same_uri(body->children[2]->ns_uri, "urn:other"));
+	/* Undeclared prefix */
+	CHECK(same_uri(body->children[3]->ns_uri, NULL) && !sx_strcmp(body->children[3]->local_name, C2SX("q")));
+	CHECK(same_uri(root->children[1]->ns_uri, "urn:d"));
+
+	/* Search on (URI, local name) */
+	memset(&search, 0, sizeof(search)); /* 'XMLSearch_init' frees a search it finds initialized */
+	XMLSearch_init(&search);
+	XMLSearch_search_set_ns(&search, C2SX("urn:soap"));
+	XMLSearch_search_set_tag(&search, C2SX("Body"));
+	n = 0;
+	for (node = root; (node = XMLSearch_next(node, &search)) != NULL; n++)
+		CHECK(node == body);
+	CHECK(n == 1);
+	XMLSearch_free(&search, true);
+	XMLDoc_free(&d);
+	XMLContext_free(&ctx);
+}
+
+/* --- Interned names --- */
+
+/*
+ Parse a document with 'intern_names' set to 'intern', change some of its nodes and return its
+ printout (to be freed).
+ */
+static char* interned_print(int intern)
+{
+	static const char* doc = "<r><a x='1' y='2'>t</a><a x='3' y='4'/><b x='5'/><a x='7'/></r>";
+	XMLContext ctx;
+	XMLDoc d;
+	XMLNode *r, *a1, *a2, *b, *dup;
+	char* s;
+
+	XMLContext_init(&ctx);
+	ctx.intern_names = intern;
+	XMLDoc_init(&d);
+	CHECK(XMLDoc_parse_buffer_DOM_ctx(C2SX(doc), C2SX("intern"), &d, false, &ctx));
+	CHECK(intern ? d.names != NULL : d.names == NULL);
+	r = XMLDoc_root(&d);
+	a1 = r->children[0];
+	a2 = r->children[1];
+	b = r->children[2];
+	if (intern) {
+		CHECK(a1->interned && a1->tag == a2->tag && a1->tag == r->children[3]->tag);
+		CHECK(a1->attributes[0].name == a2->attributes[0].name && a1->attributes[0].name == b->attributes[0].name);
+	}
+
+	/* Changes do not affect nodes sharing the same names */
+	CHECK(XMLNode_set_tag(a1, C2SX("c")));
+	CHECK(!a1->interned && !sx_strcmp(a2->tag, C2SX("a")));
+	CHECK(XMLNode_remove_attribute(a2, 0) == 1);
+	CHECK(!sx_strcmp(b->attributes[0].name, C2SX("x")));
+	CHECK(XMLNode_set_attribute(b, C2SX("z"), C2SX("6")) == 2);
+	CHECK(!sx_strcmp(a1->attributes[0].name, C2SX("x")));
+	dup = XMLNode_dup(r->children[3], true);
+	CHECK(dup != NULL && !dup->interned);
+	if (dup != NULL) {
+		XMLNode_free(dup);
+		free(dup);
+	}
+	CHECK(XMLNode_remove_child(r, 3, true) == 3);
+
+	s = doc_print(&d);
+	XMLDoc_free(&d);
+	XMLContext_free(&ctx);
+
+	return s;
+}
+
+static void test_intern_names(void)
+{
+	char *ref, *s;
+
+	ref = interned_print(false);
+	s = interned_print(true);
+	CHECK(ref != NULL && same_print(s, ref));
+	free(ref);
+	free(s);
+}
+
+/* --- Skipping children --- */
+
+static const char* skip_doc = "<r><skip a='</skip>'><x/><!-- </skip> --><![CDATA[</skip>]]><skip>t</skip><y>t</y></skip>"
+	"<z>t</z><skip/><skip></skip></r>";
+
+/* Events expected when skipping children of 'skip' nodes */
+static const char* skip_trace = "<r><skip></skip><z>#</z><skip></skip><skip></skip></r>";
+
+/*
+ Add start ('end' is 'false') or end of node 'tag' to 'trace'.
+ */
+static void add_trace(char* trace, const SXML_CHAR* tag, int end)
+{
+	strcat(trace, end ? "</" : "<");
+	strcat(trace, tag);
+	strcat(trace, ">");
+}
+
+static int skip_start(const XMLNode* node, SAX_Data* sd)
+{
+	add_trace((char*)sd->user, node->tag, false);
+
+	return strcmp(node->tag, "skip") ? true : SAX_SKIP_CHILDREN;
+}
+
+static int skip_end(const XMLNode* node, SAX_Data* sd)
+{
+	add_trace((char*)sd->user, node->tag, true);
+
+	return true;
+}
+
+static int skip_text(SXML_CHAR* text, SAX_Data* sd)
+{
+	(void)text;
+	strcat((char*)sd->user, "#");
+
+	return true;
+}
+
+static void test_skip(void)
+{
+	SAX_Callbacks sax;
+	XMLParser* parser;
+	XMLReader* reader;
+	XMLEvent event;
+	char trace[256];
+	size_t i;
+
+	SAX_Callbacks_init(&sax);
+	sax.start_node = skip_start;
+	sax.end_node = skip_end;
+	sax.new_text = skip_text;
+
+	trace[0] = '\0';
+	CHECK(XMLDoc_parse_buffer_SAX(C2SX(skip_doc), C2SX("skip"), &sax, trace));
+	CHECK(!strcmp(trace, skip_trace));
+
+	/* Skipped data split between chunks */
+	trace[0] = '\0';
+	parser = XMLParser_create(&sax, C2SX("skip"), trace);
+	for (i = 0; parser != NULL && i < strlen(skip_doc); i++)
+		CHECK(XMLParser_feed(parser, C2SX(skip_doc + i), 1));
+	CHECK(XMLParser_finish(parser));
+	XMLParser_free(parser);
+	CHECK(!strcmp(trace, skip_trace));
+
+	/* Pull parser: the end of a skipped node is not returned by 'XMLReader_next' */
+	trace[0] = '\0';
+	reader = XMLReader_open_buffer(C2SX(skip_doc), C2SX("skip"));
+	while ((event = XMLReader_next(reader)) != XML_EVENT_END_DOC && event != XML_EVENT_ERROR) {
+		switch (event) {
+			case XML_EVENT_START_NODE:
+				add_trace(trace, XMLReader_node(reader)->tag, false);
+				if (!strcmp(XMLReader_node(reader)->tag, "skip")) {
+					CHECK(XMLReader_skip(reader));
+					add_trace(trace, C2SX("skip"), true);
+				}
+				break;
+
+			case XML_EVENT_END_NODE:
+				add_trace(trace, XMLReader_node(reader)->tag, true);
+				break;
+
+			case XML_EVENT_TEXT:
+				strcat(trace, "#");
+				break;
+
+			default:
+				break;
+		}
+	}
+	CHECK(event == XML_EVENT_END_DOC);
+	CHECK(!strcmp(trace, skip_trace));
+	XMLReader_free(reader);
+}
+
+int main(void)
+{
+	test_block_input();
+	test_mmap();
+	test_push();
+	test_reader();
+	test_buffer_len();
+	test_user_source();
+	test_parallel();
+#ifdef TEST_THREADS
+	test_parallel_indented();
+#endif
+	test_limits();
+	test_files_pool();
+	test_records();
+	test_positions();
+	test_scan();
+	test_split_tags();
+	test_reuse();
+	test_lazy_attributes();
+	test_lazy_search();
+	test_entities();
+	test_user_tags();
+	test_utf8();
+	test_utf16_32();
+	test_text_spaces();
+	test_namespaces();
+	test_intern_names();
+	test_skip();
+
+	printf("%d checks, %d failed\n", n_checks, n_failed);
+
+	return n_failed;
+}
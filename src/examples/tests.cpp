@@ -0,0 +1,159 @@
+/*
+ * tests.cpp
+ *
+ * Checks of the C++ front end 'sxmlc.hpp'. 'main' returns the number of failed checks.
+ * Build with e.g.: cc -c ../sxmlc.c && c++ -std=c++11 -o tests_cpp tests.cpp sxmlc.o -lpthread
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "../sxmlc.hpp"
+
+static int n_checks = 0;
+static int n_failed = 0;
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+static void check(bool ok, const char* cond, const char* file, int line)
+{
+	n_checks++;
+	if (!ok) {
+		n_failed++;
+		fprintf(stderr, "%s:%d: check failed: %s\n", file, line, cond);
+	}
+}
+
+static const char* doc = "<r a='1'><x>t&amp;u</x><y><z/>v</y><w/></r>";
+
+/* Handler implementing all events, tracing them */
+struct Trace {
+	std::string trace;
+	int n_docs;
+	ParseError error;
+	const char* stop_at;	/* Tag which start stops parsing */
+	const char* skip;		/* Tag which children are skipped */
+
+	Trace() : n_docs(0), error(PARSE_ERR_NONE), stop_at(NULL), skip(NULL) {}
+
+	bool start_doc(XMLReader*) { n_docs++; return true; }
+	bool end_doc(XMLReader*) { trace += "$"; return true; }
+	int start_node(const XMLNode* node, XMLReader*)
+	{
+		trace += "<" + std::string(node->tag) + ">";
+		if (stop_at != NULL && !strcmp(node->tag, stop_at))
+			return false;
+		if (skip != NULL && !strcmp(node->tag, skip))
+			return SAX_SKIP_CHILDREN;
+
+		return true;
+	}
+	bool end_node(const XMLNode* node, XMLReader*) { trace += "</" + std::string(node->tag) + ">"; return true; }
+	bool new_text(const SXML_CHAR* text, size_t len, XMLReader*) { trace += std::string(text, len); return true; }
+	bool on_error(ParseError error_num, XMLReader*) { error = error_num; return true; }
+};
+
+/* Handler implementing only one event */
+struct CountNodes {
+	int n;
+
+	CountNodes() : n(0) {}
+	bool start_node(const XMLNode*, XMLReader*) { n++; return true; }
+};
+
+static void test_handlers()
+{
+	Trace t;
+	CountNodes c;
+	size_t len = strlen(doc);
+
+	CHECK(sxml::parse(sxml::buffer(C2SX(doc), len, C2SX("cpp")), t));
+	CHECK(t.n_docs == 1 && t.error == PARSE_ERR_NONE);
+	CHECK(t.trace == "<r><x>t&amp;u</x><y><z></z>v</y><w></w></r>$");
+
+	/* Buffers do not need to be NUL-terminated */
+	t = Trace();
+	CHECK(sxml::parse(sxml::buffer(C2SX(doc), strstr(doc, "<y>") - doc, C2SX("cpp")), t));
+	CHECK(t.trace == "<r><x>t&amp;u</x>$");
+
+	CHECK(sxml::parse(sxml::buffer(C2SX(doc), len), c));
+	CHECK(c.n == 5);
+	c.n = 0;
+	CHECK(sxml::parse<CountNodes>(sxml::buffer(C2SX(doc), len), &c));
+	CHECK(c.n == 5);
+
+	/* Stopped by the handler */
+	t = Trace();
+	t.stop_at = "y";
+	CHECK(!sxml::parse(sxml::buffer(C2SX(doc), len), t));
+	CHECK(t.trace == "<r><x>t&amp;u</x><y>$");
+
+	/* Malformed document */
+	t = Trace();
+	CHECK(!sxml::parse(sxml::buffer(C2SX("<r><x a='1></r>"), 15), t));
+	CHECK(t.error != PARSE_ERR_NONE && t.trace == "<r>$");
+
+	/* Skipped children */
+	t = Trace();
+	t.skip = "y";
+	CHECK(sxml::parse(sxml::buffer(C2SX(doc), len), t));
+	CHECK(t.trace == "<r><x>t&amp;u</x><y></y><w></w></r>$");
+	t = Trace();
+	t.skip = "w";
+	CHECK(sxml::parse(sxml::buffer(C2SX(doc), len), t));
+	CHECK(t.trace == "<r><x>t&amp;u</x><y><z></z>v</y><w></w></r>$");
+}
+
+static size_t read_doc(void* ctx, SXML_CHAR* buf, size_t n)
+{
+	const char** p = (const char**)ctx;
+	size_t len = strlen(*p);
+
+	if (n > len)
+		n = len;
+	if (n > 3)
+		n = 3;
+	memcpy(buf, *p, n);
+	*p += n;
+
+	return n;
+}
+
+static void test_sources()
+{
+	Trace t;
+	DataSourceUser source;
+	const char* p = doc;
+	FILE* f;
+	char path[SXMLC_MAX_PATH];
+	const char* dir = getenv("TMPDIR");
+
+	source.read = read_doc;
+	source.eof = NULL;
+	source.ctx = &p;
+	CHECK(sxml::parse(sxml::source(&source, C2SX("cpp")), t));
+	CHECK(t.trace == "<r><x>t&amp;u</x><y><z></z>v</y><w></w></r>$");
+
+	snprintf(path, sizeof(path), "%s/sxmlc_cpp.xml", (dir != NULL && dir[0] != '\0' ? dir : "/tmp"));
+	f = fopen(path, "wb");
+	CHECK(f != NULL);
+	if (f == NULL)
+		return;
+	fputs(doc, f);
+	fclose(f);
+	t = Trace();
+	CHECK(sxml::parse(sxml::file(C2SX(path)), t));
+	CHECK(t.trace == "<r><x>t&amp;u</x><y><z></z>v</y><w></w></r>$");
+	remove(path);
+	CHECK(!sxml::parse(sxml::file(C2SX(path)), t));
+}
+
+int main()
+{
+	test_handlers();
+	test_sources();
+
+	printf("%d checks, %d failed\n", n_checks, n_failed);
+
+	return n_failed;
+}
@@ -41,25 +41,34 @@
 #include <ctype.h>
 #include "sxmlc.h"
 
-/*
- Struct defining "special" tags such as "<? ?>" or "<![CDATA[ ]]/>".
- These tags are considered having a start and an end with some data in between that will
- be stored in the 'tag' member of an XMLNode.
- The 'tag_type' member is a constant that is associated to such tag.
- All 'len_*' members are basically the "sx_strlen()" of 'start' and 'end' members.
- */
-typedef struct _Tag {
-	TagType tag_type;
-	SXML_CHAR* start;
-	int len_start;
-	SXML_CHAR* end;
-	int len_end;
-} _TAG;
+/* Memory-mapped files are only handled on POSIX systems, and when characters are bytes */
+#if !defined(WIN32) && !defined(WIN64) && !defined(SXMLC_UNICODE)
+#define SXMLC_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifndef SXMLC_NO_THREADS
+#define SXMLC_THREADS
+#include <pthread.h>
+#endif
+#endif
 
-typedef struct _SpecialTag {
-	_TAG *tags;
-	int n_tags;
-} SPECIAL_TAG;
+/* Structural characters are scanned with SSE2 (and AVX2 when the processor has it) on x86, when characters are bytes */
+#if !defined(SXMLC_UNICODE) && !defined(SXMLC_NO_SIMD)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SXMLC_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SXMLC_AVX2
+#include <immintrin.h>
+#endif
+#endif
+#endif
 
 /*
  List of "special" tags handled by sxmlc.
@@ -73,12 +82,64 @@ static _TAG _spec[] = {
 };
 static int NB_SPECIAL_TAGS = (int)(sizeof(_spec) / sizeof(_TAG)); /* Auto computation of number of special tags */
 
+/* "<!DOCTYPE", which end is '>' or "]>" (only used to find the tag kind) */
+static _TAG _doctype = { TAG_DOCTYPE, C2SX("<!DOCTYPE"), 9, C2SX(">"), 1 };
+
 /*
  User-registered tags.
  */
-static SPECIAL_TAG _user_tags = { NULL, 0 };
+static SPECIAL_TAG _user_tags = { NULL, 0, NULL, 0 };
 
-int XML_register_user_tag(TagType tag_type, SXML_CHAR* start, SXML_CHAR* end)
+/*
+ Rebuild the prefix tree of 'user_tags' starts, without tag 'i_skip' (-1 to keep all tags) as
+ it is about to be removed.
+ Return 'false' on memory error, in which case the previous tree is kept.
+ */
+static int _build_tag_trie(SPECIAL_TAG* user_tags, int i_skip)
+{
+	_TAG_TRIE* trie;
+	int i, i_tag, k, n, node, child;
+
+	for (i = 0, n = 1; i < user_tags->n_tags; i++)
+		n += user_tags->tags[i].len_start - 1;
+	trie = (_TAG_TRIE*)__malloc(n * sizeof(_TAG_TRIE));
+	if (trie == NULL)
+		return false;
+
+	trie[0].c = C2SX('<');
+	trie[0].child = trie[0].next = trie[0].i_tag = -1;
+	trie[0].min_tag = 0;
+	n = 1;
+	for (i = i_tag = 0; i < user_tags->n_tags; i++) {
+		if (i == i_skip)
+			continue;
+		/* Tags are inserted by increasing index, so 'min_tag' is the index of the tag which created the node */
+		for (k = 1, node = 0; k < user_tags->tags[i].len_start; k++, node = child) {
+			for (child = trie[node].child; child >= 0 && trie[child].c != user_tags->tags[i].start[k]; child = trie[child].next) ;
+			if (child < 0) {
+				child = n++;
+				trie[child].c = user_tags->tags[i].start[k];
+				trie[child].child = -1;
+				trie[child].next = trie[node].child;
+				trie[child].i_tag = -1;
+				trie[child].min_tag = i_tag;
+				trie[node].child = child;
+			}
+		}
+		if (trie[node].i_tag < 0)
+			trie[node].i_tag = i_tag;
+		i_tag++;
+	}
+
+	if (user_tags->trie != NULL)
+		__free(user_tags->trie);
+	user_tags->trie = trie;
+	user_tags->n_trie = n;
+
+	return true;
+}
+
+static int _register_user_tag(SPECIAL_TAG* user_tags, TagType tag_type, SXML_CHAR* start, SXML_CHAR* end)
 {
 	_TAG* p;
 	int i, n, le;
@@ -93,9 +154,9 @@ int XML_register_user_tag(TagType tag_type, SXML_CHAR* start, SXML_CHAR* end)
 	if (end[le-1] != C2SX('>'))
 		return -1;
 
-	i = _user_tags.n_tags;
+	i = user_tags->n_tags;
 	n = i + 1;
-	p = (_TAG*)__realloc(_user_tags.tags, n * sizeof(_TAG));
+	p = (_TAG*)__realloc(user_tags->tags, n * sizeof(_TAG));
 	if (p == NULL)
 		return -1;
 
@@ -104,37 +165,69 @@ int XML_register_user_tag(TagType tag_type, SXML_CHAR* start, SXML_CHAR* end)
 	p[i].end = end;
 	p[i].len_start = sx_strlen(start);
 	p[i].len_end = le;
-	_user_tags.tags = p;
-	_user_tags.n_tags = n;
+	user_tags->tags = p;
+	user_tags->n_tags = n;
+	if (!_build_tag_trie(user_tags, -1)) {
+		user_tags->n_tags--;
+		return -1;
+	}
 
 	return i;
 }
 
-int XML_unregister_user_tag(int i_tag)
+static int _unregister_user_tag(SPECIAL_TAG* user_tags, int i_tag)
 {
 	_TAG* pt;
 
-	if (i_tag < 0 || i_tag >= _user_tags.n_tags)
+	if (i_tag < 0 || i_tag >= user_tags->n_tags)
  		return -1;
 
-	if (_user_tags.n_tags == 1)
+	if (user_tags->n_tags == 1)
 		pt = NULL;
 	else {
-		pt = (_TAG*)__malloc((_user_tags.n_tags - 1) * sizeof(_TAG));
+		pt = (_TAG*)__malloc((user_tags->n_tags - 1) * sizeof(_TAG));
 		if (pt == NULL)
 			return -1;
 	}
- 
+
+	/* Tree rebuilt once the new array is allocated, so tags and tree both stay unchanged on error */
+	if (!_build_tag_trie(user_tags, i_tag)) {
+		if (pt != NULL)
+			__free(pt);
+		return -1;
+	}
+
 	if (pt != NULL) {
-		memcpy(pt, _user_tags.tags, i_tag * sizeof(_TAG));
-		memcpy(&pt[i_tag], &_user_tags.tags[i_tag + 1], (_user_tags.n_tags - i_tag - 1) * sizeof(_TAG));
+		memcpy(pt, user_tags->tags, i_tag * sizeof(_TAG));
+		memcpy(&pt[i_tag], &user_tags->tags[i_tag + 1], (user_tags->n_tags - i_tag - 1) * sizeof(_TAG));
 	}
-	if (_user_tags.tags != NULL)
-		__free(_user_tags.tags);
-	_user_tags.tags = pt;
-	_user_tags.n_tags--;
+	if (user_tags->tags != NULL)
+		__free(user_tags->tags);
+	user_tags->tags = pt;
+	user_tags->n_tags--;
 
-	return _user_tags.n_tags;
+	return user_tags->n_tags;
+}
+
+static int _get_registered_user_tag(const SPECIAL_TAG* user_tags, TagType tag_type)
+{
+	int i;
+
+	for (i = 0; i < user_tags->n_tags; i++)
+		if (user_tags->tags[i].tag_type == tag_type)
+			return i;
+
+	return -1;
+}
+
+int XML_register_user_tag(TagType tag_type, SXML_CHAR* start, SXML_CHAR* end)
+{
+	return _register_user_tag(&_user_tags, tag_type, start, end);
+}
+
+int XML_unregister_user_tag(int i_tag)
+{
+	return _unregister_user_tag(&_user_tags, i_tag);
 }
 
 int XML_get_nb_registered_user_tags(void)
@@ -144,15 +237,185 @@ int XML_get_nb_registered_user_tags(void)
 
 int XML_get_registered_user_tag(TagType tag_type)
 {
-	int i;
+	return _get_registered_user_tag(&_user_tags, tag_type);
+}
 
-	for (i = 0; i < _user_tags.n_tags; i++)
-		if (_user_tags.tags[i].tag_type == tag_type)
-			return i;
+/* --- XMLContext --- */
 
-	return -1;
+int XMLContext_init(XMLContext* ctx)
+{
+	if (ctx == NULL)
+		return false;
+
+	ctx->user_tags.tags = NULL;
+	ctx->user_tags.n_tags = 0;
+	ctx->user_tags.trie = NULL;
+	ctx->user_tags.n_trie = 0;
+	ctx->regexpr_compare = NULL;
+	ctx->mem_realloc = NULL;
+	ctx->mem_free = NULL;
+	ctx->max_depth = 0;
+	ctx->max_token_len = 0;
+	ctx->lazy_values = false;
+	ctx->check_utf8 = false;
+	ctx->text_spaces = TEXT_SPACES_KEEP;
+	ctx->namespaces = false;
+	ctx->intern_names = false;
+	ctx->init_value = XML_INIT_DONE;
+
+	return true;
+}
+
+int XMLContext_free(XMLContext* ctx)
+{
+	if (ctx == NULL || ctx->init_value != XML_INIT_DONE)
+		return false;
+
+	if (ctx->user_tags.tags != NULL)
+		__free(ctx->user_tags.tags);
+	ctx->user_tags.tags = NULL;
+	ctx->user_tags.n_tags = 0;
+	if (ctx->user_tags.trie != NULL)
+		__free(ctx->user_tags.trie);
+	ctx->user_tags.trie = NULL;
+	ctx->user_tags.n_trie = 0;
+
+	return true;
+}
+
+int XMLContext_register_user_tag(XMLContext* ctx, TagType tag_type, SXML_CHAR* start, SXML_CHAR* end)
+{
+	if (ctx == NULL || ctx->init_value != XML_INIT_DONE)
+		return -1;
+
+	return _register_user_tag(&ctx->user_tags, tag_type, start, end);
+}
+
+int XMLContext_unregister_user_tag(XMLContext* ctx, int i_tag)
+{
+	if (ctx == NULL || ctx->init_value != XML_INIT_DONE)
+		return -1;
+
+	return _unregister_user_tag(&ctx->user_tags, i_tag);
+}
+
+int XMLContext_get_registered_user_tag(const XMLContext* ctx, TagType tag_type)
+{
+	if (ctx == NULL || ctx->init_value != XML_INIT_DONE)
+		return -1;
+
+	return _get_registered_user_tag(&ctx->user_tags, tag_type);
+}
+
+/*
+ Memory functions of 'ctx' (or default ones if 'ctx' is NULL or does not define them).
+ */
+static void* _ctx_realloc(const XMLContext* ctx, void* mem, size_t sz)
+{
+	return (ctx != NULL && ctx->mem_realloc != NULL ? ctx->mem_realloc(mem, sz) : __realloc(mem, sz));
+}
+
+static void _ctx_free(const XMLContext* ctx, void* mem)
+{
+	if (ctx != NULL && ctx->mem_free != NULL)
+		ctx->mem_free(mem);
+	else
+		__free(mem);
+}
+
+/*
+ User tags of 'ctx' (or global ones if 'ctx' is NULL).
+ */
+static const SPECIAL_TAG* _ctx_user_tags(const XMLContext* ctx)
+{
+	return (ctx != NULL ? &ctx->user_tags : &_user_tags);
+}
+
+/* --- Interned strings --- */
+
+/*
+ Set of strings where each string is stored only once (open addressing hash table), so that
+ equal strings can be compared as pointers.
+ */
+typedef struct _InternTable {
+	SXML_CHAR** strings;	/* 'sz' slots, NULL when empty */
+	size_t n;				/* Number of strings */
+	size_t sz;				/* Number of slots (power of 2, 0 when nothing was interned yet) */
+} _InternTable;
+
+static size_t _intern_hash(const SXML_CHAR* str, size_t len)
+{
+	size_t h = 2166136261u; /* FNV-1a */
+
+	while (len-- > 0)
+		h = (h ^ (size_t)*str++) * 16777619u;
+
+	return h;
+}
+
+/*
+ Return the interned copy of the 'len' first characters of 'str', adding it to 't' if needed,
+ or NULL on memory error.
+ */
+static const SXML_CHAR* _intern(_InternTable* t, const SXML_CHAR* str, size_t len)
+{
+	SXML_CHAR** pt;
+	SXML_CHAR* p;
+	size_t i, j, sz;
+
+	/* Keep the table at most half full */
+	if (2 * (t->n + 1) > t->sz) {
+		sz = (t->sz == 0 ? 64 : 2 * t->sz);
+		pt = (SXML_CHAR**)__calloc(sz, sizeof(SXML_CHAR*));
+		if (pt == NULL)
+			return NULL;
+		for (i = 0; i < t->sz; i++) {
+			if (t->strings[i] == NULL)
+				continue;
+			for (j = _intern_hash(t->strings[i], sx_strlen(t->strings[i])) & (sz - 1); pt[j] != NULL; j = (j + 1) & (sz - 1)) ;
+			pt[j] = t->strings[i];
+		}
+		if (t->strings != NULL)
+			__free(t->strings);
+		t->strings = pt;
+		t->sz = sz;
+	}
+
+	for (i = _intern_hash(str, len) & (t->sz - 1); (p = t->strings[i]) != NULL; i = (i + 1) & (t->sz - 1)) {
+		if (!sx_strncmp(p, str, len) && p[len] == NULC)
+			return p;
+	}
+
+	p = (SXML_CHAR*)__malloc((len + 1) * sizeof(SXML_CHAR));
+	if (p == NULL)
+		return NULL;
+	memcpy(p, str, len * sizeof(SXML_CHAR));
+	p[len] = NULC;
+	t->strings[i] = p;
+	t->n++;
+
+	return p;
+}
+
+static void _intern_free(_InternTable* t)
+{
+	size_t i;
+
+	for (i = 0; i < t->sz; i++) {
+		if (t->strings[i] != NULL)
+			__free(t->strings[i]);
+	}
+	if (t->strings != NULL)
+		__free(t->strings);
+	t->strings = NULL;
+	t->n = t->sz = 0;
 }
 
+/* --- Namespaces --- */
+
+#define XML_NS_URI C2SX("http://www.w3.org/XML/1998/namespace")
+#define XMLNS_NS_URI C2SX("http://www.w3.org/2000/xmlns/")
+
 /* --- XMLNode methods --- */
 
 /*
@@ -182,6 +445,8 @@ int XMLNode_init(XMLNode* node)
 		return true; /*(void)XMLNode_free(node);*/
 
 	node->tag = NULL;
+	node->ns_uri = NULL;
+	node->local_name = NULL;
 	node->text = NULL;
 	
 	node->attributes = NULL;
@@ -193,6 +458,7 @@ int XMLNode_init(XMLNode* node)
 	
 	node->tag_type = TAG_NONE;
 	node->active = true;
+	node->interned = false;
 
 	node->init_value = XML_INIT_DONE;
 
@@ -217,47 +483,42 @@ XMLNode* XMLNode_allocN(int n)
 	return p;
 }
 
-XMLNode* XMLNode_dup(const XMLNode* node, int copy_children)
-{
-	XMLNode* n;
-
-	if (node == NULL)
-		return NULL;
-
-	n = (XMLNode*)__calloc(1, sizeof(XMLNode));
-	if (n == NULL)
-		return NULL;
-
-	XMLNode_init(n);
-	if (!XMLNode_copy(n, node, copy_children)) {
-		XMLNode_free(n);
-
-		return NULL;
-	}
-
-	return n;
-}
-
 int XMLNode_free(XMLNode* node)
 {
 	if (node == NULL || node->init_value != XML_INIT_DONE)
 		return false;
 	
 	if (node->tag != NULL) {
-		__free(node->tag);
+		if (!node->interned)
+			__free(node->tag);
 		node->tag = NULL;
 	}
+	node->ns_uri = NULL;
+	node->local_name = NULL;
 
 	XMLNode_remove_text(node);
 	XMLNode_remove_all_attributes(node);
 	XMLNode_remove_children(node);
 	
 	node->tag_type = TAG_NONE;
+	node->interned = false;
 
 	return true;
 }
 
-int XMLNode_copy(XMLNode* dst, const XMLNode* src, int copy_children)
+/*
+ Copy of name 'str', interned in 'names' if not NULL.
+ */
+static SXML_CHAR* _name_dup(_InternTable* names, const SXML_CHAR* str)
+{
+	return (names == NULL ? sx_strdup(str) : (SXML_CHAR*)_intern(names, str, sx_strlen(str)));
+}
+
+/*
+ Same as 'XMLNode_copy', tag and attribute names of 'dst' (and its children) being interned in
+ 'names' and namespace URIs in 'uris' when they are not NULL.
+ */
+static int _XMLNode_copy(XMLNode* dst, const XMLNode* src, int copy_children, _InternTable* names, _InternTable* uris)
 {
 	int i;
 	
@@ -270,10 +531,17 @@ int XMLNode_copy(XMLNode* dst, const XMLNode* src, int copy_children)
 	if (src == NULL)
 		return true;
 	
+	/* Only element names are interned, other tags (e.g. comments) hold their text in 'tag' */
+	dst->interned = (names != NULL && (src->tag_type == TAG_FATHER || src->tag_type == TAG_SELF));
+
 	/* Tag */
 	if (src->tag != NULL) {
-		dst->tag = sx_strdup(src->tag);
+		dst->tag = _name_dup(dst->interned ? names : NULL, src->tag);
 		if (dst->tag == NULL) goto copy_err;
+		dst->ns_uri = src->ns_uri;
+		if (uris != NULL && src->ns_uri != NULL && (dst->ns_uri = _intern(uris, src->ns_uri, sx_strlen(src->ns_uri))) == NULL) goto copy_err;
+		if (src->local_name != NULL)
+			dst->local_name = dst->tag + (src->local_name - src->tag);
 	}
 
 	/* Text */
@@ -288,10 +556,17 @@ int XMLNode_copy(XMLNode* dst, const XMLNode* src, int copy_children)
 		if (dst->attributes== NULL) goto copy_err;
 		dst->n_attributes = src->n_attributes;
 		for (i = 0; i < src->n_attributes; i++) {
-			dst->attributes[i].name = sx_strdup(src->attributes[i].name);
+			dst->attributes[i].name = _name_dup(dst->interned ? names : NULL, src->attributes[i].name);
 			dst->attributes[i].value = sx_strdup(src->attributes[i].value);
 			if (dst->attributes[i].name == NULL || dst->attributes[i].value == NULL) goto copy_err;
 			dst->attributes[i].active = src->attributes[i].active;
+			dst->attributes[i].escaped = src->attributes[i].escaped;
+			dst->attributes[i].ns_uri = src->attributes[i].ns_uri;
+			if (uris != NULL && src->attributes[i].ns_uri != NULL
+				&& (dst->attributes[i].ns_uri = _intern(uris, src->attributes[i].ns_uri, sx_strlen(src->attributes[i].ns_uri))) == NULL) goto copy_err;
+			if (src->attributes[i].local_name != NULL)
+				dst->attributes[i].local_name = dst->attributes[i].name + (src->attributes[i].local_name - src->attributes[i].name);
+			(void)XMLAttribute_get_value(&dst->attributes[i]); /* Copies are always converted */
 		}
 	}
 
@@ -306,7 +581,7 @@ int XMLNode_copy(XMLNode* dst, const XMLNode* src, int copy_children)
 		if (dst->children == NULL) goto copy_err;
 		dst->n_children = src->n_children;
 		for (i = 0; i < src->n_children; i++) {
-			if (!XMLNode_copy(dst->children[i], src->children[i], true)) goto copy_err;
+			if (!_XMLNode_copy(dst->children[i], src->children[i], true, names, uris)) goto copy_err;
 		}
 	}
 	
@@ -318,6 +593,88 @@ copy_err:
 	return false;
 }
 
+int XMLNode_copy(XMLNode* dst, const XMLNode* src, int copy_children)
+{
+	return _XMLNode_copy(dst, src, copy_children, NULL, NULL);
+}
+
+/*
+ Same as 'XMLNode_dup', names being interned in 'names' and namespace URIs in 'uris' if not NULL.
+ */
+static XMLNode* _XMLNode_dup(const XMLNode* node, int copy_children, _InternTable* names, _InternTable* uris)
+{
+	XMLNode* n;
+
+	if (node == NULL)
+		return NULL;
+
+	n = (XMLNode*)__calloc(1, sizeof(XMLNode));
+	if (n == NULL)
+		return NULL;
+
+	XMLNode_init(n);
+	if (!_XMLNode_copy(n, node, copy_children, names, uris)) {
+		XMLNode_free(n);
+
+		return NULL;
+	}
+
+	return n;
+}
+
+XMLNode* XMLNode_dup(const XMLNode* node, int copy_children)
+{
+	return _XMLNode_dup(node, copy_children, NULL, NULL);
+}
+
+/*
+ Replace interned names of 'node' by its own copies, before they are changed.
+ Return 'false' on memory error ('node' being left unchanged).
+ */
+static int _node_own_names(XMLNode* node)
+{
+	SXML_CHAR* tag = NULL;
+	SXML_CHAR** names;
+	int i;
+
+	if (!node->interned)
+		return true;
+
+	names = (SXML_CHAR**)__calloc(node->n_attributes + 1, sizeof(SXML_CHAR*));
+	if (names == NULL)
+		return false;
+	if (node->tag != NULL && (tag = sx_strdup(node->tag)) == NULL)
+		goto own_err;
+	for (i = 0; i < node->n_attributes; i++) {
+		if (node->attributes[i].name != NULL && (names[i] = sx_strdup(node->attributes[i].name)) == NULL)
+			goto own_err;
+	}
+
+	if (node->local_name != NULL)
+		node->local_name = tag + (node->local_name - node->tag);
+	node->tag = tag;
+	for (i = 0; i < node->n_attributes; i++) {
+		if (node->attributes[i].local_name != NULL)
+			node->attributes[i].local_name = names[i] + (node->attributes[i].local_name - node->attributes[i].name);
+		node->attributes[i].name = names[i];
+	}
+	node->interned = false;
+	__free(names);
+
+	return true;
+
+own_err:
+	for (i = 0; i < node->n_attributes; i++) {
+		if (names[i] != NULL)
+			__free(names[i]);
+	}
+	if (tag != NULL)
+		__free(tag);
+	__free(names);
+
+	return false;
+}
+
 int XMLNode_set_active(XMLNode* node, int active)
 {
 	if (node == NULL || node->init_value != XML_INIT_DONE)
@@ -334,11 +691,15 @@ int XMLNode_set_tag(XMLNode* node, const SXML_CHAR* tag)
 	if (node == NULL || tag == NULL || node->init_value != XML_INIT_DONE)
 		return false;
 	
+	if (!_node_own_names(node))
+		return false;
 	newtag = sx_strdup(tag);
 	if (newtag == NULL)
 		return false;
 	if (node->tag != NULL) __free(node->tag);
 	node->tag = newtag;
+	node->ns_uri = NULL; /* Not resolved any more */
+	node->local_name = NULL;
 
 	return true;
 }
@@ -378,9 +739,14 @@ int XMLNode_set_attribute(XMLNode* node, const SXML_CHAR* attr_name, const SXML_
 		if (pt[i].value != NULL)
 			__free(pt[i].value);
 		pt[i].value = value;
+		pt[i].escaped = false;
 	} else { /* Attribute not found: add it */
-		SXML_CHAR* name = sx_strdup(attr_name);
-		SXML_CHAR* value = (attr_value == NULL ? NULL : sx_strdup(attr_value));
+		SXML_CHAR* name;
+		SXML_CHAR* value;
+		if (!_node_own_names(node))
+			return -1;
+		name = sx_strdup(attr_name);
+		value = (attr_value == NULL ? NULL : sx_strdup(attr_value));
 		if (name == NULL || (value == NULL && attr_value != NULL)) {
 			if (value != NULL)
 				__free(value);
@@ -400,6 +766,9 @@ int XMLNode_set_attribute(XMLNode* node, const SXML_CHAR* attr_name, const SXML_
 		pt[i].name = name;
 		pt[i].value = value;
 		pt[i].active = true;
+		pt[i].escaped = false;
+		pt[i].ns_uri = NULL;
+		pt[i].local_name = NULL;
 		node->attributes = pt;
 		node->n_attributes = i + 1;
 	}
@@ -419,7 +788,7 @@ int XMLNode_get_attribute_with_default(XMLNode* node, const SXML_CHAR* attr_name
 	if (i >= 0) {
 		pt = node->attributes;
 		if (pt[i].value != NULL) {
-			*attr_value = sx_strdup(pt[i].value);
+			*attr_value = sx_strdup(XMLAttribute_get_value(&pt[i]));
 			if (*attr_value == NULL)
 				return false;
 		} else
@@ -455,7 +824,7 @@ int XMLNode_search_attribute(const XMLNode* node, const SXML_CHAR* attr_name, in
 		return -1;
 	
 	for (i = i_search; i < node->n_attributes; i++)
-		if (node->attributes[i].active && !sx_strcmp(node->attributes[i].name, attr_name))
+		if (node->attributes[i].active && (node->attributes[i].name == attr_name || !sx_strcmp(node->attributes[i].name, attr_name)))
 			return i;
 	
 	return -1;
@@ -477,7 +846,7 @@ int XMLNode_remove_attribute(XMLNode* node, int i_attr)
 	}
 
 	/* Can't fail anymore, free item */
-	if (node->attributes[i_attr].name != NULL) __free(node->attributes[i_attr].name);
+	if (node->attributes[i_attr].name != NULL && !node->interned) __free(node->attributes[i_attr].name);
 	if (node->attributes[i_attr].value != NULL) __free(node->attributes[i_attr].value);
 	
 	if (pt != NULL) {
@@ -501,7 +870,7 @@ int XMLNode_remove_all_attributes(XMLNode* node)
 
 	if (node->attributes != NULL) {
 		for (i = 0; i < node->n_attributes; i++) {
-			if (node->attributes[i].name != NULL)
+			if (node->attributes[i].name != NULL && !node->interned)
 				__free(node->attributes[i].name);
 			if (node->attributes[i].value != NULL)
 				__free(node->attributes[i].value);
@@ -669,7 +1038,7 @@ int XMLNode_equal(const XMLNode* node1, const XMLNode* node2)
 		j = XMLNode_search_attribute(node2, node1->attributes[i].name, 0);
 		if (j < 0)
 			return false;
-		if (sx_strcmp(node1->attributes[i].value, node2->attributes[j].value))
+		if (sx_strcmp(XMLAttribute_get_value(&node1->attributes[i]), XMLAttribute_get_value(&node2->attributes[j])))
 			return false;
 	}
 
@@ -740,6 +1109,8 @@ int XMLDoc_init(XMLDoc* doc)
 	doc->nodes = NULL;
 	doc->n_nodes = 0;
 	doc->i_root = -1;
+	doc->names = NULL;
+	doc->ns_uris = NULL;
 	doc->init_value = XML_INIT_DONE;
 
 	return true;
@@ -760,6 +1131,33 @@ int XMLDoc_free(XMLDoc* doc)
 	doc->nodes = NULL;
 	doc->n_nodes = 0;
 	doc->i_root = -1;
+	if (doc->names != NULL) {
+		_intern_free(doc->names);
+		__free(doc->names);
+		doc->names = NULL;
+	}
+	if (doc->ns_uris != NULL) {
+		_intern_free(doc->ns_uris);
+		__free(doc->ns_uris);
+		doc->ns_uris = NULL;
+	}
+
+	return true;
+}
+
+/*
+ Create the tables of interned names and namespace URIs of 'doc' when 'ctx' asks for them.
+ Return 'false' on memory error.
+ */
+static int _doc_init_names(XMLDoc* doc, const XMLContext* ctx)
+{
+	if (ctx == NULL)
+		return true;
+
+	if (ctx->intern_names && doc->names == NULL && (doc->names = (_InternTable*)__calloc(1, sizeof(_InternTable))) == NULL)
+		return false;
+	if (ctx->namespaces && doc->ns_uris == NULL && (doc->ns_uris = (_InternTable*)__calloc(1, sizeof(_InternTable))) == NULL)
+		return false;
 
 	return true;
 }
@@ -894,7 +1292,7 @@ static int _XMLNode_print_header(const XMLNode* node, FILE* f, const SXML_CHAR*
 	for (i = 0; i < node->n_attributes; i++) {
 		if (!node->attributes[i].active)
 			continue;
-		cur_sz_line += sx_strlen(node->attributes[i].name) + sx_strlen(node->attributes[i].value) + 3;
+		cur_sz_line += sx_strlen(node->attributes[i].name) + sx_strlen(XMLAttribute_get_value(&node->attributes[i])) + 3;
 		if (sz_line > 0 && cur_sz_line > sz_line) {
 			cur_sz_line = _print_formatting(node, f, tag_sep, child_sep, nb_char_tab, cur_sz_line);
 			/* Add extra separator, as if new line was a child of the previous one */
@@ -1012,53 +1410,241 @@ int XMLDoc_print_attr_sep(const XMLDoc* doc, FILE* f, const SXML_CHAR* tag_sep,
 	return true;
 }
 
-/* --- */
+/* --- Character scanning --- */
 
-int XML_parse_attribute_to(const SXML_CHAR* str, int to, XMLAttribute* xmlattr)
+/*
+ Set of structural characters looked for by '_scan': up to 3 characters (repeated when there
+ are less) and, if 'spaces' is 'true', spaces (' ', '\t', '\n', '\v', '\f' and '\r').
+ */
+typedef struct _ScanSet {
+	SXML_CHAR c[3];
+	int spaces;
+} _ScanSet;
+
+/* End of a tag name or of a non-quoted attribute value */
+static const _ScanSet _scan_name_end = { { C2SX('>'), C2SX('/'), C2SX('>') }, true };
+
+/* End of an attribute name */
+static const _ScanSet _scan_attr_name_end = { { C2SX('='), C2SX('='), C2SX('=') }, true };
+
+/* End of a tag, or start of an attribute value which could hide a '>' between quotes */
+static const _ScanSet _scan_tag_end = { { C2SX('>'), C2SX('='), C2SX('=') }, false };
+
+/* End of a "<!DOCTYPE", or start of its internal subset (which then ends with "]>") */
+static const _ScanSet _scan_doctype_end = { { C2SX('>'), C2SX('['), C2SX('[') }, false };
+
+#define _scan_is_space(c) ((c) == C2SX(' ') || ((c) >= C2SX('\t') && (c) <= C2SX('\r')))
+
+static size_t _scan_scalar(const SXML_CHAR* str, size_t n, const _ScanSet* set)
 {
-	const SXML_CHAR *p;
-	int i, n0, n1, remQ = 0;
-	int ret = 1;
-	SXML_CHAR quote = '\0';
-	
-	if (str == NULL || xmlattr == NULL)
-		return 0;
+	size_t i;
 
-	if (to < 0)
-		to = sx_strlen(str) - 1;
-	
-	/* Search for the '=' */
-	/* 'n0' is where the attribute name stops, 'n1' is where the attribute value starts */
-	for (n0 = 0; n0 != to && str[n0] != C2SX('=') && !sx_isspace(str[n0]); n0++) ; /* Search for '=' or a space */
-	for (n1 = n0; n1 != to && sx_isspace(str[n1]); n1++) ; /* Search for something not a space */
-	if (str[n1] != C2SX('='))
-		return 0; /* '=' not found: malformed string */
-	for (n1++; n1 != to && sx_isspace(str[n1]); n1++) ; /* Search for something not a space */
-	if (isquote(str[n1])) { /* Remove quotes */
-		quote = str[n1];
-		remQ = 1;
+	for (i = 0; i < n; i++) {
+		if (str[i] == set->c[0] || str[i] == set->c[1] || str[i] == set->c[2] || (set->spaces && _scan_is_space(str[i])))
+			break;
 	}
-	
-	xmlattr->name = (SXML_CHAR*)__malloc((n0+1)*sizeof(SXML_CHAR));
-	xmlattr->value = (SXML_CHAR*)__malloc((to+1 - n1 - remQ + 1) * sizeof(SXML_CHAR));
+
+	return i;
+}
+
+#ifdef SXMLC_SSE2
+static int _ctz(unsigned int mask)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+
+	_BitScanForward(&i, mask);
+	return (int)i;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+/*
+ Bitmask of the characters of 'set' in the 16 characters 'v'.
+ Spaces are ' ' and characters between '\t' and '\r', i.e. 'v - '\t'' (unsigned) is at most 4.
+ */
+static unsigned int _scan_mask_sse2(__m128i v, const _ScanSet* set)
+{
+	__m128i m, t;
+
+	m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(set->c[0])), _mm_cmpeq_epi8(v, _mm_set1_epi8(set->c[1]))),
+		_mm_cmpeq_epi8(v, _mm_set1_epi8(set->c[2])));
+	if (set->spaces) {
+		t = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+		m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t)));
+	}
+
+	return (unsigned int)_mm_movemask_epi8(m);
+}
+
+static size_t _scan_sse2(const SXML_CHAR* str, size_t n, const _ScanSet* set)
+{
+	unsigned int mask;
+	size_t i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		if ((mask = _scan_mask_sse2(_mm_loadu_si128((const __m128i*)(str + i)), set)) != 0)
+			return i + _ctz(mask);
+	}
+
+	return i + _scan_scalar(str + i, n - i, set);
+}
+#endif
+
+#ifdef SXMLC_AVX2
+/* 1 if the processor has AVX2, 0 if not, -1 until checked (threads checking together store the same value) */
+static int _has_avx2 = -1;
+
+__attribute__((target("avx2")))
+static size_t _scan_avx2(const SXML_CHAR* str, size_t n, const _ScanSet* set)
+{
+	const __m256i c0 = _mm256_set1_epi8(set->c[0]), c1 = _mm256_set1_epi8(set->c[1]), c2 = _mm256_set1_epi8(set->c[2]);
+	const __m256i space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'), four = _mm256_set1_epi8(4);
+	__m256i v, m, t;
+	unsigned int mask;
+	size_t i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		v = _mm256_loadu_si256((const __m256i*)(str + i));
+		m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, c0), _mm256_cmpeq_epi8(v, c1)), _mm256_cmpeq_epi8(v, c2));
+		if (set->spaces) {
+			t = _mm256_sub_epi8(v, tab);
+			m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(_mm256_min_epu8(t, four), t)));
+		}
+		if ((mask = (unsigned int)_mm256_movemask_epi8(m)) != 0)
+			return i + _ctz(mask);
+	}
+
+	return i + _scan_sse2(str + i, n - i, set);
+}
+#endif
+
+/*
+ Return the index of the first of the 'n' characters 'str' that belongs to 'set', or 'n' if none does.
+ Characters are compared by blocks of 16 or 32 with SIMD instructions when available (AVX2 being
+ checked once at runtime), one at a time otherwise. Short strings are always scanned one at a time.
+ Only tag and attribute names, non-quoted attribute values and tag ends are scanned this way: texts,
+ quoted values and special tags look for a single character with 'sx_memchr', already vectorized
+ by the C library.
+ */
+static size_t _scan(const SXML_CHAR* str, size_t n, const _ScanSet* set)
+{
+#ifdef SXMLC_AVX2
+	if (n >= 64) {
+		if (_has_avx2 < 0)
+			_has_avx2 = (__builtin_cpu_supports("avx2") ? 1 : 0);
+		if (_has_avx2)
+			return _scan_avx2(str, n, set);
+	}
+#endif
+#ifdef SXMLC_SSE2
+	if (n >= 16)
+		return _scan_sse2(str, n, set);
+#endif
+
+	return _scan_scalar(str, n, set);
+}
+
+/* --- */
+
+/*
+ Copy the 'n' characters at 'src' as a NUL-terminated string into '*buf' (which is then moved
+ after the copy) or, when 'buf' is NULL, into a newly allocated string.
+ Return the string, or NULL on memory error.
+ */
+static SXML_CHAR* _tag_strncpy(SXML_CHAR** buf, const SXML_CHAR* src, int n)
+{
+	SXML_CHAR* str = (buf == NULL ? (SXML_CHAR*)__malloc((n + 1) * sizeof(SXML_CHAR)) : *buf);
+
+	if (str == NULL)
+		return NULL;
+	memcpy(str, src, n * sizeof(SXML_CHAR));
+	str[n] = NULC;
+	if (buf != NULL)
+		*buf += n + 1;
+
+	return str;
+}
+
+/*
+ Memory reused by '_parse_1string' from one tag to the next, instead of allocating the strings
+ and the attributes of each node.
+ */
+typedef struct _TagBuf {
+	SXML_CHAR* strings;	/* Where to copy the next string (see '_tag_strncpy') */
+	int sz_attributes;	/* Number of attributes 'node->attributes' can hold */
+	int lazy_values;	/* 'true' to leave escape sequences in attribute values (see 'XMLAttribute_get_value') */
+} _TagBuf;
+
+/*
+ Release the strings and attributes of 'node' read by '_parse_1string' with 'tb' (see
+ '_parse_1string'). The attributes array is kept to be reused by the next tag.
+ */
+static void _tag_release(XMLNode* node, _TagBuf* tb)
+{
+	if (tb == NULL) {
+		(void)XMLNode_free(node);
+		return;
+	}
+	node->n_attributes = 0;
+	node->tag = NULL;
+	node->ns_uri = NULL;
+	node->local_name = NULL;
+	node->tag_type = TAG_NONE;
+}
+
+/*
+ Same as 'XML_parse_attribute_to' but name and value are copied into '*buf' when 'buf' is
+ not NULL (see '_tag_strncpy'). Escape sequences of the value are not converted when 'lazy' is 'true'.
+ */
+static int _parse_attribute(const SXML_CHAR* str, int to, XMLAttribute* xmlattr, SXML_CHAR** buf, int lazy)
+{
+	const SXML_CHAR *p;
+	int i, n0, n1, remQ = 0;
+	int ret = 1;
+	SXML_CHAR quote = '\0';
+	
+	if (str == NULL || xmlattr == NULL)
+		return 0;
+
+	xmlattr->ns_uri = NULL;
+	xmlattr->local_name = NULL;
+	if (to < 0)
+		to = sx_strlen(str) - 1;
+	
+	/* Search for the '=' */
+	/* 'n0' is where the attribute name stops, 'n1' is where the attribute value starts */
+	n0 = (int)_scan(str, to, &_scan_attr_name_end); /* Search for '=' or a space */
+	for (n1 = n0; n1 != to && sx_isspace(str[n1]); n1++) ; /* Search for something not a space */
+	if (str[n1] != C2SX('='))
+		return 0; /* '=' not found: malformed string */
+	for (n1++; n1 != to && sx_isspace(str[n1]); n1++) ; /* Search for something not a space */
+	if (isquote(str[n1])) { /* Remove quotes */
+		quote = str[n1];
+		remQ = 1;
+	}
+	
+	xmlattr->name = _tag_strncpy(buf, str, n0); /* (void)str_unescape(xmlattr->name); do not unescape the name */
+	xmlattr->value = (buf == NULL ? (SXML_CHAR*)__malloc((to+1 - n1 - remQ + 1) * sizeof(SXML_CHAR)) : *buf);
 	xmlattr->active = true;
 	if (xmlattr->name != NULL && xmlattr->value != NULL) {
-		/* Copy name */
-		sx_strncpy(xmlattr->name, str, n0);
-		xmlattr->name[n0] = NULC;
-		/* (void)str_unescape(xmlattr->name); do not unescape the name */
 		/* Copy value (p starts after the quote (if any) and stops at the end of 'str'
 		  (skipping the quote if any, hence the '*(p+remQ)') */
 		for (i = 0, p = str + n1 + remQ; i + n1 + remQ < to && *(p+remQ) != NULC; i++, p++)
 			xmlattr->value[i] = *p;
 		xmlattr->value[i] = NULC;
-		(void)html2str(xmlattr->value, NULL); /* Convert HTML escape sequences, do not str_unescape(xmlattr->value) */
+		if (buf != NULL)
+			*buf += i + 1;
+		xmlattr->escaped = (sx_memchr(xmlattr->value, C2SX('&'), i) != NULL);
+		if (!lazy)
+			(void)XMLAttribute_get_value(xmlattr);
 		if (remQ && *p != quote)
 			ret = 2; /* Quote at the beginning but not at the end: probable presence of '>' inside attribute value, so we need to read more data! */
 	} else
 		ret = 0;
 	
-	if (ret == 0) {
+	if (ret == 0 && buf == NULL) {
 		if (xmlattr->name != NULL) {
 			__free(xmlattr->name);
 			xmlattr->name = NULL;
@@ -1072,93 +1658,175 @@ int XML_parse_attribute_to(const SXML_CHAR* str, int to, XMLAttribute* xmlattr)
 	return ret;
 }
 
-static TagType _parse_special_tag(const SXML_CHAR* str, int len, _TAG* tag, XMLNode* node)
+int XML_parse_attribute_to(const SXML_CHAR* str, int to, XMLAttribute* xmlattr)
+{
+	return _parse_attribute(str, to, xmlattr, NULL, false);
+}
+
+const SXML_CHAR* XMLAttribute_get_value(XMLAttribute* xmlattr)
+{
+	if (xmlattr == NULL)
+		return NULL;
+
+	if (xmlattr->escaped && xmlattr->value != NULL)
+		(void)html2str(xmlattr->value, NULL); /* Convert HTML escape sequences, do not str_unescape(xmlattr->value) */
+	xmlattr->escaped = false;
+
+	return xmlattr->value;
+}
+
+/*
+ Check whether the 'n' characters at 'str' start with 'start' ('len' characters).
+ Return 1 if they do, 0 if they do not and -1 if more characters are needed to know (only
+ when 'more' is 'true', i.e. more characters can follow 'str').
+ */
+static int _tag_prefix(const SXML_CHAR* str, size_t n, const SXML_CHAR* start, int len, int more)
+{
+	if (n >= (size_t)len)
+		return !sx_strncmp(str, start, len);
+
+	return (more && !sx_strncmp(str, start, n) ? -1 : 0);
+}
+
+/*
+ Find the special tag (built-in, "<!DOCTYPE" or one of 'user_tags') which start begins the 'n'
+ characters of 'str' (which starts with '<'). When several match, built-in tags come first,
+ then "<!DOCTYPE", then user tags by index.
+ The second character tells at once whether it can be a built-in tag, and user tags are found
+ by walking their prefix tree, so that plain elements (the most common case) are known without
+ comparing them to any tag start.
+ '*more' is set to 'true' when it cannot be known yet: 'more' is 'true' (i.e. more characters
+ can follow 'str') and a tag could match with more characters.
+ Return the tag, or NULL for a plain element.
+ */
+static const _TAG* _find_special_tag(const SXML_CHAR* str, size_t n, const SPECIAL_TAG* user_tags, int more, int* need_more)
+{
+	const _TAG_TRIE* trie = user_tags->trie;
+	const _TAG* tag;
+	int node, child, i_tag, rc;
+	size_t i;
+
+	*need_more = false;
+	if (n < 2) {
+		*need_more = more;
+		return NULL;
+	}
+
+	switch (str[1]) {
+		case C2SX('?'): /* "<?" (instruction) is a prefix of all tags starting with it */
+			return &_spec[0];
+
+		case C2SX('!'): /* "<!--" (comment), "<![CDATA[" or "<!DOCTYPE" */
+			if (n < 3) {
+				*need_more = more;
+				if (more)
+					return NULL;
+				break;
+			}
+			switch (str[2]) {
+				case C2SX('-'): tag = &_spec[1]; break;
+				case C2SX('['): tag = &_spec[2]; break;
+				case C2SX('D'): tag = &_doctype; break;
+				default: tag = NULL; break;
+			}
+			if (tag != NULL && (rc = _tag_prefix(str, n, tag->start, tag->len_start, more)) != 0) {
+				*need_more = (rc < 0);
+				return (rc > 0 ? tag : NULL);
+			}
+			break;
+
+		default:
+			break;
+	}
+	if (trie == NULL)
+		return NULL;
+
+	/* Walk the prefix tree as long as characters match, keeping the first tag found */
+	i_tag = -1;
+	for (i = 1, node = 0; ; i++, node = child) {
+		if (trie[node].i_tag >= 0 && (i_tag < 0 || trie[node].i_tag < i_tag))
+			i_tag = trie[node].i_tag;
+		if (trie[node].child < 0)
+			break;
+		if (i >= n) { /* A tag further down the tree could match, unless it was registered after 'i_tag' */
+			for (child = trie[node].child; child >= 0 && !*need_more; child = trie[child].next)
+				*need_more = (more && (i_tag < 0 || trie[child].min_tag < i_tag));
+			break;
+		}
+		for (child = trie[node].child; child >= 0 && trie[child].c != str[i]; child = trie[child].next) ;
+		if (child < 0)
+			break;
+	}
+
+	return (i_tag < 0 || *need_more ? NULL : &user_tags->tags[i_tag]);
+}
+
+static TagType _parse_special_tag(const SXML_CHAR* str, int len, const _TAG* tag, XMLNode* node, _TagBuf* tb)
 {
-	if (sx_strncmp(str, tag->start, tag->len_start))
+	if (len < tag->len_start || sx_strncmp(str, tag->start, tag->len_start))
 		return TAG_NONE;
 
-	if (sx_strncmp(str + len - tag->len_end, tag->end, tag->len_end)) /* There probably is a '>' inside the tag */
+	if (len < tag->len_start + tag->len_end || sx_strncmp(str + len - tag->len_end, tag->end, tag->len_end)) /* There probably is a '>' inside the tag */
 		return TAG_PARTIAL;
 
-	node->tag = (SXML_CHAR*)__malloc((len - tag->len_start - tag->len_end + 1)*sizeof(SXML_CHAR));
+	node->tag = _tag_strncpy(tb == NULL ? NULL : &tb->strings, str + tag->len_start, len - tag->len_start - tag->len_end);
 	if (node->tag == NULL)
-		return TAG_NONE;
-	sx_strncpy(node->tag, str + tag->len_start, len - tag->len_start - tag->len_end);
-	node->tag[len - tag->len_start - tag->len_end] = NULC;
+		return TAG_ERROR;
 	node->tag_type = tag->tag_type;
 
 	return node->tag_type;
 }
 
 /*
- Reads a string that is supposed to be an xml tag like '<tag (attribName="attribValue")* [/]>' or '</tag>'.
- Fills the 'xmlnode' structure with the tag name and its attributes.
- Returns 'TAG_ERROR' if an error occurred (malformed 'str' or memory). 'TAG_*' when string is recognized.
+ Same as 'XML_parse_1string' but 'str' is 'len' characters long and does not need to be
+ nul-terminated (i.e. it can point directly inside the parser input block).
+ User tags are taken from 'user_tags'.
+ When 'tb' is not NULL, tag and attribute strings are not allocated but copied one after the
+ other into 'tb->strings' (which should have room for '2*len' characters), 'xmlnode->attributes'
+ holds 'tb->sz_attributes' attributes and is only grown when more are needed. 'xmlnode' should
+ then be released by '_tag_release' instead of 'XMLNode_free'.
  */
-TagType XML_parse_1string(const SXML_CHAR* str, XMLNode* xmlnode)
+static TagType _parse_1string(const SXML_CHAR* str, int len, XMLNode* xmlnode, const SPECIAL_TAG* user_tags, _TagBuf* tb)
 {
-	SXML_CHAR *p;
+	const SXML_CHAR *p, *q;
+	SXML_CHAR** buf = (tb == NULL ? NULL : &tb->strings);
+	const _TAG* tag;
 	XMLAttribute* pt;
-	int n, nn, len, rc, tag_end = 0;
-	
-	if (str == NULL || xmlnode == NULL)
-		return TAG_ERROR;
-	len = sx_strlen(str);
+	int n, nn, rc, sz, more, tag_end = 0;
 	
 	/* Check for malformed string */
-	if (str[0] != C2SX('<') || str[len-1] != C2SX('>'))
+	if (len < 2 || str[0] != C2SX('<') || str[len-1] != C2SX('>'))
 		return TAG_ERROR;
 
-	for (nn = 0; nn < NB_SPECIAL_TAGS; nn++) {
-		n = (int)_parse_special_tag(str, len, &_spec[nn], xmlnode);
-		switch (n) {
-			case TAG_NONE:	break;				/* Nothing found => do nothing */
-			default:		return (TagType)n;	/* Tag found => return it */
-		}
-	}
-
-	/* "<!DOCTYPE" requires a special handling because it can end with "]>" instead of ">" if a '[' is found inside */
-	if (str[1] == C2SX('!')) {
-		/* DOCTYPE */
-		if (!sx_strncmp(str, C2SX("<!DOCTYPE"), 9)) { /* 9 = sizeof("<!DOCTYPE") */
-			for (n = 9; str[n] && str[n] != C2SX('['); n++) ; /* Look for a '[' inside the DOCTYPE, which would mean that we should be looking for a "]>" tag end */
+	if ((tag = _find_special_tag(str, len, user_tags, false, &more)) != NULL) {
+		/* "<!DOCTYPE" requires a special handling because it can end with "]>" instead of ">" if a '[' is found inside */
+		if (tag == &_doctype) {
+			p = (const SXML_CHAR*)sx_memchr(str + 9, C2SX('['), len - 9); /* Look for a '[' inside the DOCTYPE, which would mean that we should be looking for a "]>" tag end */
 			nn = 0;
-			if (str[n]) { /* '[' was found */
+			if (p != NULL) { /* '[' was found */
 				if (sx_strncmp(str+len-2, C2SX("]>"), 2)) /* There probably is a '>' inside the DOCTYPE */
 					return TAG_PARTIAL;
 				nn = 1;
 			}
-			xmlnode->tag = (SXML_CHAR*)__malloc((len - 9 - nn)*sizeof(SXML_CHAR)); /* 'len' - "<!DOCTYPE" and ">" + '\0' */
+			xmlnode->tag = _tag_strncpy(buf, &str[9], len - 10 - nn); /* 'len' - "<!DOCTYPE" and ">" */
 			if (xmlnode->tag == NULL)
 				return TAG_ERROR;
-			sx_strncpy(xmlnode->tag, &str[9], len - 10 - nn);
-			xmlnode->tag[len - 10 - nn] = NULC;
 			xmlnode->tag_type = TAG_DOCTYPE;
 
 			return TAG_DOCTYPE;
 		}
-	}
-	
-	/* Test user tags */
-	for (nn = 0; nn < _user_tags.n_tags; nn++) {
-		n = _parse_special_tag(str, len, &_user_tags.tags[nn], xmlnode);
-		switch (n) {
-			case TAG_ERROR:	return TAG_NONE;	/* Error => exit */
-			case TAG_NONE:	break;				/* Nothing found => do nothing */
-			default:		return (TagType)n;	/* Tag found => return it */
-		}
+
+		return _parse_special_tag(str, len, tag, xmlnode, tb);
 	}
 
 	if (str[1] == C2SX('/'))
 		tag_end = 1;
 	
 	/* tag starts at index 1 (or 2 if tag end) and ends at the first space or '/>' */
-	for (n = 1 + tag_end; str[n] != NULC && str[n] != C2SX('>') && str[n] != C2SX('/') && !sx_isspace(str[n]); n++) ;
-	xmlnode->tag = (SXML_CHAR*)__malloc((n - tag_end)*sizeof(SXML_CHAR));
+	n = 1 + tag_end + (int)_scan(str + 1 + tag_end, len - 1 - tag_end, &_scan_name_end);
+	xmlnode->tag = _tag_strncpy(buf, &str[1 + tag_end], n - 1 - tag_end);
 	if (xmlnode->tag == NULL)
 		return TAG_ERROR;
-	sx_strncpy(xmlnode->tag, &str[1 + tag_end], n - 1 - tag_end);
-	xmlnode->tag[n - 1 - tag_end] = NULC;
 	if (tag_end) {
 		xmlnode->tag_type = TAG_END;
 		return TAG_END;
@@ -1167,7 +1835,7 @@ TagType XML_parse_1string(const SXML_CHAR* str, XMLNode* xmlnode)
 	/* Here, 'n' is the position of the first space after tag name */
 	while (n < len) {
 		/* Skips spaces */
-		while (sx_isspace(str[n])) n++;
+		while (n < len && sx_isspace(str[n])) n++;
 		
 		/* Check for XML end ('>' or '/>') */
 		if (str[n] == C2SX('>')) { /* Tag with children */
@@ -1175,527 +1843,2895 @@ TagType XML_parse_1string(const SXML_CHAR* str, XMLNode* xmlnode)
 			xmlnode->tag_type = type;
 			return type;
 		}
-		if (!sx_strcmp(str+n, C2SX("/>"))) { /* Tag without children */
+		if (n == len - 2 && str[n] == C2SX('/')) { /* Tag without children */
 			xmlnode->tag_type = TAG_SELF;
 			return TAG_SELF;
 		}
 		
 		/* New attribute found */
-		p = sx_strchr(str+n, C2SX('='));
+		p = (const SXML_CHAR*)sx_memchr(str + n, C2SX('='), len - n);
 		if (p == NULL) goto parse_err;
-		pt = (XMLAttribute*)__realloc(xmlnode->attributes, (xmlnode->n_attributes + 1) * sizeof(XMLAttribute));
-		if (pt == NULL) goto parse_err;
+		while (++p < str + len && sx_isspace(*p)) ; /* Skip spaces */
+		if (isquote(*p)) { /* Attribute value starts with a quote, look for next one, ignoring protected ones with '\' */
+			/* '\' is valid in values [bugs:#7] */
+			q = (const SXML_CHAR*)sx_memchr(p + 1, *p, len - (p - str) - 1);
+			nn = (q == NULL ? len : (int)(q - str));
+			if (nn >= len) /* Closing quote not found: probable presence of '>' inside attribute value, which is legal XML */
+				return TAG_PARTIAL;
+		} else { /* Attribute value stops at first space or end of XML string */
+			nn = (int)(p - str) + 1 + (int)_scan(p + 1, len - (p - str) - 1, &_scan_name_end); /* Go to the end of the attribute value */
+		}
+		if (tb == NULL || xmlnode->n_attributes >= tb->sz_attributes) {
+			sz = (tb == NULL ? xmlnode->n_attributes + 1 : (tb->sz_attributes == 0 ? 16 : 2 * tb->sz_attributes));
+			pt = (XMLAttribute*)__realloc(xmlnode->attributes, sz * sizeof(XMLAttribute));
+			if (pt == NULL) goto parse_err;
+			xmlnode->attributes = pt;
+			if (tb != NULL)
+				tb->sz_attributes = sz;
+		}
+		pt = xmlnode->attributes;
 		
 		pt[xmlnode->n_attributes].name = NULL;
 		pt[xmlnode->n_attributes].value = NULL;
 		pt[xmlnode->n_attributes].active = false;
+		pt[xmlnode->n_attributes].escaped = false;
 		xmlnode->n_attributes++;
-		xmlnode->attributes = pt;
-		while (*p != NULC && sx_isspace(*++p)) ; /* Skip spaces */
-		if (isquote(*p)) { /* Attribute value starts with a quote, look for next one, ignoring protected ones with '\' */
-			for (nn = p-str+1; str[nn] && str[nn] != *p; nn++) { // CHECK UNICODE "nn = p-str+1"
-				/* if (str[nn] == C2SX('\\')) nn++; [bugs:#7]: '\' is valid in values */
-			}
-		} else { /* Attribute value stops at first space or end of XML string */
-			for (nn = p-str+1; str[nn] != NULC && !sx_isspace(str[nn]) && str[nn] != C2SX('/') && str[nn] != C2SX('>'); nn++) ; /* Go to the end of the attribute value */ // CHECK UNICODE
-		}
 		
 		/* Here 'str[nn]' is the character after value */
 		/* the attribute definition ('attrName="attrVal"') is between 'str[n]' and 'str[nn]' */
-		rc = XML_parse_attribute_to(&str[n], nn - n, &xmlnode->attributes[xmlnode->n_attributes - 1]);
+		rc = _parse_attribute(&str[n], nn - n, &xmlnode->attributes[xmlnode->n_attributes - 1], buf, tb != NULL && tb->lazy_values);
 		if (!rc) goto parse_err;
 		if (rc == 2) { /* Probable presence of '>' inside attribute value, which is legal XML. Remove attribute to re-parse it later */
-			XMLNode_remove_attribute(xmlnode, xmlnode->n_attributes - 1);
+			if (tb == NULL)
+				XMLNode_remove_attribute(xmlnode, xmlnode->n_attributes - 1);
+			else
+				xmlnode->n_attributes--;
 			return TAG_PARTIAL;
 		}
 		
-		n = nn + 1;
+		n = (isquote(str[nn]) ? nn + 1 : nn); /* Non-quoted values can be directly followed by '>' or '/>' */
 	}
 	
-	sx_fprintf(stderr, C2SX("\nWE SHOULD NOT BE HERE!\n[%s]\n\n"), str);
+	sx_fprintf(stderr, C2SX("\nWE SHOULD NOT BE HERE!\n[%.*s]\n\n"), len, str);
 	
 parse_err:
-	(void)XMLNode_free(xmlnode);
+	_tag_release(xmlnode, tb);
 
 	return TAG_ERROR;
 }
 
-static int _parse_data_SAX(void* in, const DataSourceType in_type, const SAX_Callbacks* sax, SAX_Data* sd)
+/*
+ Reads a string that is supposed to be an xml tag like '<tag (attribName="attribValue")* [/]>' or '</tag>'.
+ Fills the 'xmlnode' structure with the tag name and its attributes.
+ Returns 'TAG_ERROR' if an error occurred (malformed 'str' or memory). 'TAG_*' when string is recognized.
+ */
+TagType XML_parse_1string(const SXML_CHAR* str, XMLNode* xmlnode)
 {
-	SXML_CHAR *line = NULL, *txt_end, *p;
-	XMLNode node;
-	int ret, exit, sz, n0, ncr;
-	TagType tag_type;
-	int (*meos)(void* ds) = (in_type == DATA_SOURCE_BUFFER ? (int(*)(void*))_beob : (int(*)(void*))sx_feof);
-
-	if (sax->start_doc != NULL && !sax->start_doc(sd))
-		return true;
-	if (sax->all_event != NULL && !sax->all_event(XML_EVENT_START_DOC, NULL, (SXML_CHAR*)sd->name, 0, sd))
-		return true;
+	if (str == NULL || xmlnode == NULL)
+		return TAG_ERROR;
 
-	ret = true;
-	exit = false;
-	sd->line_num = 1; /* Line counter, starts at 1 */
-	sz = 0; /* 'line' buffer size */
-	node.init_value = 0;
-	(void)XMLNode_init(&node);
-	while ((n0 = read_line_alloc(in, in_type, &line, &sz, 0, NULC, C2SX('>'), true, C2SX('\n'), &ncr)) != 0) {
-		(void)XMLNode_free(&node);
-		for (p = line; *p != NULC && sx_isspace(*p); p++) ; /* Checks if text is only spaces */
-		if (*p == NULC)
-			break;
-		sd->line_num += ncr;
-
-		/* Get text for 'father' (i.e. what is before '<') */
-		while ((txt_end = sx_strchr(line, C2SX('<'))) == NULL) { /* '<' was not found, indicating a probable '>' inside text (should have been escaped with '&gt;' but we'll handle that ;) */
-			int n1 = read_line_alloc(in, in_type, &line, &sz, n0, 0, C2SX('>'), true, C2SX('\n'), &ncr); /* Go on reading the file from current position until next '>' */
-			sd->line_num += ncr;
-			if (n1 <= n0) {
-				ret = false;
-				if (sax->on_error == NULL && sax->all_event == NULL)
-					sx_fprintf(stderr, C2SX("%s:%d: MEMORY ERROR.\n"), sd->name, sd->line_num);
-				else {
-					if (sax->on_error != NULL && !sax->on_error(PARSE_ERR_MEMORY, sd->line_num, sd))
-						break;
-					if (sax->all_event != NULL && !sax->all_event(XML_EVENT_ERROR, NULL, (SXML_CHAR*)sd->name, PARSE_ERR_MEMORY, sd))
-						break;
-				}
-				break; /* 'txt_end' is still NULL here so we'll display the syntax error below */
-			}
-			n0 = n1;
-		}
-		if (txt_end == NULL) { /* Missing tag start */
-			ret = false;
-			if (sax->on_error == NULL && sax->all_event == NULL)
-				sx_fprintf(stderr, C2SX("%s:%d: ERROR: Unexpected end character '>', without matching '<'!\n"), sd->name, sd->line_num);
-			else {
-				if (sax->on_error != NULL && !sax->on_error(PARSE_ERR_UNEXPECTED_TAG_END, sd->line_num, sd))
-					break;
-				if (sax->all_event != NULL && !sax->all_event(XML_EVENT_ERROR, NULL, (SXML_CHAR*)sd->name, PARSE_ERR_UNEXPECTED_TAG_END, sd))
-					break;
-			}
-			break;
-		}
-		/* First part of 'line' (before '<') is to be added to 'father->text' */
-		*txt_end = NULC; /* Have 'line' be the text for 'father' */
-		if (*line != NULC && (sax->new_text != NULL || sax->all_event != NULL)) {
-			if (sax->new_text != NULL && (exit = !sax->new_text(line, sd))) /* no str_unescape(line) */
-				break;
-			if (sax->all_event != NULL && (exit = !sax->all_event(XML_EVENT_TEXT, NULL, line, sd->line_num, sd)))
-				break;
-		}
-		*txt_end = '<'; /* Restores tag start */
+	return _parse_1string(str, sx_strlen(str), xmlnode, &_user_tags, NULL);
+}
 
-		switch (tag_type = XML_parse_1string(txt_end, &node)) {
-			case TAG_ERROR: /* Memory error */
-				ret = false;
-				if (sax->on_error == NULL && sax->all_event == NULL)
-					sx_fprintf(stderr, C2SX("%s:%d: MEMORY ERROR.\n"), sd->name, sd->line_num);
-				else {
-					if (sax->on_error != NULL && (exit = !sax->on_error(PARSE_ERR_MEMORY, sd->line_num, sd)))
-						break;
-					if (sax->all_event != NULL && (exit = !sax->all_event(XML_EVENT_ERROR, NULL, (SXML_CHAR*)sd->name, PARSE_ERR_MEMORY, sd)))
-						break;
-				}
-				break;
-		
-			case TAG_NONE: /* Syntax error */
-				ret = false;
-				p = sx_strchr(txt_end, C2SX('\n'));
-				if (p != NULL)
-					*p = NULC;
-				if (sax->on_error == NULL && sax->all_event == NULL) {
-					sx_fprintf(stderr, C2SX("%s:%d: SYNTAX ERROR (%s%s).\n"), sd->name, sd->line_num, txt_end, p == NULL ? C2SX("") : C2SX("..."));
-					if (p != NULL)
-						*p = C2SX('\n');
-				} else {
-					if (sax->on_error != NULL && (exit = !sax->on_error(PARSE_ERR_SYNTAX, sd->line_num, sd)))
-						break;
-					if (sax->all_event != NULL && (exit = !sax->all_event(XML_EVENT_ERROR, NULL, (SXML_CHAR*)sd->name, PARSE_ERR_SYNTAX, sd)))
-						break;
-				}
-				break;
+/*
+ Write the Unicode character 'cp' to 'pd', in UTF-8 (or as a 'wchar_t', using a surrogate pair
+ when 'wchar_t' is 16 bits, if 'SXMLC_UNICODE' is defined).
+ Return the number of characters written (at most 4).
+ */
+static int _put_codepoint(SXML_CHAR* pd, unsigned long cp)
+{
+#ifdef SXMLC_UNICODE
+	if (sizeof(wchar_t) == 2 && cp > 0xffff) {
+		cp -= 0x10000;
+		pd[0] = (SXML_CHAR)(0xd800 | (cp >> 10));
+		pd[1] = (SXML_CHAR)(0xdc00 | (cp & 0x3ff));
+		return 2;
+	}
+	pd[0] = (SXML_CHAR)cp;
+	return 1;
+#else
+	if (cp < 0x80) {
+		pd[0] = (SXML_CHAR)cp;
+		return 1;
+	}
+	if (cp < 0x800) {
+		pd[0] = (SXML_CHAR)(0xc0 | (cp >> 6));
+		pd[1] = (SXML_CHAR)(0x80 | (cp & 0x3f));
+		return 2;
+	}
+	if (cp < 0x10000) {
+		pd[0] = (SXML_CHAR)(0xe0 | (cp >> 12));
+		pd[1] = (SXML_CHAR)(0x80 | ((cp >> 6) & 0x3f));
+		pd[2] = (SXML_CHAR)(0x80 | (cp & 0x3f));
+		return 3;
+	}
+	pd[0] = (SXML_CHAR)(0xf0 | (cp >> 18));
+	pd[1] = (SXML_CHAR)(0x80 | ((cp >> 12) & 0x3f));
+	pd[2] = (SXML_CHAR)(0x80 | ((cp >> 6) & 0x3f));
+	pd[3] = (SXML_CHAR)(0x80 | (cp & 0x3f));
+	return 4;
+#endif
+}
 
-			case TAG_END:
-				if (sax->end_node != NULL || sax->all_event != NULL) {
-					if (sax->end_node != NULL && (exit = !sax->end_node(&node, sd)))
-						break;
-					if (sax->all_event != NULL && (exit = !sax->all_event(XML_EVENT_END_NODE, &node, NULL, sd->line_num, sd)))
-						break;
-				}
-				break;
+/* --- Parser input --- */
 
-			default: /* Add 'node' to 'father' children */
-				/* If the line looks like a comment (or CDATA) but is not properly finished, loop until we find the end. */
-				while (tag_type == TAG_PARTIAL) {
-					int n1 = read_line_alloc(in, in_type, &line, &sz, n0, NULC, C2SX('>'), true, C2SX('\n'), &ncr); /* Go on reading the file from current position until next '>' */
-					sd->line_num += ncr;
-					if (n1 <= n0) {
-						ret = false;
-						if (sax->on_error == NULL && sax->all_event == NULL)
-							sx_fprintf(stderr, C2SX("%s:%d: SYNTAX ERROR.\n"), sd->name, sd->line_num);
-						else {
-							if (sax->on_error != NULL && (exit = !sax->on_error(meos(in) ? PARSE_ERR_EOF : PARSE_ERR_MEMORY, sd->line_num, sd)))
-								break;
-							if (sax->all_event != NULL && (exit = !sax->all_event(XML_EVENT_ERROR, NULL, (SXML_CHAR*)sd->name, meos(in) ? PARSE_ERR_EOF : PARSE_ERR_MEMORY, sd)))
-								break;
-						}
-						break;
-					}
-					n0 = n1;
-					txt_end = sx_strchr(line, C2SX('<')); /* In case 'line' has been moved by the '__realloc' in 'read_line_alloc' */
-					tag_type = XML_parse_1string(txt_end, &node);
-					if (tag_type == TAG_ERROR) {
-						ret = false;
-						if (sax->on_error == NULL && sax->all_event == NULL)
-							sx_fprintf(stderr, C2SX("%s:%d: PARSE ERROR.\n"), sd->name, sd->line_num);
-						else {
-							if (sax->on_error != NULL && (exit = !sax->on_error(meos(in) ? PARSE_ERR_EOF : PARSE_ERR_SYNTAX, sd->line_num, sd)))
-								break;
-							if (sax->all_event != NULL && (exit = !sax->all_event(XML_EVENT_ERROR, NULL, (SXML_CHAR*)sd->name, meos(in) ? PARSE_ERR_EOF : PARSE_ERR_SYNTAX, sd)))
-								break;
-						}
-						break;
-					}
-				}
-				if (ret == false)
-					break;
-				if (sax->start_node != NULL && (exit = !sax->start_node(&node, sd)))
-					break;
-				if (sax->all_event != NULL && (exit = !sax->all_event(XML_EVENT_START_NODE, &node, NULL, sd->line_num, sd)))
-					break;
-				if (node.tag_type != TAG_FATHER && (sax->end_node != NULL || sax->all_event != NULL)) {
-					if (sax->end_node != NULL && (exit = !sax->end_node(&node, sd)))
-						break;
-					if (sax->all_event != NULL && (exit = !sax->all_event(XML_EVENT_END_NODE, &node, NULL, sd->line_num, sd)))
-						break;
-				}
-			break;
-		}
-		if (exit == true || ret == false || meos(in))
-			break;
+/*
+ Block-buffered input used by the parser.
+ File data sources are read by blocks of 'SXMLC_BLOCK_SIZE' characters into 'mem', while
+ buffer data sources are used in place. Tokens are then found in 'data' with bulk
+ 'sx_memchr' scans instead of reading the data source one character at a time.
+ */
+typedef struct _ParseInput {
+	void* in;				/* 'FILE*', 'DataSourceBuffer*' or 'DataSourceUser*' */
+	DataSourceType in_type;
+	const SXML_CHAR* data;	/* Characters available for parsing ('mem' or the buffer data) */
+	size_t n_data;			/* Number of characters in 'data' */
+	size_t pos;				/* Index in 'data' of the first character not parsed yet */
+	SXML_CHAR* mem;			/* Block buffer for file data sources */
+	size_t sz_mem;			/* Size of 'mem' (in SXML_CHAR) */
+	int eof;				/* 'true' when 'in' has no more data to give */
+	int64_t offset;			/* Offset of 'data' from the start of the data source */
+	const XMLContext* ctx;	/* Context giving the allocator for 'mem' (set by '_parser_init') */
+	BOM_TYPE enc;			/* Encoding of a file data source, transcoded into 'mem' when UTF-16 or UTF-32 */
+	unsigned char* raw;		/* Bytes read from the file that could not be transcoded yet (incomplete character) */
+	size_t n_raw;			/* Number of bytes in 'raw' */
+} _ParseInput;
+
+static void _input_init(_ParseInput* inp, void* in, DataSourceType in_type)
+{
+	inp->in = in;
+	inp->in_type = in_type;
+	inp->data = NULL;
+	inp->n_data = 0;
+	inp->pos = 0;
+	inp->mem = NULL;
+	inp->sz_mem = 0;
+	inp->eof = false;
+	inp->offset = 0;
+	inp->enc = BOM_NONE;
+	inp->raw = NULL;
+	inp->n_raw = 0;
+
+	/* Buffer is used directly: all its data is available at once */
+	if (in_type == DATA_SOURCE_BUFFER) {
+		DataSourceBuffer* ds = (DataSourceBuffer*)in;
+		inp->data = ds->buf + ds->cur_pos;
+		inp->n_data = sx_strlen(inp->data);
+		inp->eof = true;
 	}
-	__free(line);
-	(void)XMLNode_free(&node);
+}
 
-	if (sax->end_doc != NULL && !sax->end_doc(sd))
-		return ret;
-	if (sax->all_event != NULL)
-		(void)sax->all_event(XML_EVENT_END_DOC, NULL, (SXML_CHAR*)sd->name, sd->line_num, sd);
+/*
+ Initialize 'inp' to parse the 'n' characters of 'data' in place (e.g. a memory-mapped file).
+ */
+static void _input_init_mem(_ParseInput* inp, const SXML_CHAR* data, size_t n)
+{
+	_input_init(inp, NULL, DATA_SOURCE_MAX);
+	inp->data = data;
+	inp->n_data = n;
+	inp->eof = true;
+}
 
-	return ret;
+static void _input_free(_ParseInput* inp)
+{
+	if (inp->in_type == DATA_SOURCE_BUFFER)
+		((DataSourceBuffer*)inp->in)->cur_pos += inp->pos;
+
+	if (inp->mem != NULL)
+		_ctx_free(inp->ctx, inp->mem);
+	inp->mem = NULL;
+	if (inp->raw != NULL)
+		_ctx_free(inp->ctx, inp->raw);
+	inp->raw = NULL;
+	inp->n_raw = 0;
+	inp->data = NULL;
+	inp->sz_mem = inp->n_data = inp->pos = 0;
 }
 
-int SAX_Callbacks_init(SAX_Callbacks* sax)
+/*
+ Move the characters not parsed yet to the beginning of 'inp->mem' (copying them from
+ 'inp->data' if needed), making sure there is room for at least 'n_more' characters after them.
+ Return 'false' on memory error.
+ */
+static int _input_reserve(_ParseInput* inp, size_t n_more)
 {
-	if (sax == NULL)
-		return false;
+	size_t n = inp->n_data - inp->pos, sz;
+	SXML_CHAR* p;
 
-	sax->start_doc = NULL;
-	sax->start_node = NULL;
-	sax->end_node = NULL;
-	sax->new_text = NULL;
-	sax->on_error = NULL;
-	sax->end_doc = NULL;
-	sax->all_event = NULL;
+	/* Grow the block when it is (almost) full of unparsed characters (e.g. a big CDATA) */
+	if (n + n_more > inp->sz_mem) {
+		sz = (inp->sz_mem == 0 ? SXMLC_BLOCK_SIZE : 2 * inp->sz_mem);
+		if (sz < n + n_more)
+			sz = n + n_more;
+		p = (SXML_CHAR*)_ctx_realloc(inp->ctx, inp->mem, sz * sizeof(SXML_CHAR));
+		if (p == NULL)
+			return false;
+		if (inp->data == inp->mem)
+			inp->data = p;
+		inp->mem = p;
+		inp->sz_mem = sz;
+	}
+
+	if (n > 0 && (inp->data != inp->mem || inp->pos > 0))
+		memmove(inp->mem, inp->data + inp->pos, n * sizeof(SXML_CHAR));
+	inp->offset += inp->pos;
+	inp->data = inp->mem;
+	inp->n_data = n;
+	inp->pos = 0;
 
 	return true;
 }
 
-int DOMXMLDoc_doc_start(SAX_Data* sd)
+/*
+ Read more data from the data source, keeping the characters after 'inp->pos' (which
+ will then be at the beginning of 'inp->data').
+ Return 1 when new characters were read, 0 when there is nothing to read (end of the
+ data source, or data given by 'XMLParser_feed'), -1 on memory error or -2 on read error.
+ */
+static int _input_fill(_ParseInput* inp)
 {
-	DOM_through_SAX* dom = (DOM_through_SAX*)sd->user;
+	size_t n, n_read, n_in, n_used;
 
-	dom->current = NULL;
-	dom->error = PARSE_ERR_NONE;
-	dom->line_error = 0;
+	if (inp->eof || inp->in == NULL)
+		return 0;
+
+	if (!_input_reserve(inp, SXMLC_BLOCK_SIZE / 2))
+		return -1;
+	n = inp->n_data;
+
+	if (inp->in_type == DATA_SOURCE_USER) {
+		DataSourceUser* ds = (DataSourceUser*)inp->in;
+		n_read = ds->read(ds->ctx, inp->mem + n, inp->sz_mem - n);
+		if (n_read == 0) {
+			inp->eof = true;
+			return _ueob(ds) ? 0 : -2;
+		}
+	} else if (inp->enc != BOM_NONE && inp->enc != BOM_UTF_8) {
+		/* UTF-16 or UTF-32 file: bytes are read after the ones left by the previous block and
+		   transcoded in bulk, reading no more than what can fit once transcoded */
+		if (inp->raw == NULL && (inp->raw = (unsigned char*)_ctx_realloc(inp->ctx, NULL, SXMLC_BLOCK_SIZE)) == NULL)
+			return -1;
+#ifndef SXMLC_UNICODE
+		n_in = (inp->sz_mem - n) / 3 * 2;
+#else
+		n_in = inp->sz_mem - n;
+#endif
+		if (n_in > SXMLC_BLOCK_SIZE)
+			n_in = SXMLC_BLOCK_SIZE;
+		n_in = inp->n_raw + fread(inp->raw + inp->n_raw, 1, n_in - inp->n_raw, (FILE*)inp->in);
+		if (n_in == inp->n_raw) {
+			inp->eof = true;
+			if (n_in == 0)
+				return 0;
+			/* Last character is truncated */
+			n_read = _put_codepoint(inp->mem + n, 0xfffd);
+			inp->n_raw = 0;
+		} else {
+			n_read = XML_transcode(inp->raw, n_in, inp->enc, inp->mem + n, &n_used);
+			inp->n_raw = n_in - n_used;
+			memmove(inp->raw, inp->raw + n_used, inp->n_raw);
+		}
+	} else {
+#ifndef SXMLC_UNICODE
+		n_read = fread(inp->mem + n, sizeof(SXML_CHAR), inp->sz_mem - n, (FILE*)inp->in);
+#else
+		wint_t c;
+		for (n_read = 0; n + n_read < inp->sz_mem && (c = sx_fgetc((FILE*)inp->in)) != CEOF; n_read++)
+			inp->mem[n + n_read] = (SXML_CHAR)c;
+#endif
+		if (n_read == 0) {
+			inp->eof = true;
+			return 0;
+		}
+	}
+	inp->n_data += n_read;
+
+	return 1;
+}
+
+/*
+ Report parse error 'error_num' to 'sax' callbacks, or print 'msg' to 'stderr' when there
+ are no callbacks to handle errors.
+ Return 'false' if a callback asked to stop parsing.
+ */
+static int _sax_error(const SAX_Callbacks* sax, SAX_Data* sd, ParseError error_num, const SXML_CHAR* msg)
+{
+	if (sax->on_error == NULL && sax->all_event == NULL) {
+		sx_fprintf(stderr, C2SX("%s:%d: %s\n"), sd->name, sd->line_num, msg);
+		return true;
+	}
+	if (sax->on_error != NULL && !sax->on_error(error_num, sd->line_num, sd))
+		return false;
+	if (sax->all_event != NULL && !sax->all_event(XML_EVENT_ERROR, NULL, (SXML_CHAR*)sd->name, error_num, sd))
+		return false;
 
 	return true;
 }
 
-int DOMXMLDoc_node_start(const XMLNode* node, SAX_Data* sd)
+/* --- Parser --- */
+
+/*
+ Namespace prefix declared by a node being parsed.
+ */
+typedef struct _NSBinding {
+	const SXML_CHAR* prefix;	/* Interned prefix, "" for the default namespace */
+	const SXML_CHAR* uri;		/* Interned URI, NULL when the default namespace is undeclared ('xmlns=""') */
+	int depth;					/* Depth of the declaring node (i.e. 'XMLParser.depth' of its children) */
+} _NSBinding;
+
+/*
+ Parser state. It is kept between calls to 'XMLParser_feed' so that parsing can resume
+ where data was missing.
+ */
+struct _XMLParser {
+	_ParseInput inp;
+	const SAX_Callbacks* sax;
+	const XMLContext* ctx;
+	SAX_Data sd;
+	XMLNode node;		/* Last tag read */
+	SXML_CHAR* strings;	/* Buffer for the strings of 'node' (tag, attribute names and values), NULL when they are allocated */
+	size_t sz_strings;	/* Size of 'strings' (in SXML_CHAR) */
+	_TagBuf tb;			/* Memory of 'node' reused from one tag to the next, unless 'own_strings' is 'true' */
+	int own_strings;	/* 'true' when strings of 'node' are allocated (i.e. 'node' can be moved out of the parser) */
+	SXML_CHAR* text;	/* Buffer for the text given to callbacks */
+	size_t sz_text;		/* Size of 'text' (in SXML_CHAR) */
+	size_t i_scan;		/* Where to resume searching for the next '<' or '>', relative to 'inp.pos' */
+	int in_tag;			/* 'true' when 'inp.pos' is on a '<' which '>' has not been found yet */
+	int scan_state;		/* What is being searched for in the tag (see '_parser_tag_len') */
+	const SXML_CHAR* tag_end;	/* End of the special tag being read (e.g. "-->") */
+	int len_tag_end;	/* Length of 'tag_end' */
+	size_t i_min_end;	/* 'tag_end' cannot start before this index */
+	SXML_CHAR quote;	/* Quote ending the attribute value being read */
+	const SXML_CHAR* tok;	/* Last text or tag read (not NUL-terminated), valid until next '_parser_next' */
+	size_t len_tok;		/* Length of 'tok' */
+	TagType tag_type;	/* Type of the last tag read */
+	ParseError error;	/* Error that stopped parsing */
+	int depth;			/* Number of nodes started and not ended yet */
+	int skip_depth;		/* Depth of the node which children are being skipped (see '_parser_skip'), 0 if none */
+	_NSBinding* ns;		/* Namespace prefixes in scope, when the context resolves namespaces */
+	_InternTable ns_strings;	/* Prefixes and URIs of 'ns', kept until the parser is freed as nodes given to callbacks point to them */
+	int n_ns;			/* Number of bindings in 'ns' */
+	int sz_ns;			/* Size of 'ns' */
+	int64_t line_start;	/* Offset of the first character of the current line */
+	int done;			/* 'true' when parsing is over (end of data, error or stopped by a callback) */
+	int ended;			/* 'true' when 'end_doc' callbacks have been called (or should not be) */
+	int ret;			/* 'false' when an error occurred */
+};
+
+static void _parser_init(XMLParser* parser, const SAX_Callbacks* sax, const SXML_CHAR* name, void* user, const XMLContext* ctx)
 {
-	DOM_through_SAX* dom = (DOM_through_SAX*)sd->user;
-	XMLNode* new_node;
+	parser->sax = sax;
+	parser->ctx = ctx;
+	parser->inp.ctx = ctx;
+	parser->sd.name = name;
+	parser->sd.user = user;
+	parser->sd.line_num = 1; /* Line counter, starts at 1 */
+	parser->sd.start_pos = 0;
+	parser->sd.end_pos = 0;
+	parser->sd.column = 1;
+	parser->line_start = 0;
+	parser->node.init_value = 0;
+	(void)XMLNode_init(&parser->node);
+	parser->strings = NULL;
+	parser->sz_strings = 0;
+	parser->tb.strings = NULL;
+	parser->tb.sz_attributes = 0;
+	parser->tb.lazy_values = (ctx != NULL && ctx->lazy_values);
+	parser->own_strings = false;
+	parser->text = NULL;
+	parser->sz_text = 0;
+	parser->i_scan = 0;
+	parser->in_tag = false;
+	parser->scan_state = 0;
+	parser->tag_end = NULL;
+	parser->len_tag_end = 0;
+	parser->i_min_end = 0;
+	parser->quote = NULC;
+	parser->tok = NULL;
+	parser->len_tok = 0;
+	parser->tag_type = TAG_NONE;
+	parser->error = PARSE_ERR_NONE;
+	parser->depth = 0;
+	parser->skip_depth = 0;
+	parser->ns = NULL;
+	parser->n_ns = 0;
+	parser->sz_ns = 0;
+	parser->ns_strings.strings = NULL;
+	parser->ns_strings.n = parser->ns_strings.sz = 0;
+	parser->done = false;
+	parser->ended = false;
+	parser->ret = true;
+}
+
+static void _parser_free(XMLParser* parser)
+{
+	_input_free(&parser->inp);
+	if (parser->text != NULL)
+		_ctx_free(parser->ctx, parser->text);
+	parser->text = NULL;
+	parser->sz_text = 0;
+	_tag_release(&parser->node, parser->own_strings ? NULL : &parser->tb);
+	if (parser->node.attributes != NULL)
+		__free(parser->node.attributes);
+	parser->node.attributes = NULL;
+	parser->tb.sz_attributes = 0;
+	if (parser->strings != NULL)
+		_ctx_free(parser->ctx, parser->strings);
+	parser->strings = NULL;
+	parser->sz_strings = 0;
+	if (parser->ns != NULL)
+		_ctx_free(parser->ctx, parser->ns);
+	parser->ns = NULL;
+	parser->n_ns = parser->sz_ns = 0;
+	_intern_free(&parser->ns_strings);
+}
+
+/*
+ Report error 'error_num' (or print 'msg' when there are no error callbacks) and stop parsing.
+ Nothing is reported when the parser has no callbacks (i.e. it is used by an 'XMLReader').
+ */
+static void _parser_error(XMLParser* parser, ParseError error_num, const SXML_CHAR* msg)
+{
+	parser->ret = false;
+	parser->done = true;
+	parser->error = error_num;
+	if (parser->sax != NULL)
+		(void)_sax_error(parser->sax, &parser->sd, error_num, msg);
+}
+
+/*
+ Report error 'rc' returned by '_input_fill'.
+ */
+static void _parser_input_error(XMLParser* parser, int rc)
+{
+	if (rc == -1)
+		_parser_error(parser, PARSE_ERR_MEMORY, C2SX("MEMORY ERROR."));
+	else
+		_parser_error(parser, PARSE_ERR_EOF, C2SX("ERROR: Cannot read data."));
+}
+
+/*
+ Check that a text or tag of 'n' characters is allowed by the parser context.
+ Return 'false' (and stop parsing) when it is too long.
+ */
+static int _parser_check_len(XMLParser* parser, size_t n)
+{
+	if (parser->ctx == NULL || parser->ctx->max_token_len == 0 || n <= parser->ctx->max_token_len)
+		return true;
+
+	_parser_error(parser, PARSE_ERR_LIMIT, C2SX("ERROR: Text or tag too long."));
+
+	return false;
+}
+
+/*
+ Check that the 'n' characters token at 'str' is valid UTF-8, when the parser context asks for it.
+ Return 'false' (and stop parsing) when it is not.
+ */
+static int _parser_check_utf8(XMLParser* parser, const SXML_CHAR* str, size_t n)
+{
+#ifndef SXMLC_UNICODE
+	if (parser->ctx == NULL || !parser->ctx->check_utf8 || utf8_check(str, n) == n)
+		return true;
+
+	_parser_error(parser, PARSE_ERR_ENCODING, C2SX("ERROR: Invalid UTF-8 sequence."));
+
+	return false;
+#else
+	return true;
+#endif
+}
+
+/*
+ Add binding of 'prefix' (which is 'len' characters long) to 'uri' ('len_uri' characters, no
+ namespace if 0) for the nodes under depth 'depth'.
+ Return 'false' on memory error.
+ */
+static int _parser_push_ns(XMLParser* parser, const SXML_CHAR* prefix, size_t len, const SXML_CHAR* uri, size_t len_uri, int depth)
+{
+	_NSBinding* p;
+	int sz;
+
+	if (parser->n_ns >= parser->sz_ns) {
+		sz = (parser->sz_ns == 0 ? 8 : 2 * parser->sz_ns);
+		p = (_NSBinding*)_ctx_realloc(parser->ctx, parser->ns, sz * sizeof(_NSBinding));
+		if (p == NULL)
+			return false;
+		parser->ns = p;
+		parser->sz_ns = sz;
+	}
+	p = &parser->ns[parser->n_ns];
+	p->prefix = _intern(&parser->ns_strings, prefix, len);
+	p->uri = (len_uri == 0 ? NULL : _intern(&parser->ns_strings, uri, len_uri));
+	p->depth = depth;
+	if (p->prefix == NULL || (len_uri > 0 && p->uri == NULL))
+		return false;
+	parser->n_ns++;
+
+	return true;
+}
+
+/*
+ Set '*ns_uri' and '*local_name' of node or attribute 'name' from the bindings in scope.
+ Unprefixed names are in the default namespace when 'use_default' is 'true', in no namespace otherwise.
+ */
+static void _parser_resolve_name(XMLParser* parser, const SXML_CHAR* name, int use_default, const SXML_CHAR** ns_uri, const SXML_CHAR** local_name)
+{
+	const SXML_CHAR* p = sx_strchr(name, C2SX(':'));
+	size_t len = (p == NULL ? 0 : p - name);
 	int i;
 
-	if ((new_node = XMLNode_dup(node, true)) == NULL) goto node_start_err; /* No real need to put 'true' for 'XMLNode_dup', but cleaner */
-	
-	if (dom->current == NULL) {
-		if ((i = _add_node(&dom->doc->nodes, &dom->doc->n_nodes, new_node)) < 0) goto node_start_err;
+	*local_name = (p == NULL ? name : p + 1);
+	*ns_uri = NULL;
+	if (p == NULL && !use_default)
+		return;
+	for (i = parser->n_ns - 1; i >= 0; i--) {
+		if (!sx_strncmp(parser->ns[i].prefix, name, len) && parser->ns[i].prefix[len] == NULC) {
+			*ns_uri = parser->ns[i].uri;
+			return;
+		}
+	}
+}
 
-		if (dom->doc->i_root < 0 && (node->tag_type == TAG_FATHER || node->tag_type == TAG_SELF))
-			dom->doc->i_root = i;
-	} else {
-		if (_add_node(&dom->current->children, &dom->current->n_children, new_node) < 0) goto node_start_err;
+/*
+ Resolve namespaces of 'parser->node', after the bindings it declares when it is a start node.
+ Bindings are removed at the end of the nodes declaring them.
+ Return 'false' on memory error.
+ */
+static int _parser_resolve_ns(XMLParser* parser)
+{
+	XMLNode* node = &parser->node;
+	XMLAttribute* attr;
+	const SXML_CHAR* value;
+	int i, depth;
+
+	/* Predefined prefixes, never removed */
+	if (parser->sz_ns == 0 && (!_parser_push_ns(parser, C2SX("xml"), 3, XML_NS_URI, sx_strlen(XML_NS_URI), -1)
+			|| !_parser_push_ns(parser, C2SX("xmlns"), 5, XMLNS_NS_URI, sx_strlen(XMLNS_NS_URI), -1)))
+		return false;
+
+	if (parser->tag_type == TAG_END) {
+		_parser_resolve_name(parser, node->tag, true, &node->ns_uri, &node->local_name);
+		for (; parser->n_ns > 0 && parser->ns[parser->n_ns - 1].depth >= parser->depth; parser->n_ns--) ;
+		return true;
 	}
 
-	new_node->father = dom->current;
-	dom->current = new_node;
+	depth = parser->depth + 1;
+	for (i = 0; i < node->n_attributes; i++) {
+		attr = &node->attributes[i];
+		if (sx_strncmp(attr->name, C2SX("xmlns"), 5) || (attr->name[5] != NULC && attr->name[5] != C2SX(':')))
+			continue;
+		value = XMLAttribute_get_value(attr);
+		if (attr->name[5] == NULC) {
+			if (!_parser_push_ns(parser, C2SX(""), 0, value, sx_strlen(value), depth))
+				return false;
+		} else if (!_parser_push_ns(parser, attr->name + 6, sx_strlen(attr->name + 6), value, sx_strlen(value), depth))
+			return false;
+	}
+
+	_parser_resolve_name(parser, node->tag, true, &node->ns_uri, &node->local_name);
+	for (i = 0; i < node->n_attributes; i++) {
+		attr = &node->attributes[i];
+		if (!sx_strcmp(attr->name, C2SX("xmlns"))) {
+			attr->ns_uri = parser->ns[1].uri; /* 'xmlns' predefined binding */
+			attr->local_name = attr->name;
+		} else
+			_parser_resolve_name(parser, attr->name, false, &attr->ns_uri, &attr->local_name);
+	}
+
+	/* Nodes without children end here */
+	if (parser->tag_type == TAG_SELF)
+		for (; parser->n_ns > 0 && parser->ns[parser->n_ns - 1].depth >= depth; parser->n_ns--) ;
 
 	return true;
+}
 
-node_start_err:
-	dom->error = PARSE_ERR_MEMORY;
-	dom->line_error = sd->line_num;
-	(void)XMLNode_free(new_node);
-	__free(new_node);
+static void _parser_start(XMLParser* parser)
+{
+	const SAX_Callbacks* sax = parser->sax;
+	SAX_Data* sd = &parser->sd;
 
-	return false;
+	if ((sax->start_doc != NULL && !sax->start_doc(sd))
+		|| (sax->all_event != NULL && !sax->all_event(XML_EVENT_START_DOC, NULL, (SXML_CHAR*)sd->name, 0, sd))) {
+		parser->done = true;
+		parser->ended = true; /* Parsing did not start, so it should not end either */
+	}
 }
 
-int DOMXMLDoc_node_end(const XMLNode* node, SAX_Data* sd)
+static int _parser_end(XMLParser* parser)
 {
-	DOM_through_SAX* dom = (DOM_through_SAX*)sd->user;
+	const SAX_Callbacks* sax = parser->sax;
+	SAX_Data* sd = &parser->sd;
 
-	if (dom->current == NULL || sx_strcmp(dom->current->tag, node->tag)) {
-		sx_fprintf(stderr, C2SX("%s:%d: ERROR - End tag </%s> was unexpected"), sd->name, sd->line_num, node->tag);
-		if (dom->current != NULL)
-			sx_fprintf(stderr, C2SX(" (</%s> was expected)\n"), dom->current->tag);
-		else
-			sx_fprintf(stderr, C2SX(" (no node to end)\n"));
+	parser->done = true;
+	if (parser->ended)
+		return parser->ret;
+	parser->ended = true;
+	sd->start_pos = sd->end_pos = parser->inp.offset + parser->inp.pos;
 
-		dom->error = PARSE_ERR_UNEXPECTED_NODE_END;
-		dom->line_error = sd->line_num;
+	if (sax->end_doc != NULL && !sax->end_doc(sd))
+		return parser->ret;
+	if (sax->all_event != NULL)
+		(void)sax->all_event(XML_EVENT_END_DOC, NULL, (SXML_CHAR*)sd->name, sd->line_num, sd);
 
-		return false;
+	return parser->ret;
+}
+
+/*
+ Set the position of the 'n' characters token at 'parser->inp.pos' in 'parser->sd', then
+ count its lines.
+ */
+static void _parser_token_pos(XMLParser* parser, size_t n)
+{
+	_ParseInput* inp = &parser->inp;
+	SAX_Data* sd = &parser->sd;
+	const SXML_CHAR *str = inp->data + inp->pos, *end = str + n, *p;
+
+	sd->start_pos = inp->offset + inp->pos;
+	sd->end_pos = sd->start_pos + n;
+	sd->column = (int)(sd->start_pos - parser->line_start) + 1;
+	for (p = str; p < end && (p = (const SXML_CHAR*)sx_memchr(p, C2SX('\n'), end - p)) != NULL; ) {
+		sd->line_num++;
+		parser->line_start = sd->start_pos + (++p - str);
 	}
+}
 
-	dom->current = dom->current->father;
+/*
+ Make 'parser->strings' at least 'n' characters long.
+ Return 'false' on memory error.
+ */
+static int _parser_reserve_strings(XMLParser* parser, size_t n)
+{
+	SXML_CHAR* p;
+
+	if (n <= parser->sz_strings)
+		return true;
+
+	n += MEM_INCR_RLA;
+	p = (SXML_CHAR*)_ctx_realloc(parser->ctx, parser->strings, n * sizeof(SXML_CHAR));
+	if (p == NULL)
+		return false;
+	parser->strings = p;
+	parser->sz_strings = n;
 
 	return true;
 }
 
-int DOMXMLDoc_node_text(SXML_CHAR* text, SAX_Data* sd)
+/* States of '_parser_tag_len' */
+enum {
+	SCAN_START,		/* Kind of tag not known yet */
+	SCAN_TAG,		/* Looking for '>' or the '=' before an attribute value */
+	SCAN_VALUE,		/* After '=', looking for the start of the attribute value */
+	SCAN_QUOTE,		/* Inside a quoted attribute value, looking for 'parser->quote' */
+	SCAN_DOCTYPE,	/* In a "<!DOCTYPE", looking for '>' or '[' */
+	SCAN_SPECIAL	/* Looking for 'parser->tag_end' */
+};
+
+/*
+ Set 'parser->scan_state' according to the kind of the tag starting at 'str' ('n' characters
+ available), as '_parse_1string' will: special tags end with their own end string (which is
+ the only place where their '>' can be), "<!DOCTYPE" with '>' or "]>" and other tags with a
+ '>' which is not inside a quoted attribute value.
+ Return 'false' if more characters are needed to know.
+ */
+static int _parser_tag_kind(XMLParser* parser, const SXML_CHAR* str, size_t n)
 {
-	SXML_CHAR* p = text;
-	DOM_through_SAX* dom = (DOM_through_SAX*)sd->user;
+	const _TAG* tag;
+	int more;
 
-	/* Keep text, even if it is only spaces */
-#if 0
-	while(*p != NULC && sx_isspace(*p++)) ;
-	if (*p == NULC) return true; /* Only spaces */
-#endif
+	tag = _find_special_tag(str, n, _ctx_user_tags(parser->ctx), !parser->inp.eof, &more);
+	if (more)
+		return false;
 
-	/* If there is no current node to add text to, raise an error, except if text is only spaces, in which case it is probably just formatting */
-	if (dom->current == NULL) {
-		while(*p != NULC && sx_isspace(*p++)) ;
-		if (*p == NULC) /* Only spaces => probably pretty-printing */
-			return true;
-		dom->error = PARSE_ERR_TEXT_OUTSIDE_NODE;
-		dom->line_error = sd->line_num;
-		return false; /* There is some "real" text => raise an error */
+	if (tag == &_doctype) {
+		parser->scan_state = SCAN_DOCTYPE;
+		parser->i_scan = 9;
+	} else if (tag == NULL) {
+		parser->scan_state = SCAN_TAG;
+	} else {
+		parser->scan_state = SCAN_SPECIAL;
+		parser->tag_end = tag->end;
+		parser->len_tag_end = tag->len_end;
+		parser->i_min_end = tag->len_start;
+		parser->i_scan = tag->len_start;
 	}
 
-	if (dom->text_as_nodes) {
-		XMLNode* new_node = XMLNode_allocN(1);
-		if (new_node == NULL || (new_node->text = sx_strdup(text)) == NULL
-			|| _add_node(&dom->current->children, &dom->current->n_children, new_node) < 0) {
-			dom->error = PARSE_ERR_MEMORY;
-			dom->line_error = sd->line_num;
-			(void)XMLNode_free(new_node);
-			__free(new_node);
-			return false;
+	return true;
+}
+
+/*
+ Look for the end of the tag at 'str' ('n' characters available), from 'parser->i_scan'.
+ Characters are looked at only once: the search state is kept in 'parser' when the tag end
+ is not available yet, so that the search can resume once more data has been read.
+ Return the length of the tag, or 0 if its end was not found.
+ */
+static size_t _parser_tag_len(XMLParser* parser, const SXML_CHAR* str, size_t n)
+{
+	const SXML_CHAR* q;
+	size_t i;
+
+	if (parser->scan_state == SCAN_START && !_parser_tag_kind(parser, str, n))
+		return 0;
+
+	for (i = parser->i_scan; i < n; ) {
+		switch (parser->scan_state) {
+			case SCAN_TAG:
+				i += _scan(str + i, n - i, &_scan_tag_end);
+				if (i >= n)
+					break;
+				if (str[i++] == C2SX('>'))
+					return i;
+				parser->scan_state = SCAN_VALUE;
+				break;
+
+			case SCAN_VALUE: /* Same as '_parse_1string': only values starting with a quote can hide a '>' */
+				while (i < n && sx_isspace(str[i])) i++;
+				if (i >= n)
+					break;
+				if (isquote(str[i])) {
+					parser->quote = str[i++];
+					parser->scan_state = SCAN_QUOTE;
+				} else
+					parser->scan_state = SCAN_TAG;
+				break;
+
+			case SCAN_QUOTE:
+				q = (const SXML_CHAR*)sx_memchr(str + i, parser->quote, n - i);
+				i = (q == NULL ? n : (size_t)(q - str) + 1);
+				if (q != NULL)
+					parser->scan_state = SCAN_TAG;
+				break;
+
+			case SCAN_DOCTYPE:
+				i += _scan(str + i, n - i, &_scan_doctype_end);
+				if (i >= n)
+					break;
+				if (str[i++] == C2SX('>'))
+					return i;
+				parser->scan_state = SCAN_SPECIAL;
+				parser->tag_end = C2SX("]>");
+				parser->len_tag_end = 2;
+				parser->i_min_end = i;
+				break;
+
+			case SCAN_SPECIAL: /* Only check the end string where its last character is found */
+				q = (const SXML_CHAR*)sx_memchr(str + i, parser->tag_end[parser->len_tag_end - 1], n - i);
+				i = (q == NULL ? n : (size_t)(q - str) + 1);
+				if (q != NULL && i >= parser->i_min_end + parser->len_tag_end
+					&& !sx_strncmp(str + i - parser->len_tag_end, parser->tag_end, parser->len_tag_end))
+					return i;
+				break;
 		}
-		new_node->tag_type = TAG_TEXT;
-		new_node->father = dom->current;
-		//dom->current->tag_type = TAG_FATHER; // OS: should parent field be forced to be TAG_FATHER? now it has at least one TAG_TEXT child. I decided not to enforce this to enforce backward-compatibility related to tag_types
-		return true;
-	} else { /* Old behaviour: concatenate text to the previous one */
-		/* 'p' will point at the new text */
-		if (dom->current->text == NULL) {
-			p = sx_strdup(text);
-		} else {
-			p = (SXML_CHAR*)__realloc(dom->current->text, (sx_strlen(dom->current->text) + sx_strlen(text) + 1)*sizeof(SXML_CHAR));
-			if (p != NULL)
-				sx_strcat(p, text);
+	}
+	parser->i_scan = i;
+
+	return 0;
+}
+
+/*
+ Skip the data of 'parser->inp' up to the end tag of the node at depth 'parser->skip_depth',
+ only looking for '<' and tag ends, and counting the nodes started and ended meanwhile: no node
+ is built and nothing is checked. The end tag itself is left to '_parser_next', so that the
+ skipped node ends as usual.
+ Return 1 when the end tag (or the end of data) was reached, 0 if more data is needed
+ (see 'XMLParser_feed') or -1 on error.
+ */
+static int _parser_skip(XMLParser* parser)
+{
+	_ParseInput* inp = &parser->inp;
+	const SXML_CHAR *str, *q;
+	size_t n, len, i = 0; /* 'i' characters after 'inp->pos' were skipped, their lines are counted at once */
+	int rc;
+
+	for (;;) {
+		str = inp->data + inp->pos + i;
+		n = inp->n_data - inp->pos - i;
+
+		if (!parser->in_tag) {
+			q = (parser->i_scan < n ? (const SXML_CHAR*)sx_memchr(str + parser->i_scan, C2SX('<'), n - parser->i_scan) : NULL);
+			if (q == NULL) {
+				/* Text is dropped as it is read, so that it is not kept in memory */
+				_parser_token_pos(parser, i + n);
+				inp->pos += i + n;
+				i = 0;
+				parser->i_scan = 0;
+				if ((rc = _input_fill(inp)) > 0)
+					continue;
+				if (rc < 0) {
+					_parser_input_error(parser, rc);
+					return -1;
+				}
+				if (!inp->eof)
+					return 0;
+				break; /* End of data: nodes are not checked to be ended, as in '_parser_next' */
+			}
+			i += q - str;
+			str = q;
+			n = inp->n_data - inp->pos - i;
+			parser->in_tag = true;
+			parser->i_scan = 1;
+			parser->scan_state = SCAN_START;
 		}
-		if (p == NULL) {
-			dom->error = PARSE_ERR_MEMORY;
-			dom->line_error = sd->line_num;
-			return false;
+
+		if ((len = _parser_tag_len(parser, str, n)) == 0) {
+			if (!_parser_check_len(parser, n))
+				return -1;
+			_parser_token_pos(parser, i);
+			inp->pos += i;
+			i = 0;
+			if ((rc = _input_fill(inp)) > 0)
+				continue;
+			if (rc < 0) {
+				_parser_input_error(parser, rc);
+				return -1;
+			}
+			if (!inp->eof)
+				return 0;
+			break; /* Truncated tag, reported by '_parser_next' */
 		}
-		
-		dom->current->text = p;
+
+		/* Only element tags are counted ("<!...>" not being special tags is an error anyway) */
+		if (parser->scan_state == SCAN_TAG && len > 2) {
+			if (str[1] == C2SX('/')) {
+				if (parser->depth <= parser->skip_depth) { /* End of the skipped node: read it again */
+					parser->i_scan = 1;
+					parser->scan_state = SCAN_START;
+					break;
+				}
+				parser->depth--;
+			} else if (str[1] != C2SX('!') && str[1] != C2SX('?') && str[len - 2] != C2SX('/'))
+				parser->depth++;
+		}
+		i += len;
+		parser->in_tag = false;
+		parser->i_scan = 0;
 	}
+	_parser_token_pos(parser, i);
+	inp->pos += i;
+	parser->skip_depth = 0;
+
+	return 1;
+}
+
+/* Tokens read by '_parser_next' */
+typedef enum _ParseToken {
+	TOKEN_MORE,		/* More data is needed (see 'XMLParser_feed') */
+	TOKEN_TEXT,		/* Text before a tag, in 'parser->tok' */
+	TOKEN_TAG,		/* Tag in 'parser->tok', parsed in 'parser->node' as 'parser->tag_type' */
+	TOKEN_END		/* End of data or error, 'parser->done' is 'true' */
+} ParseToken;
+
+/*
+ Read the next token (text or tag) from the data available in 'parser->inp', and update
+ the line number. The token and 'parser->node' are only valid until next call.
+ */
+static ParseToken _parser_next(XMLParser* parser)
+{
+	_ParseInput* inp = &parser->inp;
+	const SXML_CHAR *str, *q;
+	size_t n, len;
+	int rc;
+
+	if (parser->skip_depth > 0 && !parser->done && (rc = _parser_skip(parser)) <= 0)
+		return (rc == 0 ? TOKEN_MORE : TOKEN_END);
+
+	while (!parser->done) {
+		str = inp->data + inp->pos;
+		n = inp->n_data - inp->pos;
+
+		if (!parser->in_tag) {
+			/* Get text for 'father' (i.e. what is before '<') */
+			q = (parser->i_scan < n ? (const SXML_CHAR*)sx_memchr(str + parser->i_scan, C2SX('<'), n - parser->i_scan) : NULL);
+			if (q == NULL) {
+				parser->i_scan = n;
+				if (!_parser_check_len(parser, n))
+					break;
+				if ((rc = _input_fill(inp)) > 0)
+					continue;
+				if (rc < 0) {
+					_parser_input_error(parser, rc);
+					break;
+				}
+				if (!inp->eof)
+					return TOKEN_MORE;
+				/* End of data: remaining text should only be spaces */
+				for (n = 0; n < inp->n_data - inp->pos && sx_isspace(str[n]); n++) ;
+				if (n < inp->n_data - inp->pos) {
+					_parser_token_pos(parser, n);
+					if (sx_memchr(str, C2SX('>'), inp->n_data - inp->pos) != NULL)
+						_parser_error(parser, PARSE_ERR_UNEXPECTED_TAG_END, C2SX("ERROR: Unexpected end character '>', without matching '<'!"));
+					else
+						_parser_error(parser, PARSE_ERR_EOF, C2SX("ERROR: Unexpected end of file."));
+				}
+				inp->pos = inp->n_data;
+				parser->done = true;
+				break;
+			}
+
+			parser->in_tag = true;
+			parser->i_scan = 1;
+			parser->scan_state = SCAN_START;
+			/* First part (before '<') is to be added to 'father->text' */
+			n = q - str;
+			if (!_parser_check_len(parser, n))
+				break;
+			if (n > 0 && parser->ctx != NULL && parser->ctx->text_spaces != TEXT_SPACES_KEEP) {
+				/* Drop leading spaces, i.e. the whole text when it is only spaces */
+				for (len = 0; len < n && sx_isspace(str[len]); len++) ;
+				if (len == n || parser->ctx->text_spaces == TEXT_SPACES_TRIM) {
+					_parser_token_pos(parser, len);
+					inp->pos += len;
+					str += len;
+					n -= len;
+				}
+			}
+			if (n > 0) {
+				_parser_token_pos(parser, n);
+				if (!_parser_check_utf8(parser, str, n))
+					break;
+				inp->pos += n;
+				parser->tok = str;
+				parser->len_tok = n;
+				/* Drop trailing spaces ('str' starts with a non-space character) */
+				if (parser->ctx != NULL && parser->ctx->text_spaces == TEXT_SPACES_TRIM)
+					while (sx_isspace(str[parser->len_tok - 1])) parser->len_tok--;
+				return TOKEN_TEXT;
+			}
+			n = inp->n_data - inp->pos;
+		}
+
+		/* Read the tag until its end, so that it is parsed only once */
+		if ((len = _parser_tag_len(parser, str, n)) == 0) {
+			if (!_parser_check_len(parser, n))
+				break;
+			if ((rc = _input_fill(inp)) > 0)
+				continue;
+			if (rc < 0)
+				_parser_input_error(parser, rc);
+			else if (inp->eof)
+				_parser_error(parser, PARSE_ERR_EOF, C2SX("SYNTAX ERROR."));
+			else
+				return TOKEN_MORE;
+			break;
+		}
+		n = len;
+		if (!_parser_check_len(parser, n) || !_parser_check_utf8(parser, str, n))
+			break;
+		if (!parser->own_strings && !_parser_reserve_strings(parser, 2 * n)) {
+			_parser_error(parser, PARSE_ERR_MEMORY, C2SX("MEMORY ERROR."));
+			break;
+		}
+		_tag_release(&parser->node, parser->own_strings ? NULL : &parser->tb);
+		parser->tb.strings = parser->strings;
+		parser->tag_type = _parse_1string(str, (int)n, &parser->node, _ctx_user_tags(parser->ctx), parser->own_strings ? NULL : &parser->tb);
+		if (parser->tag_type == TAG_PARTIAL) { /* Should not happen, but '_parse_1string' knows better: keep on searching */
+			parser->i_scan = n;
+			continue;
+		}
+		_parser_token_pos(parser, n);
+		if (parser->ctx != NULL && parser->ctx->namespaces
+				&& (parser->tag_type == TAG_FATHER || parser->tag_type == TAG_SELF || parser->tag_type == TAG_END)
+				&& !_parser_resolve_ns(parser)) {
+			_parser_error(parser, PARSE_ERR_MEMORY, C2SX("MEMORY ERROR."));
+			break;
+		}
+		if (parser->tag_type == TAG_FATHER || parser->tag_type == TAG_SELF) {
+			if (parser->ctx != NULL && parser->ctx->max_depth > 0 && parser->depth >= parser->ctx->max_depth) {
+				_parser_error(parser, PARSE_ERR_LIMIT, C2SX("ERROR: Too many nested nodes."));
+				break;
+			}
+			if (parser->tag_type == TAG_FATHER)
+				parser->depth++;
+		} else if (parser->tag_type == TAG_END && parser->depth > 0)
+			parser->depth--;
+		inp->pos += n;
+		parser->in_tag = false;
+		parser->i_scan = 0;
+		parser->tok = str;
+		parser->len_tok = n;
+		return TOKEN_TAG;
+	}
+
+	return TOKEN_END;
+}
+
+/*
+ Parse data available in 'parser->inp', calling SAX callbacks for each text and tag read.
+ Return when all data has been parsed ('parser->done' is 'true') or when more data is
+ needed (i.e. more data should be given with 'XMLParser_feed').
+ */
+static void _parser_run(XMLParser* parser)
+{
+	const SAX_Callbacks* sax = parser->sax;
+	SAX_Data* sd = &parser->sd;
+	XMLNode* node = &parser->node;
+	SXML_CHAR* p;
+	const SXML_CHAR* str;
+	size_t n, len;
+	int exit = false, rc;
+
+	while (!parser->done) {
+		switch (_parser_next(parser)) {
+			case TOKEN_MORE:
+				return;
+
+			case TOKEN_TEXT:
+				if (sax->new_text == NULL && sax->all_event == NULL)
+					break;
+				n = parser->len_tok;
+				if (n + 1 > parser->sz_text) {
+					p = (SXML_CHAR*)_ctx_realloc(parser->ctx, parser->text, (n + 1 + MEM_INCR_RLA) * sizeof(SXML_CHAR));
+					if (p == NULL) {
+						_parser_error(parser, PARSE_ERR_MEMORY, C2SX("MEMORY ERROR."));
+						break;
+					}
+					parser->text = p;
+					parser->sz_text = n + 1 + MEM_INCR_RLA;
+				}
+				memcpy(parser->text, parser->tok, n * sizeof(SXML_CHAR));
+				parser->text[n] = NULC;
+				if (sax->new_text != NULL && (exit = !sax->new_text(parser->text, sd))) /* no str_unescape(text) */
+					break;
+				if (sax->all_event != NULL && (exit = !sax->all_event(XML_EVENT_TEXT, NULL, parser->text, sd->line_num, sd)))
+					break;
+				break;
+
+			case TOKEN_TAG:
+				switch (parser->tag_type) {
+					case TAG_ERROR: /* Memory error */
+						_parser_error(parser, PARSE_ERR_MEMORY, C2SX("MEMORY ERROR."));
+						break;
+				
+					case TAG_NONE: /* Syntax error */
+						parser->ret = false;
+						parser->done = true;
+						parser->error = PARSE_ERR_SYNTAX;
+						str = parser->tok;
+						len = parser->len_tok;
+						for (n = 0; n < len && str[n] != C2SX('\n'); n++) ;
+						if (sax->on_error == NULL && sax->all_event == NULL)
+							sx_fprintf(stderr, C2SX("%s:%d: SYNTAX ERROR (%.*s%s).\n"), sd->name, sd->line_num, (int)n, str, n < len ? C2SX("...") : C2SX(""));
+						else
+							(void)_sax_error(sax, sd, PARSE_ERR_SYNTAX, NULL);
+						break;
+
+					case TAG_END:
+						if (sax->end_node != NULL && (exit = !sax->end_node(node, sd)))
+							break;
+						if (sax->all_event != NULL && (exit = !sax->all_event(XML_EVENT_END_NODE, node, NULL, sd->line_num, sd)))
+							break;
+						break;
+
+					default: /* Add 'node' to 'father' children */
+						rc = true;
+						if (sax->start_node != NULL && (exit = !(rc = sax->start_node(node, sd))))
+							break;
+						if (rc == SAX_SKIP_CHILDREN && node->tag_type == TAG_FATHER)
+							parser->skip_depth = parser->depth;
+						if (sax->all_event != NULL && (exit = !(rc = sax->all_event(XML_EVENT_START_NODE, node, NULL, sd->line_num, sd))))
+							break;
+						if (rc == SAX_SKIP_CHILDREN && node->tag_type == TAG_FATHER)
+							parser->skip_depth = parser->depth;
+						if (node->tag_type != TAG_FATHER) {
+							if (sax->end_node != NULL && (exit = !sax->end_node(node, sd)))
+								break;
+							if (sax->all_event != NULL && (exit = !sax->all_event(XML_EVENT_END_NODE, node, NULL, sd->line_num, sd)))
+								break;
+						}
+						break;
+				}
+				break;
+
+			default: /* TOKEN_END: 'parser->done' is set */
+				break;
+		}
+		if (exit)
+			parser->done = true;
+	}
+}
+
+/*
+ Parse the whole data source of 'parser', from start to end.
+ */
+static int _parse_data_SAX(XMLParser* parser)
+{
+	_parser_start(parser);
+	_parser_run(parser);
+
+	return _parser_end(parser);
+}
+
+XMLParser* XMLParser_create_ctx(const SAX_Callbacks* sax, const SXML_CHAR* name, void* user, const XMLContext* ctx)
+{
+	XMLParser* parser;
+
+	if (sax == NULL)
+		return NULL;
+
+	parser = (XMLParser*)__malloc(sizeof(XMLParser));
+	if (parser == NULL)
+		return NULL;
+
+	_parser_init(parser, sax, name, user, ctx);
+	_input_init_mem(&parser->inp, NULL, 0);
+	parser->inp.eof = false; /* Data will be given by 'XMLParser_feed' */
+	_parser_start(parser);
+
+	return parser;
+}
+
+int XMLParser_feed(XMLParser* parser, const SXML_CHAR* chunk, size_t len)
+{
+	_ParseInput* inp;
+
+	if (parser == NULL || (chunk == NULL && len > 0))
+		return false;
+
+	if (parser->done)
+		return false;
+
+	inp = &parser->inp;
+	if (inp->pos >= inp->n_data) { /* Nothing left from previous chunks: parse 'chunk' in place */
+		inp->offset += inp->pos;
+		inp->data = chunk;
+		inp->n_data = len;
+		inp->pos = 0;
+	} else {
+		if (!_input_reserve(inp, len)) {
+			_parser_error(parser, PARSE_ERR_MEMORY, C2SX("MEMORY ERROR."));
+			return false;
+		}
+		memcpy(inp->mem + inp->n_data, chunk, len * sizeof(SXML_CHAR));
+		inp->n_data += len;
+	}
+
+	_parser_run(parser);
+
+	/* Keep what could not be parsed yet, as 'chunk' will not be available anymore */
+	if (parser->done) {
+		inp->offset += inp->pos;
+		inp->data = inp->mem;
+		inp->n_data = inp->pos = 0;
+	} else if (inp->data != inp->mem && !_input_reserve(inp, 0))
+		_parser_error(parser, PARSE_ERR_MEMORY, C2SX("MEMORY ERROR."));
+
+	return !parser->done;
+}
+
+int XMLParser_finish(XMLParser* parser)
+{
+	if (parser == NULL)
+		return false;
+
+	parser->inp.eof = true;
+	_parser_run(parser);
+
+	return _parser_end(parser);
+}
+
+int XMLParser_free(XMLParser* parser)
+{
+	if (parser == NULL)
+		return false;
+
+	_parser_free(parser);
+	__free(parser);
+
+	return true;
+}
+
+int SAX_Callbacks_init(SAX_Callbacks* sax)
+{
+	if (sax == NULL)
+		return false;
+
+	sax->start_doc = NULL;
+	sax->start_node = NULL;
+	sax->end_node = NULL;
+	sax->new_text = NULL;
+	sax->on_error = NULL;
+	sax->end_doc = NULL;
+	sax->all_event = NULL;
+
+	return true;
+}
+
+int DOMXMLDoc_doc_start(SAX_Data* sd)
+{
+	DOM_through_SAX* dom = (DOM_through_SAX*)sd->user;
+
+	dom->current = NULL;
+	dom->error = PARSE_ERR_NONE;
+	dom->line_error = 0;
+
+	return true;
+}
+
+/*
+ Add 'new_node' to the document being built, as a child of the current node, and make it
+ the current node. 'new_node' is owned by the document (or freed in case of error).
+ */
+static int _dom_add_node(XMLNode* new_node, SAX_Data* sd)
+{
+	DOM_through_SAX* dom = (DOM_through_SAX*)sd->user;
+	int i;
+
+	if (dom->current == NULL) {
+		if ((i = _add_node(&dom->doc->nodes, &dom->doc->n_nodes, new_node)) < 0) goto node_start_err;
+
+		if (dom->doc->i_root < 0 && (new_node->tag_type == TAG_FATHER || new_node->tag_type == TAG_SELF))
+			dom->doc->i_root = i;
+	} else {
+		if (_add_node(&dom->current->children, &dom->current->n_children, new_node) < 0) goto node_start_err;
+	}
+
+	new_node->father = dom->current;
+	dom->current = new_node;
+
+	return true;
+
+node_start_err:
+	dom->error = PARSE_ERR_MEMORY;
+	dom->line_error = sd->line_num;
+	(void)XMLNode_free(new_node);
+	__free(new_node);
+
+	return false;
+}
+
+int DOMXMLDoc_node_start(const XMLNode* node, SAX_Data* sd)
+{
+	XMLNode* new_node;
+
+	DOM_through_SAX* dom = (DOM_through_SAX*)sd->user;
+
+	if ((new_node = _XMLNode_dup(node, true, dom->doc->names, dom->doc->ns_uris)) == NULL) { /* No real need to put 'true' for 'XMLNode_dup', but cleaner */
+		dom->error = PARSE_ERR_MEMORY;
+		dom->line_error = sd->line_num;
+		return false;
+	}
+
+	return _dom_add_node(new_node, sd);
+}
+
+int DOMXMLDoc_node_end(const XMLNode* node, SAX_Data* sd)
+{
+	DOM_through_SAX* dom = (DOM_through_SAX*)sd->user;
+
+	if (dom->current == NULL || sx_strcmp(dom->current->tag, node->tag)) {
+		sx_fprintf(stderr, C2SX("%s:%d: ERROR - End tag </%s> was unexpected"), sd->name, sd->line_num, node->tag);
+		if (dom->current != NULL)
+			sx_fprintf(stderr, C2SX(" (</%s> was expected)\n"), dom->current->tag);
+		else
+			sx_fprintf(stderr, C2SX(" (no node to end)\n"));
+
+		dom->error = PARSE_ERR_UNEXPECTED_NODE_END;
+		dom->line_error = sd->line_num;
+
+		return false;
+	}
+
+	dom->current = dom->current->father;
+
+	return true;
+}
+
+int DOMXMLDoc_node_text(SXML_CHAR* text, SAX_Data* sd)
+{
+	SXML_CHAR* p = text;
+	DOM_through_SAX* dom = (DOM_through_SAX*)sd->user;
+
+	/* Keep text, even if it is only spaces */
+#if 0
+	while(*p != NULC && sx_isspace(*p++)) ;
+	if (*p == NULC) return true; /* Only spaces */
+#endif
+
+	/* If there is no current node to add text to, raise an error, except if text is only spaces, in which case it is probably just formatting */
+	if (dom->current == NULL) {
+		while(*p != NULC && sx_isspace(*p++)) ;
+		if (*p == NULC) /* Only spaces => probably pretty-printing */
+			return true;
+		dom->error = PARSE_ERR_TEXT_OUTSIDE_NODE;
+		dom->line_error = sd->line_num;
+		return false; /* There is some "real" text => raise an error */
+	}
+
+	if (dom->text_as_nodes) {
+		XMLNode* new_node = XMLNode_allocN(1);
+		if (new_node == NULL || (new_node->text = sx_strdup(text)) == NULL
+			|| _add_node(&dom->current->children, &dom->current->n_children, new_node) < 0) {
+			dom->error = PARSE_ERR_MEMORY;
+			dom->line_error = sd->line_num;
+			(void)XMLNode_free(new_node);
+			__free(new_node);
+			return false;
+		}
+		new_node->tag_type = TAG_TEXT;
+		new_node->father = dom->current;
+		//dom->current->tag_type = TAG_FATHER; // OS: should parent field be forced to be TAG_FATHER? now it has at least one TAG_TEXT child. I decided not to enforce this to enforce backward-compatibility related to tag_types
+		return true;
+	} else { /* Old behaviour: concatenate text to the previous one */
+		/* 'p' will point at the new text */
+		if (dom->current->text == NULL) {
+			p = sx_strdup(text);
+		} else {
+			p = (SXML_CHAR*)__realloc(dom->current->text, (sx_strlen(dom->current->text) + sx_strlen(text) + 1)*sizeof(SXML_CHAR));
+			if (p != NULL)
+				sx_strcat(p, text);
+		}
+		if (p == NULL) {
+			dom->error = PARSE_ERR_MEMORY;
+			dom->line_error = sd->line_num;
+			return false;
+		}
+		
+		dom->current->text = p;
+	}
+
+	return true;
+}
+
+int DOMXMLDoc_parse_error(ParseError error_num, int line_number, SAX_Data* sd)
+{
+	DOM_through_SAX* dom = (DOM_through_SAX*)sd->user;
+
+	dom->error = error_num;
+	dom->line_error = line_number;
+
+	/* Complete error message will be displayed in 'DOMXMLDoc_doc_end' callback */
+
+	return false; /* Stop on error */
+}
+
+int DOMXMLDoc_doc_end(SAX_Data* sd)
+{
+	DOM_through_SAX* dom = (DOM_through_SAX*)sd->user;
+
+	if (dom->error != PARSE_ERR_NONE) {
+		SXML_CHAR* msg;
+
+		switch (dom->error) {
+			case PARSE_ERR_MEMORY:				msg = C2SX("MEMORY"); break;
+			case PARSE_ERR_UNEXPECTED_TAG_END:	msg = C2SX("UNEXPECTED_TAG_END"); break;
+			case PARSE_ERR_SYNTAX:				msg = C2SX("SYNTAX"); break;
+			case PARSE_ERR_EOF:					msg = C2SX("UNEXPECTED_END_OF_FILE"); break;
+			case PARSE_ERR_TEXT_OUTSIDE_NODE:	msg = C2SX("TEXT_OUTSIDE_NODE"); break;
+			case PARSE_ERR_UNEXPECTED_NODE_END:	msg = C2SX("UNEXPECTED_NODE_END"); break;
+			case PARSE_ERR_LIMIT:				msg = C2SX("LIMIT"); break;
+			case PARSE_ERR_ENCODING:			msg = C2SX("ENCODING"); break;
+			default:							msg = C2SX("UNKNOWN"); break;
+		}
+		sx_fprintf(stderr, C2SX("%s:%d: An error was found (%s), loading aborted...\n"), sd->name, dom->line_error, msg);
+		dom->current = NULL;
+		(void)XMLDoc_free(dom->doc);
+		dom->doc = NULL;
+	}
+
+	return true;
+}
+
+int SAX_Callbacks_init_DOM(SAX_Callbacks* sax)
+{
+	if (sax == NULL)
+		return false;
+
+	sax->start_doc = DOMXMLDoc_doc_start;
+	sax->start_node = DOMXMLDoc_node_start;
+	sax->end_node = DOMXMLDoc_node_end;
+	sax->new_text = DOMXMLDoc_node_text;
+	sax->on_error = DOMXMLDoc_parse_error;
+	sax->end_doc = DOMXMLDoc_doc_end;
+	sax->all_event = NULL;
+
+	return true;
+}
+
+/* --- Record streaming --- */
+
+int RecordStream_init(RecordStream* rs, const SXML_CHAR* tag, int (*on_record)(XMLNode* record, SAX_Data* sd), void* user)
+{
+	if (rs == NULL)
+		return false;
+
+	rs->tag = tag;
+	rs->match = NULL;
+	rs->match_data = NULL;
+	rs->on_record = on_record;
+	rs->user = user;
+	rs->text_as_nodes = false;
+	rs->error = PARSE_ERR_NONE;
+	rs->record = NULL;
+	rs->path = NULL;
+	rs->doc.init_value = 0;
+	(void)XMLDoc_init(&rs->doc);
+	rs->dom.doc = &rs->doc;
+	rs->dom.current = NULL;
+
+	return true;
+}
+
+static int _record_doc_start(SAX_Data* sd)
+{
+	RecordStream* rs = (RecordStream*)sd->user;
+
+	rs->error = PARSE_ERR_NONE;
+	rs->record = NULL;
+	rs->path = NULL;
+	rs->dom.doc = &rs->doc;
+	rs->dom.current = NULL;
+	rs->dom.error = PARSE_ERR_NONE;
+	rs->dom.line_error = 0;
+	rs->dom.text_as_nodes = rs->text_as_nodes;
+
+	return true;
+}
+
+static int _record_node_start(const XMLNode* node, SAX_Data* sd)
+{
+	RecordStream* rs = (RecordStream*)sd->user;
+	SAX_Data dom_sd = *sd;
+	XMLNode* new_node;
+	int is_record;
+
+	dom_sd.user = &rs->dom;
+
+	/* Inside a record, build its tree */
+	if (rs->dom.current != NULL)
+		return DOMXMLDoc_node_start(node, &dom_sd);
+
+	if ((new_node = XMLNode_dup(node, false)) == NULL)
+		return DOMXMLDoc_parse_error(PARSE_ERR_MEMORY, sd->line_num, &dom_sd);
+	new_node->father = rs->path;
+
+	if (node->tag_type != TAG_FATHER && node->tag_type != TAG_SELF)
+		is_record = false;
+	else if (rs->tag != NULL)
+		is_record = (sx_strcmp(node->tag, rs->tag) == 0);
+	else
+		is_record = (rs->match != NULL && rs->match(new_node, rs->match_data));
+
+	/* Other nodes are only kept (without children) until they end, as fathers of next records */
+	if (!is_record) {
+		rs->path = new_node;
+		return true;
+	}
+
+	/* Record is the root node of the document being built */
+	new_node->father = NULL;
+
+	return _dom_add_node(new_node, &dom_sd);
+}
+
+static int _record_node_end(const XMLNode* node, SAX_Data* sd)
+{
+	RecordStream* rs = (RecordStream*)sd->user;
+	SAX_Data dom_sd = *sd;
+	XMLNode* father;
+	int ret;
+
+	dom_sd.user = &rs->dom;
+
+	/* Outside of records, nodes are ended as they would be in a document */
+	if (rs->dom.current == NULL) {
+		rs->dom.current = rs->path;
+		ret = DOMXMLDoc_node_end(node, &dom_sd);
+		rs->dom.current = NULL;
+		if (ret) {
+			father = rs->path->father;
+			(void)XMLNode_free(rs->path);
+			__free(rs->path);
+			rs->path = father;
+		}
+		return ret;
+	}
+
+	if (!DOMXMLDoc_node_end(node, &dom_sd))
+		return false;
+	if (rs->dom.current != NULL)
+		return true;
+
+	/* Record is complete: give it to the user, then recycle the document for next record */
+	rs->record = rs->doc.nodes[0];
+	rs->record->father = rs->path;
+	ret = (rs->on_record == NULL || rs->on_record(rs->record, sd));
+	if (rs->record != NULL) {
+		rs->record->father = NULL;
+		(void)XMLNode_free(rs->record);
+		__free(rs->record);
+	}
+	rs->record = NULL;
+	rs->doc.n_nodes = 0;
+	rs->doc.i_root = -1;
+
+	return ret;
+}
+
+static int _record_node_text(SXML_CHAR* text, SAX_Data* sd)
+{
+	RecordStream* rs = (RecordStream*)sd->user;
+	SAX_Data dom_sd = *sd;
+
+	/* Text outside of records is ignored */
+	if (rs->dom.current == NULL)
+		return true;
+
+	dom_sd.user = &rs->dom;
+
+	return DOMXMLDoc_node_text(text, &dom_sd);
+}
+
+static int _record_parse_error(ParseError error_num, int line_number, SAX_Data* sd)
+{
+	RecordStream* rs = (RecordStream*)sd->user;
+	SAX_Data dom_sd = *sd;
+
+	dom_sd.user = &rs->dom;
+
+	return DOMXMLDoc_parse_error(error_num, line_number, &dom_sd);
+}
+
+static int _record_doc_end(SAX_Data* sd)
+{
+	RecordStream* rs = (RecordStream*)sd->user;
+	SAX_Data dom_sd = *sd;
+	XMLNode* father;
+
+	dom_sd.user = &rs->dom;
+
+	for (; rs->path != NULL; rs->path = father) {
+		father = rs->path->father;
+		(void)XMLNode_free(rs->path);
+		__free(rs->path);
+	}
+
+	/* Displays the error, if any, and frees an incomplete record */
+	rs->error = rs->dom.error;
+	(void)DOMXMLDoc_doc_end(&dom_sd);
+	(void)XMLDoc_free(&rs->doc);
+	rs->dom.doc = &rs->doc;
+	rs->dom.current = NULL;
+
+	return true;
+}
+
+int SAX_Callbacks_init_records(SAX_Callbacks* sax)
+{
+	if (sax == NULL)
+		return false;
+
+	sax->start_doc = _record_doc_start;
+	sax->start_node = _record_node_start;
+	sax->end_node = _record_node_end;
+	sax->new_text = _record_node_text;
+	sax->on_error = _record_parse_error;
+	sax->end_doc = _record_doc_end;
+	sax->all_event = NULL;
+
+	return true;
+}
+
+/*
+ Return the type of the BOM at the beginning of the 'n' bytes of 's', storing its size in '*sz_bom'
+ (see 'freadBOM').
+ */
+static BOM_TYPE _bom_type(const unsigned char* s, size_t n, int* sz_bom)
+{
+	*sz_bom = 0;
+	if (n >= 3 && s[0] == 0xef && s[1] == 0xbb && s[2] == 0xbf) {
+		*sz_bom = 3;
+		return BOM_UTF_8;
+	}
+	if (n >= 4 && s[0] == 0xff && s[1] == 0xfe && s[2] == 0x00 && s[3] == 0x00) {
+		*sz_bom = 4;
+		return BOM_UTF_32LE;
+	}
+	if (n >= 4 && s[0] == 0x00 && s[1] == 0x00 && s[2] == 0xfe && s[3] == 0xff) {
+		*sz_bom = 4;
+		return BOM_UTF_32BE;
+	}
+	if (n >= 2 && s[0] == 0xff && s[1] == 0xfe) {
+		*sz_bom = 2;
+		return BOM_UTF_16LE;
+	}
+	if (n >= 2 && s[0] == 0xfe && s[1] == 0xff) {
+		*sz_bom = 2;
+		return BOM_UTF_16BE;
+	}
+
+	return BOM_NONE;
+}
+
+/*
+ Open 'filename' for parsing, skipping its BOM (if any) which type is stored in '*enc'.
+ UTF-16 and UTF-32 files are left opened as binary, to be transcoded by the parser input.
+ */
+static FILE* _open_file(const SXML_CHAR* filename, BOM_TYPE* enc)
+{
+	FILE* f;
+
+	f = sx_fopen(filename, C2SX("rb"));
+	if (f == NULL)
+		return NULL;
+	/* Microsoft' 'ftell' returns invalid position for Unicode text files
+	   (see http://connect.microsoft.com/VisualStudio/feedback/details/369265/ftell-ftell-nolock-incorrectly-handling-unicode-text-translation)
+	   However, we're opening the file as binary so we don't fall into that case...
+	*/
+
+	*enc = freadBOM(f, NULL, NULL); /* Skip BOM, if any */
+	/* Re-open the file in text-mode if there is no BOM (or UTF-8) as we assume that the file
+	   is "plain" text (i.e. 1 byte = 1 character). */
+	if (*enc == BOM_NONE || *enc == BOM_UTF_8) {
+		sx_fclose(f);
+		f = sx_fopen(filename, C2SX("rt"));
+		if (f == NULL)
+			return NULL;
+		if (*enc == BOM_UTF_8)
+			freadBOM(f, NULL, NULL); /* Skip the UTF-8 BOM that was found */
+	}
+
+	return f;
+}
+
+int XMLDoc_parse_file_SAX_ctx(const SXML_CHAR* filename, const SAX_Callbacks* sax, void* user, const XMLContext* ctx)
+{
+	FILE* f;
+	int ret;
+	XMLParser parser;
+	BOM_TYPE enc;
+
+	if (sax == NULL || filename == NULL || filename[0] == NULC)
+		return false;
+
+	f = _open_file(filename, &enc);
+	if (f == NULL)
+		return false;
+
+	_parser_init(&parser, sax, filename, user, ctx);
+	_input_init(&parser.inp, (void*)f, DATA_SOURCE_FILE);
+	parser.inp.enc = enc;
+	ret = _parse_data_SAX(&parser);
+	_parser_free(&parser);
+	(void)sx_fclose(f);
+
+	return ret;
+}
+
+int XMLDoc_parse_file_SAX(const SXML_CHAR* filename, const SAX_Callbacks* sax, void* user)
+{
+	return XMLDoc_parse_file_SAX_ctx(filename, sax, user, NULL);
+}
+
+int XMLDoc_parse_buffer_SAX_ctx(const SXML_CHAR* buffer, const SXML_CHAR* name, const SAX_Callbacks* sax, void* user, const XMLContext* ctx)
+{
+	DataSourceBuffer dsb = { buffer, 0 };
+	XMLParser parser;
+	int ret;
+
+	if (sax == NULL || buffer == NULL)
+		return false;
+
+	_parser_init(&parser, sax, name, user, ctx);
+	_input_init(&parser.inp, (void*)&dsb, DATA_SOURCE_BUFFER);
+	ret = _parse_data_SAX(&parser);
+	_parser_free(&parser);
+
+	return ret;
+}
+
+int XMLDoc_parse_buffer_SAX(const SXML_CHAR* buffer, const SXML_CHAR* name, const SAX_Callbacks* sax, void* user)
+{
+	return XMLDoc_parse_buffer_SAX_ctx(buffer, name, sax, user, NULL);
+}
+
+int XMLDoc_parse_buffer_len_SAX_ctx(const SXML_CHAR* buffer, size_t len, const SXML_CHAR* name, const SAX_Callbacks* sax, void* user, const XMLContext* ctx)
+{
+	XMLParser parser;
+	int ret;
+
+	if (sax == NULL || (buffer == NULL && len > 0))
+		return false;
+
+	_parser_init(&parser, sax, name, user, ctx);
+	_input_init_mem(&parser.inp, buffer, len);
+	ret = _parse_data_SAX(&parser);
+	_parser_free(&parser);
+
+	return ret;
+}
+
+int XMLDoc_parse_bytes_SAX_ctx(const void* data, size_t n, const SXML_CHAR* name, const SAX_Callbacks* sax, void* user, const XMLContext* ctx)
+{
+	const unsigned char* s = (const unsigned char*)data;
+	SXML_CHAR* buf;
+	size_t len, n_used;
+	int sz_bom, ret;
+	BOM_TYPE enc;
+
+	if (sax == NULL || (data == NULL && n > 0))
+		return false;
+
+	enc = _bom_type(s, n, &sz_bom);
+	s += sz_bom;
+	n -= sz_bom;
+#ifndef SXMLC_UNICODE
+	/* UTF-8 is parsed in place */
+	if (enc == BOM_NONE || enc == BOM_UTF_8)
+		return XMLDoc_parse_buffer_len_SAX_ctx((const SXML_CHAR*)s, n, name, sax, user, ctx);
+
+	buf = (SXML_CHAR*)_ctx_realloc(ctx, NULL, (n / 2 * 3 + 4) * sizeof(SXML_CHAR));
+#else
+	buf = (SXML_CHAR*)_ctx_realloc(ctx, NULL, (n + 1) * sizeof(SXML_CHAR));
+#endif
+	if (buf == NULL)
+		return false;
+
+	len = XML_transcode(s, n, enc, buf, &n_used);
+	if (n_used < n) /* Last character is truncated */
+		len += _put_codepoint(buf + len, 0xfffd);
+	ret = XMLDoc_parse_buffer_len_SAX_ctx(buf, len, name, sax, user, ctx);
+	_ctx_free(ctx, buf);
+
+	return ret;
+}
+
+int XMLDoc_parse_source_SAX_ctx(const DataSourceUser* source, const SXML_CHAR* name, const SAX_Callbacks* sax, void* user, const XMLContext* ctx)
+{
+	XMLParser parser;
+	int ret;
+
+	if (sax == NULL || source == NULL || source->read == NULL)
+		return false;
+
+	_parser_init(&parser, sax, name, user, ctx);
+	_input_init(&parser.inp, (void*)source, DATA_SOURCE_USER);
+	ret = _parse_data_SAX(&parser);
+	_parser_free(&parser);
+
+	return ret;
+}
+
+#ifdef SXMLC_MMAP
+/*
+ Map file 'filename' in memory, storing its address in '*map' and its size in '*size'.
+ Empty files cannot be mapped: '*map' is then NULL and '*size' is 0.
+ Return the file descriptor to give to '_unmap_file', or -1 on error.
+ */
+static int _map_file(const SXML_CHAR* filename, void** map, size_t* size)
+{
+	int fd;
+	struct stat st;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) < 0 || (off_t)(size_t)st.st_size != st.st_size) {
+		(void)close(fd);
+		return -1;
+	}
+
+	*map = NULL;
+	*size = (size_t)st.st_size;
+	if (*size > 0) {
+		*map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (*map == MAP_FAILED) {
+			(void)close(fd);
+			return -1;
+		}
+		(void)madvise(*map, *size, MADV_SEQUENTIAL);
+	}
+
+	return fd;
+}
+
+static void _unmap_file(int fd, void* map, size_t size)
+{
+	if (map != NULL)
+		(void)munmap(map, size);
+	(void)close(fd);
+}
+#endif
+
+int XMLDoc_parse_file_mmap_SAX_ctx(const SXML_CHAR* filename, const SAX_Callbacks* sax, void* user, const XMLContext* ctx)
+{
+#ifdef SXMLC_MMAP
+	int fd, ret;
+	void* map;
+	size_t size;
+
+	if (sax == NULL || filename == NULL || filename[0] == NULC)
+		return false;
+
+	if ((fd = _map_file(filename, &map, &size)) < 0)
+		return false;
+
+	ret = XMLDoc_parse_bytes_SAX_ctx(map, size, filename, sax, user, ctx);
+	_unmap_file(fd, map, size);
+
+	return ret;
+#else
+	return XMLDoc_parse_file_SAX_ctx(filename, sax, user, ctx);
+#endif
+}
+
+int XMLDoc_parse_file_DOM_ctx(const SXML_CHAR* filename, XMLDoc* doc, int text_as_nodes, const XMLContext* ctx)
+{
+	DOM_through_SAX dom;
+	SAX_Callbacks sax;
+
+	if (doc == NULL || filename == NULL || filename[0] == NULC || doc->init_value != XML_INIT_DONE)
+		return false;
+
+	sx_strncpy(doc->filename, filename, SXMLC_MAX_PATH - 1);
+	doc->filename[SXMLC_MAX_PATH - 1] = NULC;
+
+	/* Read potential BOM on file, only when unicode is defined */
+#ifdef SXMLC_UNICODE
+	{
+		/* In Unicode, open the file as binary so that further 'fgetwc' read all bytes */
+		FILE* f = sx_fopen(filename, C2SX("rb"));
+		if (f != NULL) {
+			#if defined(SXMLC_UNICODE) && (defined(WIN32) || defined(WIN64))
+			//setvbuf(f, NULL, _IONBF, 0);
+			#endif
+			doc->bom_type = freadBOM(f, doc->bom, &doc->sz_bom);
+			sx_fclose(f);
+		}
+	}
+#endif
+
+	dom.doc = doc;
+	dom.current = NULL;
+	dom.error = PARSE_ERR_NONE;
+	dom.text_as_nodes = text_as_nodes;
+	if (!_doc_init_names(doc, ctx))
+		return false;
+	SAX_Callbacks_init_DOM(&sax);
+
+	if (!XMLDoc_parse_file_SAX_ctx(filename, &sax, &dom, ctx) || dom.error != PARSE_ERR_NONE) {
+		(void)XMLDoc_free(doc);
+		dom.doc = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+int XMLDoc_parse_file_DOM_text_as_nodes(const SXML_CHAR* filename, XMLDoc* doc, int text_as_nodes)
+{
+	return XMLDoc_parse_file_DOM_ctx(filename, doc, text_as_nodes, NULL);
+}
+
+int XMLDoc_parse_file_mmap_DOM_ctx(const SXML_CHAR* filename, XMLDoc* doc, int text_as_nodes, const XMLContext* ctx)
+{
+#ifdef SXMLC_MMAP
+	DOM_through_SAX dom;
+	SAX_Callbacks sax;
+
+	if (doc == NULL || filename == NULL || filename[0] == NULC || doc->init_value != XML_INIT_DONE)
+		return false;
+
+	sx_strncpy(doc->filename, filename, SXMLC_MAX_PATH - 1);
+	doc->filename[SXMLC_MAX_PATH - 1] = NULC;
+
+	dom.doc = doc;
+	dom.current = NULL;
+	dom.error = PARSE_ERR_NONE;
+	dom.text_as_nodes = text_as_nodes;
+	if (!_doc_init_names(doc, ctx))
+		return false;
+	SAX_Callbacks_init_DOM(&sax);
+
+	if (!XMLDoc_parse_file_mmap_SAX_ctx(filename, &sax, &dom, ctx) || dom.error != PARSE_ERR_NONE) {
+		(void)XMLDoc_free(doc);
+		dom.doc = NULL;
+		return false;
+	}
+
+	return true;
+#else
+	return XMLDoc_parse_file_DOM_ctx(filename, doc, text_as_nodes, ctx);
+#endif
+}
+
+int XMLDoc_parse_buffer_DOM_ctx(const SXML_CHAR* buffer, const SXML_CHAR* name, XMLDoc* doc, int text_as_nodes, const XMLContext* ctx)
+{
+	DOM_through_SAX dom;
+	SAX_Callbacks sax;
+
+	if (doc == NULL || buffer == NULL || doc->init_value != XML_INIT_DONE)
+		return false;
+
+	dom.doc = doc;
+	dom.current = NULL;
+	dom.error = PARSE_ERR_NONE;
+	dom.text_as_nodes = text_as_nodes;
+	if (!_doc_init_names(doc, ctx))
+		return false;
+	SAX_Callbacks_init_DOM(&sax);
+
+	if (!XMLDoc_parse_buffer_SAX_ctx(buffer, name, &sax, &dom, ctx) || dom.error != PARSE_ERR_NONE) {
+		(void)XMLDoc_free(doc);
+		return false;
+	}
+
+	return true;
+}
+
+int XMLDoc_parse_buffer_DOM_text_as_nodes(const SXML_CHAR* buffer, const SXML_CHAR* name, XMLDoc* doc, int text_as_nodes)
+{
+	return XMLDoc_parse_buffer_DOM_ctx(buffer, name, doc, text_as_nodes, NULL);
+}
+
+int XMLDoc_parse_buffer_len_DOM_ctx(const SXML_CHAR* buffer, size_t len, const SXML_CHAR* name, XMLDoc* doc, int text_as_nodes, const XMLContext* ctx)
+{
+	DOM_through_SAX dom;
+	SAX_Callbacks sax;
+
+	if (doc == NULL || (buffer == NULL && len > 0) || doc->init_value != XML_INIT_DONE)
+		return false;
+
+	dom.doc = doc;
+	dom.current = NULL;
+	dom.error = PARSE_ERR_NONE;
+	dom.text_as_nodes = text_as_nodes;
+	if (!_doc_init_names(doc, ctx))
+		return false;
+	SAX_Callbacks_init_DOM(&sax);
+
+	if (!XMLDoc_parse_buffer_len_SAX_ctx(buffer, len, name, &sax, &dom, ctx) || dom.error != PARSE_ERR_NONE) {
+		(void)XMLDoc_free(doc);
+		return false;
+	}
+
+	return true;
+}
+
+int XMLDoc_parse_bytes_DOM_ctx(const void* data, size_t n, const SXML_CHAR* name, XMLDoc* doc, int text_as_nodes, const XMLContext* ctx)
+{
+	DOM_through_SAX dom;
+	SAX_Callbacks sax;
+
+	if (doc == NULL || (data == NULL && n > 0) || doc->init_value != XML_INIT_DONE)
+		return false;
+
+	dom.doc = doc;
+	dom.current = NULL;
+	dom.error = PARSE_ERR_NONE;
+	dom.text_as_nodes = text_as_nodes;
+	if (!_doc_init_names(doc, ctx))
+		return false;
+	SAX_Callbacks_init_DOM(&sax);
+
+	if (!XMLDoc_parse_bytes_SAX_ctx(data, n, name, &sax, &dom, ctx) || dom.error != PARSE_ERR_NONE) {
+		(void)XMLDoc_free(doc);
+		return false;
+	}
+
+	return true;
+}
+
+int XMLDoc_parse_source_DOM_ctx(const DataSourceUser* source, const SXML_CHAR* name, XMLDoc* doc, int text_as_nodes, const XMLContext* ctx)
+{
+	DOM_through_SAX dom;
+	SAX_Callbacks sax;
+
+	if (doc == NULL || source == NULL || doc->init_value != XML_INIT_DONE)
+		return false;
+
+	dom.doc = doc;
+	dom.current = NULL;
+	dom.error = PARSE_ERR_NONE;
+	dom.text_as_nodes = text_as_nodes;
+	if (!_doc_init_names(doc, ctx))
+		return false;
+	SAX_Callbacks_init_DOM(&sax);
+
+	if (!XMLDoc_parse_source_SAX_ctx(source, name, &sax, &dom, ctx) || dom.error != PARSE_ERR_NONE) {
+		(void)XMLDoc_free(doc);
+		return false;
+	}
+
+	return true;
+}
+
+/* --- Parallel parsing --- */
+
+#ifdef SXMLC_THREADS
+/* Event read in a chunk, replayed on the document once previous chunks are known to be valid */
+typedef struct _ChunkEvent {
+	XMLEvent event;		/* 'XML_EVENT_START_NODE', 'XML_EVENT_END_NODE' or 'XML_EVENT_TEXT' */
+	XMLNode* node;		/* Node started or ended */
+	SXML_CHAR* text;	/* Text read */
+	int line_num;		/* Line number, relative to the chunk start */
+} _ChunkEvent;
+
+/* Part of a document parsed by a thread */
+typedef struct _ParseChunk {
+	const SXML_CHAR* data;	/* Whole document */
+	size_t size;			/* Size of the whole document */
+	size_t start;			/* Where parsing starts (on a '<', maybe not a real tag start) */
+	size_t limit;			/* Parsing stops on the first token starting at or after 'limit' (start of the next chunk) */
+	size_t end;				/* Where parsing stopped ('limit' unless the last token read ends after it) */
+	_ChunkEvent* events;
+	int n_events;
+	int sz_events;
+	int n_lines;			/* Line number (starting at 1) where parsing stopped */
+	ParseError error;		/* Error that stopped parsing */
+	const XMLContext* ctx;	/* Context used by the thread (depth is only checked when replaying) */
+} _ParseChunk;
+
+static void _chunk_free(_ParseChunk* chunk)
+{
+	int i;
+
+	for (i = 0; i < chunk->n_events; i++) {
+		if (chunk->events[i].node != NULL) {
+			(void)XMLNode_free(chunk->events[i].node);
+			__free(chunk->events[i].node);
+		}
+		if (chunk->events[i].text != NULL)
+			__free(chunk->events[i].text);
+	}
+	if (chunk->events != NULL)
+		_ctx_free(chunk->ctx, chunk->events);
+	chunk->events = NULL;
+	chunk->n_events = 0;
+	chunk->sz_events = 0;
+}
+
+/*
+ Tokenize 'chunk', from 'chunk->start' up to the first token starting at or after 'chunk->limit'.
+ Tags are parsed into nodes and texts are copied, so that they can be added to the document
+ without any more work.
+ */
+static void _chunk_parse(_ParseChunk* chunk)
+{
+	XMLParser parser;
+	_ChunkEvent* ev;
+	XMLNode* node;
+	SXML_CHAR* text;
+	ParseToken token;
+
+	_parser_init(&parser, NULL, NULL, NULL, chunk->ctx);
+	parser.own_strings = true; /* Nodes are moved to the chunk */
+	_input_init_mem(&parser.inp, chunk->data + chunk->start, chunk->size - chunk->start);
+	while (!parser.done && chunk->start + parser.inp.pos < chunk->limit) {
+		node = NULL;
+		text = NULL;
+		token = _parser_next(&parser);
+		if (token == TOKEN_TEXT) {
+			text = (SXML_CHAR*)__malloc((parser.len_tok + 1) * sizeof(SXML_CHAR));
+			if (text == NULL) {
+				_parser_error(&parser, PARSE_ERR_MEMORY, NULL);
+				break;
+			}
+			memcpy(text, parser.tok, parser.len_tok * sizeof(SXML_CHAR));
+			text[parser.len_tok] = NULC;
+		} else if (token == TOKEN_TAG) {
+			if (parser.tag_type == TAG_ERROR) {
+				_parser_error(&parser, PARSE_ERR_MEMORY, NULL);
+				break;
+			}
+			if (parser.tag_type == TAG_NONE) {
+				_parser_error(&parser, PARSE_ERR_SYNTAX, NULL);
+				break;
+			}
+			/* Move the node read by the parser to the chunk */
+			node = (XMLNode*)__malloc(sizeof(XMLNode));
+			if (node == NULL) {
+				_parser_error(&parser, PARSE_ERR_MEMORY, NULL);
+				break;
+			}
+			*node = parser.node;
+			parser.node.init_value = 0;
+			(void)XMLNode_init(&parser.node);
+		} else
+			break;
+
+		if (chunk->n_events >= chunk->sz_events) {
+			ev = (_ChunkEvent*)_ctx_realloc(chunk->ctx, chunk->events, (chunk->sz_events == 0 ? 256 : 2 * chunk->sz_events) * sizeof(_ChunkEvent));
+			if (ev == NULL) {
+				if (node != NULL) {
+					(void)XMLNode_free(node);
+					__free(node);
+				}
+				if (text != NULL)
+					__free(text);
+				_parser_error(&parser, PARSE_ERR_MEMORY, NULL);
+				break;
+			}
+			chunk->events = ev;
+			chunk->sz_events = (chunk->sz_events == 0 ? 256 : 2 * chunk->sz_events);
+		}
+		ev = &chunk->events[chunk->n_events++];
+		ev->event = (text != NULL ? XML_EVENT_TEXT : parser.tag_type == TAG_END ? XML_EVENT_END_NODE : XML_EVENT_START_NODE);
+		ev->node = node;
+		ev->text = text;
+		ev->line_num = parser.sd.line_num;
+	}
+	chunk->end = chunk->start + parser.inp.pos;
+	chunk->n_lines = parser.sd.line_num;
+	chunk->error = parser.error;
+	_parser_free(&parser);
+}
+
+static void* _chunk_thread(void* chunk)
+{
+	_chunk_parse((_ParseChunk*)chunk);
+
+	return NULL;
+}
+
+/*
+ Replace the names of element 'node' by their interned copies in 'names'.
+ Return 'false' on memory error ('node' being left unchanged).
+ */
+static int _node_intern_names(XMLNode* node, _InternTable* names)
+{
+	SXML_CHAR* tag = NULL;
+	SXML_CHAR** strs;
+	int i;
+
+	if (node->interned || (node->tag_type != TAG_FATHER && node->tag_type != TAG_SELF))
+		return true;
+
+	/* Interned strings belong to 'names', so nothing has to be released on error */
+	strs = (SXML_CHAR**)__calloc(node->n_attributes + 1, sizeof(SXML_CHAR*));
+	if (strs == NULL)
+		return false;
+	if (node->tag != NULL && (tag = _name_dup(names, node->tag)) == NULL)
+		goto intern_err;
+	for (i = 0; i < node->n_attributes; i++) {
+		if (node->attributes[i].name != NULL && (strs[i] = _name_dup(names, node->attributes[i].name)) == NULL)
+			goto intern_err;
+	}
+
+	if (node->tag != NULL) {
+		if (node->local_name != NULL)
+			node->local_name = tag + (node->local_name - node->tag);
+		__free(node->tag);
+		node->tag = tag;
+	}
+	for (i = 0; i < node->n_attributes; i++) {
+		if (node->attributes[i].name == NULL)
+			continue;
+		if (node->attributes[i].local_name != NULL)
+			node->attributes[i].local_name = strs[i] + (node->attributes[i].local_name - node->attributes[i].name);
+		__free(node->attributes[i].name);
+		node->attributes[i].name = strs[i];
+	}
+	node->interned = true;
+	__free(strs);
+
+	return true;
+
+intern_err:
+	__free(strs);
+
+	return false;
+}
+
+/*
+ Add events of 'chunk' to the document built by 'sd->user' (a 'DOM_through_SAX'), as the
+ DOM callbacks would. Nodes and texts are moved to the document.
+ 'line0' is the line number where 'chunk' starts, '*depth' the number of opened nodes
+ (checked against 'max_depth' of 'ctx').
+ As in 'XMLDoc_parse_buffer_SAX', a DOM callback refusing an event only stops the parsing,
+ while a parse error fails it.
+ Return 1 to go on, 0 when a DOM callback stopped the parsing, -1 if a parse error was found.
+ */
+static int _chunk_replay(_ParseChunk* chunk, SAX_Data* sd, int line0, int* depth, const XMLContext* ctx)
+{
+	DOM_through_SAX* dom = (DOM_through_SAX*)sd->user;
+	_ChunkEvent* ev;
+	XMLNode* node;
+	int i;
+
+	for (i = 0; i < chunk->n_events; i++) {
+		ev = &chunk->events[i];
+		sd->line_num = line0 + ev->line_num - 1;
+		switch (ev->event) {
+			case XML_EVENT_START_NODE:
+				if (ev->node->tag_type == TAG_FATHER || ev->node->tag_type == TAG_SELF) {
+					if (ctx != NULL && ctx->max_depth > 0 && *depth >= ctx->max_depth) {
+						(void)DOMXMLDoc_parse_error(PARSE_ERR_LIMIT, sd->line_num, sd);
+						return -1;
+					}
+					if (ev->node->tag_type == TAG_FATHER)
+						(*depth)++;
+				}
+				node = ev->node;
+				ev->node = NULL;
+				if (dom->doc->names != NULL && !_node_intern_names(node, dom->doc->names)) {
+					(void)XMLNode_free(node);
+					__free(node);
+					(void)DOMXMLDoc_parse_error(PARSE_ERR_MEMORY, sd->line_num, sd);
+					return -1;
+				}
+				if (!_dom_add_node(node, sd))
+					return 0;
+				if (node->tag_type != TAG_FATHER && !DOMXMLDoc_node_end(node, sd))
+					return 0;
+				break;
+
+			case XML_EVENT_END_NODE:
+				if (*depth > 0)
+					(*depth)--;
+				if (!DOMXMLDoc_node_end(ev->node, sd))
+					return 0;
+				break;
+
+			default:
+				/* Give the text to the current node when it has none, otherwise let the DOM callback handle it */
+				if (!dom->text_as_nodes && dom->current != NULL && dom->current->text == NULL) {
+					dom->current->text = ev->text;
+					ev->text = NULL;
+				} else if (!DOMXMLDoc_node_text(ev->text, sd))
+					return 0;
+				break;
+		}
+	}
+
+	if (chunk->error != PARSE_ERR_NONE) {
+		sd->line_num = line0 + chunk->n_lines - 1;
+		(void)DOMXMLDoc_parse_error(chunk->error, sd->line_num, sd);
+		return -1;
+	}
+
+	return 1;
+}
+
+/*
+ Parse 'size' characters 'data' into the document of 'sd->user' (a 'DOM_through_SAX'),
+ by 'n_chunks' threads.
+ Each chunk but the first one starts on the first '<' after its share of 'data', assuming
+ it is a tag start, and the previous chunk stops there (texts between tags, e.g. indentation,
+ end on that '<'). Chunks are then checked in order: when a chunk does not start exactly
+ where the previous one stopped (i.e. its '<' was inside a comment, a CDATA or an attribute
+ value), it is parsed again from there.
+ Return 'false' if a parse error was found.
+ */
+static int _parse_chunks(const SXML_CHAR* data, size_t size, int n_chunks, SAX_Data* sd, const XMLContext* ctx)
+{
+	_ParseChunk* chunks;
+	pthread_t* threads;
+	char* started;
+	const SXML_CHAR* p;
+	XMLContext chunk_ctx;
+	int i, line0, depth, ret;
+
+	chunks = (_ParseChunk*)__calloc(n_chunks, sizeof(_ParseChunk));
+	threads = (pthread_t*)__calloc(n_chunks, sizeof(pthread_t));
+	started = (char*)__calloc(n_chunks, sizeof(char));
+	if (chunks == NULL || threads == NULL || started == NULL) {
+		if (chunks != NULL) __free(chunks);
+		if (threads != NULL) __free(threads);
+		if (started != NULL) __free(started);
+		return DOMXMLDoc_parse_error(PARSE_ERR_MEMORY, 0, sd);
+	}
+
+	/* Threads cannot know the depth where their chunk starts */
+	if (ctx != NULL) {
+		chunk_ctx = *ctx;
+		chunk_ctx.max_depth = 0;
+	}
+
+	for (i = 0; i < n_chunks; i++) {
+		chunks[i].ctx = (ctx != NULL ? &chunk_ctx : NULL);
+		chunks[i].data = data;
+		chunks[i].size = size;
+		chunks[i].start = (i == 0 ? 0 : chunks[i - 1].limit);
+		if (i == n_chunks - 1)
+			chunks[i].limit = size;
+		else {
+			chunks[i].limit = (size / n_chunks) * (i + 1);
+			if (chunks[i].limit < chunks[i].start)
+				chunks[i].limit = chunks[i].start;
+			p = (const SXML_CHAR*)sx_memchr(data + chunks[i].limit, C2SX('<'), size - chunks[i].limit);
+			chunks[i].limit = (p == NULL ? size : (size_t)(p - data));
+		}
+	}
+
+	/* First chunk is parsed by the calling thread */
+	for (i = 1; i < n_chunks; i++)
+		started[i] = (pthread_create(&threads[i], NULL, _chunk_thread, &chunks[i]) == 0);
+	_chunk_parse(&chunks[0]);
+	for (i = 1; i < n_chunks; i++) {
+		if (started[i])
+			(void)pthread_join(threads[i], NULL);
+		else
+			_chunk_parse(&chunks[i]);
+	}
+
+	/* Stitch chunks together, in order */
+	ret = 1;
+	line0 = 1;
+	depth = 0;
+	for (i = 0; i < n_chunks && ret > 0; i++) {
+		if (i > 0) {
+			if (chunks[i].start != chunks[i - 1].end) { /* Wrong guess on where chunk starts */
+				_chunk_free(&chunks[i]);
+				chunks[i].start = chunks[i - 1].end;
+				_chunk_parse(&chunks[i]);
+			}
+			line0 += chunks[i - 1].n_lines - 1;
+		}
+		ret = _chunk_replay(&chunks[i], sd, line0, &depth, ctx);
+	}
+
+	for (i = 0; i < n_chunks; i++)
+		_chunk_free(&chunks[i]);
+	__free(chunks);
+	__free(threads);
+	__free(started);
+
+	return ret >= 0;
+}
+#endif
+
+int XMLDoc_parse_file_parallel_DOM_ctx(const SXML_CHAR* filename, XMLDoc* doc, int text_as_nodes, int n_threads, const XMLContext* ctx)
+{
+#ifdef SXMLC_THREADS
+	DOM_through_SAX dom;
+	SAX_Callbacks sax;
+	SAX_Data sd;
+	void* map;
+	const SXML_CHAR* data;
+	size_t size, len;
+	int fd, ret, sz_bom;
+	BOM_TYPE enc;
+
+	if (doc == NULL || filename == NULL || filename[0] == NULC || doc->init_value != XML_INIT_DONE)
+		return false;
+
+	if (n_threads <= 0)
+		n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	/* Namespaces in scope at the start of a chunk depend on all the nodes before it */
+	if (ctx != NULL && ctx->namespaces)
+		n_threads = 1;
+	if (!_doc_init_names(doc, ctx))
+		return false;
+
+	if ((fd = _map_file(filename, &map, &size)) < 0)
+		return false;
+
+	/* UTF-16 and UTF-32 files are transcoded as a whole before being parsed, UTF-8 BOM is skipped */
+	enc = _bom_type((const unsigned char*)map, size, &sz_bom);
+	if (enc != BOM_NONE && enc != BOM_UTF_8) {
+		_unmap_file(fd, map, size);
+		return XMLDoc_parse_file_mmap_DOM_ctx(filename, doc, text_as_nodes, ctx);
+	}
+	data = (const SXML_CHAR*)map + sz_bom;
+	len = size - sz_bom;
+
+	/* Small chunks are not worth a thread */
+	if ((size_t)n_threads > len / SXMLC_PARALLEL_MIN_CHUNK)
+		n_threads = (int)(len / SXMLC_PARALLEL_MIN_CHUNK);
+
+	sx_strncpy(doc->filename, filename, SXMLC_MAX_PATH - 1);
+	doc->filename[SXMLC_MAX_PATH - 1] = NULC;
+
+	dom.doc = doc;
+	dom.current = NULL;
+	dom.error = PARSE_ERR_NONE;
+	dom.text_as_nodes = text_as_nodes;
+	if (n_threads <= 1) {
+		SAX_Callbacks_init_DOM(&sax);
+		ret = XMLDoc_parse_buffer_len_SAX_ctx(data, len, filename, &sax, &dom, ctx);
+	} else {
+		sd.name = filename;
+		sd.user = &dom;
+		sd.line_num = 1;
+		sd.start_pos = sd.end_pos = 0;
+		sd.column = 1;
+		(void)DOMXMLDoc_doc_start(&sd);
+		ret = _parse_chunks(data, len, n_threads, &sd, ctx);
+		(void)DOMXMLDoc_doc_end(&sd);
+	}
+	_unmap_file(fd, map, size);
+
+	if (!ret || dom.error != PARSE_ERR_NONE) {
+		(void)XMLDoc_free(doc);
+		dom.doc = NULL;
+		return false;
+	}
+
+	return true;
+#else
+	(void)n_threads;
+	return XMLDoc_parse_file_mmap_DOM_ctx(filename, doc, text_as_nodes, ctx);
+#endif
+}
+
+/* --- Multi-file parsing --- */
+
+/* Files parsed by 'XMLDoc_parse_files_parallel_*' */
+typedef struct _FilesJob {
+	const SXML_CHAR* const* paths;
+	XMLDoc* docs;				/* Documents to load (DOM), or NULL */
+	int text_as_nodes;
+	const SAX_Callbacks* sax;	/* Callbacks (SAX) when 'docs' is NULL */
+	void** users;				/* User data of each worker (SAX), or NULL */
+	int* status;				/* Status of each file, or NULL */
+	const XMLContext* ctx;
+#ifdef SXMLC_THREADS
+	struct _FileQueue* queues;	/* Files of each worker */
+	int n_workers;
+#endif
+} _FilesJob;
+
+/*
+ Parse file 'i_file' of 'job', by worker 'i_worker'.
+ Return 'false' if it could not be parsed.
+ */
+static int _files_parse1(const _FilesJob* job, int i_file, int i_worker)
+{
+	int ret;
+
+	if (job->docs != NULL)
+		ret = XMLDoc_parse_file_DOM_ctx(job->paths[i_file], &job->docs[i_file], job->text_as_nodes, job->ctx);
+	else
+		ret = XMLDoc_parse_file_SAX_ctx(job->paths[i_file], job->sax, job->users == NULL ? NULL : job->users[i_worker], job->ctx);
+	if (job->status != NULL)
+		job->status[i_file] = ret;
+
+	return ret;
+}
+
+#ifdef SXMLC_THREADS
+/*
+ Files to be parsed by a worker, biggest first. The worker takes files from 'head' while other
+ workers, once they are done with their own queue, steal files from 'tail'.
+ */
+typedef struct _FileQueue {
+	pthread_mutex_t lock;
+	int* files;
+	int head;
+	int tail;
+} _FileQueue;
+
+typedef struct _FileSize {
+	size_t size;
+	int i_file;
+} _FileSize;
+
+typedef struct _FilesWorker {
+	_FilesJob* job;
+	int i_worker;
+	int n_ok;		/* Number of files parsed successfully */
+} _FilesWorker;
+
+static int _file_size_cmp(const void* a, const void* b)
+{
+	size_t sa = ((const _FileSize*)a)->size, sb = ((const _FileSize*)b)->size;
+
+	return (sa > sb ? -1 : sa < sb ? 1 : 0);
+}
+
+/*
+ Next file to be parsed by worker 'i_worker': the biggest of its own queue or, when it is
+ empty, the smallest of the first other queue that is not.
+ Return '-1' when all files are taken.
+ */
+static int _files_next(_FilesJob* job, int i_worker)
+{
+	_FileQueue* queue;
+	int i, i_file = -1;
+
+	for (i = 0; i < job->n_workers && i_file < 0; i++) {
+		queue = &job->queues[(i_worker + i) % job->n_workers];
+		(void)pthread_mutex_lock(&queue->lock);
+		if (queue->head < queue->tail)
+			i_file = (i == 0 ? queue->files[queue->head++] : queue->files[--queue->tail]);
+		(void)pthread_mutex_unlock(&queue->lock);
+	}
+
+	return i_file;
+}
+
+static void* _files_thread(void* arg)
+{
+	_FilesWorker* worker = (_FilesWorker*)arg;
+	int i_file;
+
+	while ((i_file = _files_next(worker->job, worker->i_worker)) >= 0) {
+		if (_files_parse1(worker->job, i_file, worker->i_worker))
+			worker->n_ok++;
+	}
+
+	return NULL;
+}
+
+/*
+ Parse the 'n' files of 'job' with 'n_workers' workers (the calling thread being one of them).
+ Files are sorted by decreasing size and dealt in turn to the workers.
+ Return the number of files parsed successfully, or '-1' on memory error (nothing was parsed).
+ */
+static int _files_pool(_FilesJob* job, int n, int n_workers)
+{
+	_FileSize* sizes;
+	_FileQueue* queues;
+	_FilesWorker* workers;
+	pthread_t* threads;
+	char* started;
+	int* files;
+	struct stat st;
+	int i, w, n_ok;
+
+	sizes = (_FileSize*)__calloc(n, sizeof(_FileSize));
+	files = (int*)__calloc(n, sizeof(int));
+	queues = (_FileQueue*)__calloc(n_workers, sizeof(_FileQueue));
+	workers = (_FilesWorker*)__calloc(n_workers, sizeof(_FilesWorker));
+	threads = (pthread_t*)__calloc(n_workers, sizeof(pthread_t));
+	started = (char*)__calloc(n_workers, sizeof(char));
+	if (sizes == NULL || files == NULL || queues == NULL || workers == NULL || threads == NULL || started == NULL) {
+		if (sizes != NULL) __free(sizes);
+		if (files != NULL) __free(files);
+		if (queues != NULL) __free(queues);
+		if (workers != NULL) __free(workers);
+		if (threads != NULL) __free(threads);
+		if (started != NULL) __free(started);
+		return -1;
+	}
+
+	/* Biggest files first, so that the last files parsed are small ones. Files that cannot be
+	 stat'ed are given a null size (they will fail to parse anyway) */
+	for (i = 0; i < n; i++) {
+		sizes[i].size = (job->paths[i] != NULL && stat(job->paths[i], &st) == 0 ? (size_t)st.st_size : 0);
+		sizes[i].i_file = i;
+	}
+	qsort(sizes, n, sizeof(_FileSize), _file_size_cmp);
+
+	/* File 'i' in size order goes to worker 'i % n_workers', which queues are stored one after the other in 'files' */
+	for (w = 0, i = 0; w < n_workers; w++) {
+		queues[w].files = files + i;
+		queues[w].head = 0;
+		queues[w].tail = n / n_workers + (w < n % n_workers ? 1 : 0);
+		i += queues[w].tail;
+		(void)pthread_mutex_init(&queues[w].lock, NULL);
+		workers[w].job = job;
+		workers[w].i_worker = w;
+	}
+	for (i = 0; i < n; i++)
+		queues[i % n_workers].files[i / n_workers] = sizes[i].i_file;
+	job->queues = queues;
+	job->n_workers = n_workers;
+
+	/* Worker 0 is the calling thread. Files of a worker that could not be started are stolen by others */
+	for (w = 1; w < n_workers; w++)
+		started[w] = (pthread_create(&threads[w], NULL, _files_thread, &workers[w]) == 0);
+	(void)_files_thread(&workers[0]);
+	n_ok = workers[0].n_ok;
+	for (w = 1; w < n_workers; w++) {
+		if (started[w]) {
+			(void)pthread_join(threads[w], NULL);
+			n_ok += workers[w].n_ok;
+		}
+	}
+
+	for (w = 0; w < n_workers; w++)
+		(void)pthread_mutex_destroy(&queues[w].lock);
+	job->queues = NULL;
+	__free(sizes);
+	__free(files);
+	__free(queues);
+	__free(workers);
+	__free(threads);
+	__free(started);
+
+	return n_ok;
+}
+#endif
+
+/*
+ Parse the 'n' files of 'job' with 'n_threads' threads.
+ Return the number of files parsed successfully.
+ */
+static int _parse_files(_FilesJob* job, int n, int n_threads)
+{
+	int i, n_ok;
+
+#ifdef SXMLC_THREADS
+	if (n_threads > n)
+		n_threads = n;
+	if (n_threads > 1 && (n_ok = _files_pool(job, n, n_threads)) >= 0)
+		return n_ok;
+#else
+	(void)n_threads;
+#endif
+
+	/* Sequential parsing */
+	for (i = 0, n_ok = 0; i < n; i++) {
+		if (_files_parse1(job, i, 0))
+			n_ok++;
+	}
+
+	return n_ok;
+}
+
+int XMLDoc_parse_files_parallel_DOM_ctx(const SXML_CHAR* const* paths, int n, XMLDoc* docs, int text_as_nodes, int* status, int n_threads, const XMLContext* ctx)
+{
+	_FilesJob job;
+
+	if (paths == NULL || docs == NULL || n <= 0)
+		return 0;
+
+#ifdef SXMLC_THREADS
+	if (n_threads <= 0)
+		n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+	job.paths = paths;
+	job.docs = docs;
+	job.text_as_nodes = text_as_nodes;
+	job.sax = NULL;
+	job.users = NULL;
+	job.status = status;
+	job.ctx = ctx;
+
+	return _parse_files(&job, n, n_threads);
+}
+
+int XMLDoc_parse_files_parallel_SAX_ctx(const SXML_CHAR* const* paths, int n, const SAX_Callbacks* sax, void** users, int* status, int n_threads, const XMLContext* ctx)
+{
+	_FilesJob job;
+
+	if (paths == NULL || n <= 0 || n_threads <= 0)
+		return 0;
+
+	job.paths = paths;
+	job.docs = NULL;
+	job.text_as_nodes = false;
+	job.sax = sax;
+	job.users = users;
+	job.status = status;
+	job.ctx = ctx;
+
+	return _parse_files(&job, n, n_threads);
+}
+
+/* --- Pull parsing --- */
+
+struct _XMLReader {
+	XMLParser parser;
+	FILE* f;			/* File opened by 'XMLReader_open_file', or NULL */
+	DataSourceBuffer dsb;
+	XMLEvent event;		/* Last event returned by 'XMLReader_next' */
+	int end_pending;	/* 'true' when last node has no children, so that 'XML_EVENT_END_NODE' comes next */
+};
+
+static XMLReader* _reader_create(const SXML_CHAR* name, const XMLContext* ctx)
+{
+	XMLReader* reader = (XMLReader*)__malloc(sizeof(XMLReader));
+
+	if (reader == NULL)
+		return NULL;
+
+	_parser_init(&reader->parser, NULL, name, NULL, ctx);
+	reader->f = NULL;
+	reader->event = XML_EVENT_START_DOC;
+	reader->end_pending = false;
+
+	return reader;
+}
+
+XMLReader* XMLReader_open_file_ctx(const SXML_CHAR* filename, const XMLContext* ctx)
+{
+	XMLReader* reader;
+	BOM_TYPE enc;
+
+	if (filename == NULL || filename[0] == NULC)
+		return NULL;
+
+	reader = _reader_create(filename, ctx);
+	if (reader == NULL)
+		return NULL;
+
+	reader->f = _open_file(filename, &enc);
+	if (reader->f == NULL) {
+		__free(reader);
+		return NULL;
+	}
+	_input_init(&reader->parser.inp, (void*)reader->f, DATA_SOURCE_FILE);
+	reader->parser.inp.enc = enc;
+
+	return reader;
+}
+
+XMLReader* XMLReader_open_buffer_ctx(const SXML_CHAR* buffer, const SXML_CHAR* name, const XMLContext* ctx)
+{
+	XMLReader* reader;
+
+	if (buffer == NULL)
+		return NULL;
+
+	reader = _reader_create(name, ctx);
+	if (reader == NULL)
+		return NULL;
+
+	reader->dsb.buf = buffer;
+	reader->dsb.cur_pos = 0;
+	_input_init(&reader->parser.inp, (void*)&reader->dsb, DATA_SOURCE_BUFFER);
+
+	return reader;
+}
+
+XMLReader* XMLReader_open_buffer_len_ctx(const SXML_CHAR* buffer, size_t len, const SXML_CHAR* name, const XMLContext* ctx)
+{
+	XMLReader* reader;
+
+	if (buffer == NULL && len > 0)
+		return NULL;
+
+	reader = _reader_create(name, ctx);
+	if (reader == NULL)
+		return NULL;
+
+	_input_init_mem(&reader->parser.inp, buffer, len);
+
+	return reader;
+}
+
+XMLReader* XMLReader_open_source_ctx(const DataSourceUser* source, const SXML_CHAR* name, const XMLContext* ctx)
+{
+	XMLReader* reader;
+
+	if (source == NULL || source->read == NULL)
+		return NULL;
+
+	reader = _reader_create(name, ctx);
+	if (reader == NULL)
+		return NULL;
 
-	return true;
+	_input_init(&reader->parser.inp, (void*)source, DATA_SOURCE_USER);
+
+	return reader;
 }
 
-int DOMXMLDoc_parse_error(ParseError error_num, int line_number, SAX_Data* sd)
+XMLEvent XMLReader_next(XMLReader* reader)
 {
-	DOM_through_SAX* dom = (DOM_through_SAX*)sd->user;
+	XMLParser* parser;
 
-	dom->error = error_num;
-	dom->line_error = line_number;
+	if (reader == NULL)
+		return XML_EVENT_ERROR;
 
-	/* Complete error message will be displayed in 'DOMXMLDoc_doc_end' callback */
+	if (reader->end_pending) {
+		reader->end_pending = false;
+		return reader->event = XML_EVENT_END_NODE;
+	}
 
-	return false; /* Stop on error */
-}
+	parser = &reader->parser;
+	while (!parser->done) {
+		switch (_parser_next(parser)) {
+			case TOKEN_TEXT:
+				return reader->event = XML_EVENT_TEXT;
 
-int DOMXMLDoc_doc_end(SAX_Data* sd)
-{
-	DOM_through_SAX* dom = (DOM_through_SAX*)sd->user;
+			case TOKEN_TAG:
+				switch (parser->tag_type) {
+					case TAG_ERROR:
+						_parser_error(parser, PARSE_ERR_MEMORY, NULL);
+						break;
 
-	if (dom->error != PARSE_ERR_NONE) {
-		SXML_CHAR* msg;
+					case TAG_NONE:
+						_parser_error(parser, PARSE_ERR_SYNTAX, NULL);
+						break;
 
-		switch (dom->error) {
-			case PARSE_ERR_MEMORY:				msg = C2SX("MEMORY"); break;
-			case PARSE_ERR_UNEXPECTED_TAG_END:	msg = C2SX("UNEXPECTED_TAG_END"); break;
-			case PARSE_ERR_SYNTAX:				msg = C2SX("SYNTAX"); break;
-			case PARSE_ERR_EOF:					msg = C2SX("UNEXPECTED_END_OF_FILE"); break;
-			case PARSE_ERR_TEXT_OUTSIDE_NODE:	msg = C2SX("TEXT_OUTSIDE_NODE"); break;
-			case PARSE_ERR_UNEXPECTED_NODE_END:	msg = C2SX("UNEXPECTED_NODE_END"); break;
-			default:							msg = C2SX("UNKNOWN"); break;
+					case TAG_END:
+						return reader->event = XML_EVENT_END_NODE;
+
+					default:
+						if (parser->node.tag_type != TAG_FATHER)
+							reader->end_pending = true;
+						return reader->event = XML_EVENT_START_NODE;
+				}
+				break;
+
+			default: /* TOKEN_END ('TOKEN_MORE' cannot happen as all data is available) */
+				parser->done = true;
+				break;
 		}
-		sx_fprintf(stderr, C2SX("%s:%d: An error was found (%s), loading aborted...\n"), sd->name, dom->line_error, msg);
-		dom->current = NULL;
-		(void)XMLDoc_free(dom->doc);
-		dom->doc = NULL;
 	}
 
-	return true;
+	return reader->event = (parser->ret ? XML_EVENT_END_DOC : XML_EVENT_ERROR);
 }
 
-int SAX_Callbacks_init_DOM(SAX_Callbacks* sax)
+int XMLReader_skip(XMLReader* reader)
 {
-	if (sax == NULL)
+	int depth;
+	XMLEvent event;
+
+	if (reader == NULL)
 		return false;
 
-	sax->start_doc = DOMXMLDoc_doc_start;
-	sax->start_node = DOMXMLDoc_node_start;
-	sax->end_node = DOMXMLDoc_node_end;
-	sax->new_text = DOMXMLDoc_node_text;
-	sax->on_error = DOMXMLDoc_parse_error;
-	sax->end_doc = DOMXMLDoc_doc_end;
-	sax->all_event = NULL;
+	if (reader->event != XML_EVENT_START_NODE || reader->end_pending) {
+		reader->end_pending = false;
+		return true;
+	}
+
+	depth = reader->parser.depth - 1;
+	reader->parser.skip_depth = reader->parser.depth;
+	do {
+		event = XMLReader_next(reader);
+		if (event == XML_EVENT_ERROR || event == XML_EVENT_END_DOC)
+			return false;
+	} while (event != XML_EVENT_END_NODE || reader->parser.depth > depth);
 
 	return true;
 }
 
-int XMLDoc_parse_file_SAX(const SXML_CHAR* filename, const SAX_Callbacks* sax, void* user)
+const XMLNode* XMLReader_node(const XMLReader* reader)
 {
-	FILE* f;
-	int ret;
-	SAX_Data sd;
-	SXML_CHAR* fmode = 
-#ifndef SXMLC_UNICODE
-	C2SX("rt");
-#else
-	C2SX("rb"); /* In Unicode, open the file as binary so that further 'fgetwc' read all bytes */
-	BOM_TYPE bom;
-#endif
-
-
-	if (sax == NULL || filename == NULL || filename[0] == NULC)
-		return false;
-
-	f = sx_fopen(filename, fmode);
-	if (f == NULL)
-		return false;
-	/* Microsoft' 'ftell' returns invalid position for Unicode text files
-	   (see http://connect.microsoft.com/VisualStudio/feedback/details/369265/ftell-ftell-nolock-incorrectly-handling-unicode-text-translation)
-	   However, we're opening the file as binary in Unicode so we don't fall into that case...
-	*/
-	#if defined(SXMLC_UNICODE) && (defined(WIN32) || defined(WIN64))
-	//setvbuf(f, NULL, _IONBF, 0);
-	#endif
-
-	sd.name = (SXML_CHAR*)filename;
-	sd.user = user;
-#ifdef SXMLC_UNICODE
-	bom = freadBOM(f, NULL, NULL); /* Skip BOM, if any */
-	/* In Unicode, re-open the file in text-mode if there is no BOM (or UTF-8) as we assume that
-	   the file is "plain" text (i.e. 1 byte = 1 character). If opened in binary mode, 'fgetwc'
-	   would read 2 bytes for 1 character, which would not work on "plain" files. */
-	if (bom == BOM_NONE || bom == BOM_UTF_8) {
-		sx_fclose(f);
-		f = sx_fopen(filename, C2SX("rt"));
-		if (f == NULL)
-			return false;
-		if (bom == BOM_UTF_8)
-			freadBOM(f, NULL, NULL); /* Skip the UTF-8 BOM that was found */
-	}
-#endif
-	ret = _parse_data_SAX((void*)f, DATA_SOURCE_FILE, sax, &sd);
-	(void)sx_fclose(f);
+	if (reader == NULL || (reader->event != XML_EVENT_START_NODE && reader->event != XML_EVENT_END_NODE))
+		return NULL;
 
-	return ret;
+	return &reader->parser.node;
 }
 
-int XMLDoc_parse_buffer_SAX(const SXML_CHAR* buffer, const SXML_CHAR* name, const SAX_Callbacks* sax, void* user)
+const SXML_CHAR* XMLReader_text(const XMLReader* reader, size_t* len)
 {
-	DataSourceBuffer dsb = { buffer, 0 };
-	SAX_Data sd;
+	if (reader == NULL || reader->event != XML_EVENT_TEXT)
+		return NULL;
 
-	if (sax == NULL || buffer == NULL)
-		return false;
+	if (len != NULL)
+		*len = reader->parser.len_tok;
 
-	sd.name = name;
-	sd.user = user;
-	return _parse_data_SAX((void*)&dsb, DATA_SOURCE_BUFFER, sax, &sd);
+	return reader->parser.tok;
 }
 
-int XMLDoc_parse_file_DOM_text_as_nodes(const SXML_CHAR* filename, XMLDoc* doc, int text_as_nodes)
+int XMLReader_depth(const XMLReader* reader)
 {
-	DOM_through_SAX dom;
-	SAX_Callbacks sax;
+	if (reader == NULL)
+		return -1;
 
-	if (doc == NULL || filename == NULL || filename[0] == NULC || doc->init_value != XML_INIT_DONE)
-		return false;
+	/* 'parser.depth' counts a father node from its start to its end, excluded */
+	if (reader->event == XML_EVENT_END_NODE || (reader->event == XML_EVENT_START_NODE && reader->parser.node.tag_type != TAG_FATHER))
+		return reader->parser.depth + 1;
 
-	sx_strncpy(doc->filename, filename, SXMLC_MAX_PATH - 1);
-	doc->filename[SXMLC_MAX_PATH - 1] = NULC;
+	return reader->parser.depth;
+}
 
-	/* Read potential BOM on file, only when unicode is defined */
-#ifdef SXMLC_UNICODE
-	{
-		/* In Unicode, open the file as binary so that further 'fgetwc' read all bytes */
-		FILE* f = sx_fopen(filename, C2SX("rb"));
-		if (f != NULL) {
-			#if defined(SXMLC_UNICODE) && (defined(WIN32) || defined(WIN64))
-			//setvbuf(f, NULL, _IONBF, 0);
-			#endif
-			doc->bom_type = freadBOM(f, doc->bom, &doc->sz_bom);
-			sx_fclose(f);
-		}
-	}
-#endif
+int XMLReader_line(const XMLReader* reader)
+{
+	return reader == NULL ? -1 : reader->parser.sd.line_num;
+}
 
-	dom.doc = doc;
-	dom.current = NULL;
-	dom.text_as_nodes = text_as_nodes;
-	SAX_Callbacks_init_DOM(&sax);
+int XMLReader_column(const XMLReader* reader)
+{
+	return reader == NULL ? -1 : reader->parser.sd.column;
+}
 
-	if (!XMLDoc_parse_file_SAX(filename, &sax, &dom)) {
-		(void)XMLDoc_free(doc);
-		dom.doc = NULL;
+int XMLReader_position(const XMLReader* reader, int64_t* start_pos, int64_t* end_pos)
+{
+	if (reader == NULL)
 		return false;
-	}
+
+	if (start_pos != NULL)
+		*start_pos = reader->parser.sd.start_pos;
+	if (end_pos != NULL)
+		*end_pos = reader->parser.sd.end_pos;
 
 	return true;
 }
 
-int XMLDoc_parse_buffer_DOM_text_as_nodes(const SXML_CHAR* buffer, const SXML_CHAR* name, XMLDoc* doc, int text_as_nodes)
+ParseError XMLReader_error(const XMLReader* reader)
 {
-	DOM_through_SAX dom;
-	SAX_Callbacks sax;
+	return reader == NULL ? PARSE_ERR_NONE : reader->parser.error;
+}
 
-	if (doc == NULL || buffer == NULL || doc->init_value != XML_INIT_DONE)
+int XMLReader_free(XMLReader* reader)
+{
+	if (reader == NULL)
 		return false;
 
-	dom.doc = doc;
-	dom.current = NULL;
-	dom.text_as_nodes = text_as_nodes;
-	SAX_Callbacks_init_DOM(&sax);
+	_parser_free(&reader->parser);
+	if (reader->f != NULL)
+		(void)sx_fclose(reader->f);
+	__free(reader);
 
-	return XMLDoc_parse_buffer_SAX(buffer, name, &sax, &dom) ? true : XMLDoc_free(doc);
+	return true;
 }
 
-
-
 /* --- Utility functions (ex sxmlutils.c) --- */
 
 #ifdef DBG_MEM
@@ -1787,14 +4823,32 @@ int _beob(DataSourceBuffer* ds)
 	return false;
 }
 
+int _ugetc(DataSourceUser* ds)
+{
+	SXML_CHAR c;
+
+	if (ds == NULL || ds->read == NULL || ds->read(ds->ctx, &c, 1) != 1)
+		return EOF;
+
+	return (int)c;
+}
+
+int _ueob(DataSourceUser* ds)
+{
+	if (ds == NULL || ds->read == NULL)
+		return true;
+
+	return ds->eof == NULL ? true : ds->eof(ds->ctx);
+}
+
 int read_line_alloc(void* in, DataSourceType in_type, SXML_CHAR** line, int* sz_line, int i0, SXML_CHAR from, SXML_CHAR to, int keep_fromto, SXML_CHAR interest, int* interest_count)
 {
 	int init_sz = 0;
 	SXML_CHAR ch, *pt;
 	int c;
 	int n, ret;
-	int (*mgetc)(void* ds) = (in_type == DATA_SOURCE_BUFFER ? (int(*)(void*))_bgetc : (int(*)(void*))sx_fgetc);
-	int (*meos)(void* ds) = (in_type == DATA_SOURCE_BUFFER ? (int(*)(void*))_beob : (int(*)(void*))sx_feof);
+	int (*mgetc)(void* ds) = (in_type == DATA_SOURCE_BUFFER ? (int(*)(void*))_bgetc : in_type == DATA_SOURCE_USER ? (int(*)(void*))_ugetc : (int(*)(void*))sx_fgetc);
+	int (*meos)(void* ds) = (in_type == DATA_SOURCE_BUFFER ? (int(*)(void*))_beob : in_type == DATA_SOURCE_USER ? (int(*)(void*))_ueob : (int(*)(void*))sx_feof);
 	
 	if (in == NULL || line == NULL)
 		return 0;
@@ -2089,9 +5143,11 @@ BOM_TYPE freadBOM(FILE* f, unsigned char* bom, int* sz_bom)
 		case (unsigned short)0x0000:
 			if (fread(&c1, sizeof(char), 1, f) == 1 && fread(&c2, sizeof(char), 1, f) == 1
 					&& c1 == 0xfe && c2 == 0xff) {
-				bom[2] = c1;
-				bom[3] = c2;
-				bom[4] = '\0';
+				if (bom != NULL) {
+					bom[2] = c1;
+					bom[3] = c2;
+					bom[4] = '\0';
+				}
 				if (sz_bom != NULL)
 					*sz_bom = 4;
 				return BOM_UTF_32BE;
@@ -2128,36 +5184,118 @@ BOM_TYPE freadBOM(FILE* f, unsigned char* bom, int* sz_bom)
 
 /* --- */
 
+/*
+ Decode the numeric character reference "&#...;" at 'ps' into 'pd'.
+ Return the length of the reference, or 0 if it is not a valid one (nothing is written to 'pd').
+ '*n_pd' receives the number of characters written, which is never more than the length of
+ the reference so that decoding can be done in place.
+ */
+static int _html_numeric(const SXML_CHAR* ps, SXML_CHAR* pd, int* n_pd)
+{
+	const SXML_CHAR* p = ps + 2;
+	unsigned long cp = 0;
+	int base = 10, d;
+
+	if (*p == C2SX('x') || *p == C2SX('X')) {
+		base = 16;
+		p++;
+	}
+	for (; ; p++) {
+		if (*p >= C2SX('0') && *p <= C2SX('9'))
+			d = *p - C2SX('0');
+		else if (base == 16 && *p >= C2SX('a') && *p <= C2SX('f'))
+			d = *p - C2SX('a') + 10;
+		else if (base == 16 && *p >= C2SX('A') && *p <= C2SX('F'))
+			d = *p - C2SX('A') + 10;
+		else
+			break;
+		cp = cp * base + d;
+		if (cp > 0x10ffff)
+			return 0;
+	}
+	if (*p != C2SX(';') || p == ps + 2 + (base == 16) || cp == 0 || (cp >= 0xd800 && cp <= 0xdfff))
+		return 0;
+
+	*n_pd = _put_codepoint(pd, cp);
+
+	return (int)(p + 1 - ps);
+}
+
+/*
+ Decode the escape sequence at 'ps' (a '&') into 'pd', dispatching on its first character
+ instead of comparing it to all 'HTML_SPECIAL_DICT' entries.
+ Return the length of the sequence, or 0 if it is not a known one (nothing is written to 'pd').
+ '*n_pd' receives the number of characters written.
+ */
+static int _html_entity(const SXML_CHAR* ps, SXML_CHAR* pd, int* n_pd)
+{
+	*n_pd = 1;
+	switch (ps[1]) {
+		case C2SX('l'):
+			if (ps[2] != C2SX('t') || ps[3] != C2SX(';'))
+				return 0;
+			*pd = C2SX('<');
+			return 4;
+
+		case C2SX('g'):
+			if (ps[2] != C2SX('t') || ps[3] != C2SX(';'))
+				return 0;
+			*pd = C2SX('>');
+			return 4;
+
+		case C2SX('a'):
+			if (ps[2] == C2SX('m') && ps[3] == C2SX('p') && ps[4] == C2SX(';')) {
+				*pd = C2SX('&');
+				return 5;
+			}
+			if (ps[2] == C2SX('p') && ps[3] == C2SX('o') && ps[4] == C2SX('s') && ps[5] == C2SX(';')) {
+				*pd = C2SX('\'');
+				return 6;
+			}
+			return 0;
+
+		case C2SX('q'):
+			if (ps[2] != C2SX('u') || ps[3] != C2SX('o') || ps[4] != C2SX('t') || ps[5] != C2SX(';'))
+				return 0;
+			*pd = C2SX('"');
+			return 6;
+
+		case C2SX('#'):
+			return _html_numeric(ps, pd, n_pd);
+
+		default:
+			return 0;
+	}
+}
+
 SXML_CHAR* html2str(SXML_CHAR* html, SXML_CHAR* str)
 {
-	SXML_CHAR *ps, *pd;
-	int i;
+	SXML_CHAR *ps, *pd, *amp;
+	size_t n;
+	int len, n_pd;
 
 	if (html == NULL) return NULL;
 
 	if (str == NULL) str = html;
 	
-	/* Look for '&' and matches it to any of the recognized HTML pattern. */
-	/* If found, replaces the '&' by the corresponding char. */
-	/* 'p2' is the char to analyze, 'p1' is where to insert it */
-	for (pd = str, ps = html; *ps; ps++, pd++) {
-		if (*ps != C2SX('&')) {
-			if (pd != ps)
-				*pd = *ps;
-			continue;
-		}
-		
-		for (i = 0; HTML_SPECIAL_DICT[i].chr; i++) {
-			if (sx_strncmp(ps, HTML_SPECIAL_DICT[i].html, HTML_SPECIAL_DICT[i].html_len))
-				continue;
-			
-			*pd = HTML_SPECIAL_DICT[i].chr;
-			ps += HTML_SPECIAL_DICT[i].html_len-1;
+	/* Copy the characters up to the next '&' at once (found with 'sx_strchr', which is vectorized
+	   by most C libraries), then decode the escape sequence it starts, if any */
+	/* 'ps' is the char to analyze, 'pd' is where to insert it */
+	for (pd = str, ps = html; ; ) {
+		amp = sx_strchr(ps, C2SX('&'));
+		n = (amp == NULL ? sx_strlen(ps) : (size_t)(amp - ps));
+		if (pd != ps)
+			memmove(pd, ps, n * sizeof(SXML_CHAR));
+		pd += n;
+		ps += n;
+		if (amp == NULL)
 			break;
-		}
-		/* If no string was found, simply copy the character */
-		if (HTML_SPECIAL_DICT[i].chr == NULC && pd != ps)
-			*pd = *ps;
+
+		if ((len = _html_entity(ps, pd, &n_pd)) > 0) {
+			ps += len;
+			pd += n_pd;
+		} else /* Not an escape sequence: simply copy the character */
+			*pd++ = *ps++;
 	}
 	*pd = NULC;
 	
@@ -2242,6 +5380,212 @@ int fprintHTML(FILE* f, SXML_CHAR* str)
 	return n;
 }
 
+/*
+ Decode the UTF-8 sequence at 's' ('n' bytes available) into '*cp'.
+ Return its length, or 0 if it is invalid (or truncated).
+ */
+static int _utf8_decode(const unsigned char* s, size_t n, unsigned long* cp)
+{
+	int len, i;
+
+	if (s[0] < 0x80) {
+		*cp = s[0];
+		return 1;
+	}
+	if (s[0] < 0xc2) /* Continuation byte, or overlong 2-byte form */
+		return 0;
+	if (s[0] < 0xe0) {
+		len = 2;
+		*cp = s[0] & 0x1f;
+	} else if (s[0] < 0xf0) {
+		len = 3;
+		*cp = s[0] & 0x0f;
+	} else if (s[0] < 0xf5) {
+		len = 4;
+		*cp = s[0] & 0x07;
+	} else
+		return 0;
+	if (n < (size_t)len)
+		return 0;
+	for (i = 1; i < len; i++) {
+		if ((s[i] & 0xc0) != 0x80)
+			return 0;
+		*cp = (*cp << 6) | (s[i] & 0x3f);
+	}
+	if ((len == 3 && *cp < 0x800) || (len == 4 && (*cp < 0x10000 || *cp > 0x10ffff)) || (*cp >= 0xd800 && *cp <= 0xdfff))
+		return 0;
+
+	return len;
+}
+
+size_t utf8_check(const char* str, size_t n)
+{
+	const unsigned char* s = (const unsigned char*)str;
+	unsigned long cp;
+	size_t i = 0;
+	int len;
+
+	if (str == NULL)
+		return 0;
+
+	while (i < n) {
+#ifdef SXMLC_SSE2
+		/* Skip ASCII characters 16 at a time */
+		while (i + 16 <= n && _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(s + i))) == 0)
+			i += 16;
+#endif
+		for (; i < n && s[i] < 0x80; i++) ;
+		for (; i < n && s[i] >= 0x80; i += len) {
+			if ((len = _utf8_decode(s + i, n - i, &cp)) == 0)
+				return i;
+		}
+	}
+
+	return i;
+}
+
+size_t utf8_wcslen(const char* str)
+{
+	const unsigned char* s = (const unsigned char*)str;
+	unsigned long cp;
+	size_t n, i, len;
+	int l;
+
+	if (str == NULL)
+		return 0;
+
+	n = strlen(str);
+	for (i = len = 0; i < n; len++) {
+		l = _utf8_decode(s + i, n - i, &cp);
+		i += (l == 0 ? 1 : l);
+		if (sizeof(wchar_t) == 2 && l == 4)
+			len++;
+	}
+
+	return len;
+}
+
+wchar_t* utf8_to_wcs(const char* str, wchar_t* wcs)
+{
+	const unsigned char* s = (const unsigned char*)str;
+	unsigned long cp;
+	size_t n, i, j;
+	int l;
+
+	if (str == NULL)
+		return NULL;
+
+	if (wcs == NULL) {
+		wcs = (wchar_t*)__malloc((utf8_wcslen(str) + 1) * sizeof(wchar_t));
+		if (wcs == NULL)
+			return NULL;
+	}
+
+	n = strlen(str);
+	for (i = j = 0; i < n; ) {
+		if ((l = _utf8_decode(s + i, n - i, &cp)) == 0) {
+			cp = 0xfffd;
+			l = 1;
+		}
+		i += l;
+		if (sizeof(wchar_t) == 2 && cp > 0xffff) {
+			cp -= 0x10000;
+			wcs[j++] = (wchar_t)(0xd800 | (cp >> 10));
+			wcs[j++] = (wchar_t)(0xdc00 | (cp & 0x3ff));
+		} else
+			wcs[j++] = (wchar_t)cp;
+	}
+	wcs[j] = 0;
+
+	return wcs;
+}
+
+size_t XML_transcode(const unsigned char* src, size_t n, BOM_TYPE enc, SXML_CHAR* dst, size_t* n_used)
+{
+	const unsigned char* s = src;
+	const unsigned char* end;
+	const unsigned char* stop;
+	SXML_CHAR* pd = dst;
+	unsigned long cp, cp2;
+	int unit, be;
+
+	switch (enc) {
+		case BOM_UTF_16LE:	unit = 2; be = false; break;
+		case BOM_UTF_16BE:	unit = 2; be = true; break;
+		case BOM_UTF_32LE:	unit = 4; be = false; break;
+		case BOM_UTF_32BE:	unit = 4; be = true; break;
+		default: /* UTF-8 */
+#ifndef SXMLC_UNICODE
+			memcpy(dst, src, n);
+			*n_used = n;
+			return n;
+#else
+			for (; s < src + n; s += unit) {
+				if ((unit = _utf8_decode(s, src + n - s, &cp)) == 0) {
+					cp = 0xfffd;
+					unit = 1;
+				}
+				pd += _put_codepoint(pd, cp);
+			}
+			*n_used = n;
+			return pd - dst;
+#endif
+	}
+
+	end = src + n - n % unit;
+	while (s < end) {
+#ifdef SXMLC_SSE2
+		/* Copy ASCII characters 16 at a time, and decode at least the next 16 ones one by one */
+		if (unit == 2) {
+			const __m128i non_ascii = _mm_set1_epi16((short)0xff80);
+			__m128i a, b;
+
+			while (end - s >= 32) {
+				a = _mm_loadu_si128((const __m128i*)s);
+				b = _mm_loadu_si128((const __m128i*)(s + 16));
+				if (be) {
+					a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+					b = _mm_or_si128(_mm_slli_epi16(b, 8), _mm_srli_epi16(b, 8));
+				}
+				if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(_mm_or_si128(a, b), non_ascii), _mm_setzero_si128())) != 0xffff)
+					break;
+				_mm_storeu_si128((__m128i*)pd, _mm_packus_epi16(a, b));
+				s += 32;
+				pd += 16;
+			}
+		}
+		stop = (end - s > 32 ? s + 32 : end);
+#else
+		stop = end;
+#endif
+		while (s < stop) {
+			if (unit == 2)
+				cp = (be ? (s[0] << 8) | s[1] : (s[1] << 8) | s[0]);
+			else
+				cp = (be ? ((unsigned long)s[0] << 24) | (s[1] << 16) | (s[2] << 8) | s[3]
+						: ((unsigned long)s[3] << 24) | (s[2] << 16) | (s[1] << 8) | s[0]);
+			if (unit == 2 && cp >= 0xd800 && cp <= 0xdbff) {
+				if (end - s < 4) /* Low surrogate is not available yet */
+					break;
+				cp2 = (be ? (s[2] << 8) | s[3] : (s[3] << 8) | s[2]);
+				if (cp2 >= 0xdc00 && cp2 <= 0xdfff) {
+					cp = 0x10000 + ((cp - 0xd800) << 10) + (cp2 - 0xdc00);
+					s += 2;
+				} else
+					cp = 0xfffd;
+			} else if ((cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff)
+				cp = 0xfffd;
+			s += unit;
+			pd += _put_codepoint(pd, cp);
+		}
+		if (s < stop)
+			break;
+	}
+	*n_used = s - src;
+
+	return pd - dst;
+}
+
 int regstrcmp(SXML_CHAR* str, SXML_CHAR* pattern)
 {
 	SXML_CHAR *p, *s;
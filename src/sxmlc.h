@@ -30,13 +30,15 @@
 #ifndef _SXML_H_
 #define _SXML_H_
 
-#define SXMLC_VERSION "4.2.7"
+#define SXMLC_VERSION "4.3.0"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #include <stdio.h>
+#include <stdint.h>
+#include <wchar.h>
 
 #ifdef SXMLC_UNICODE
 	typedef wchar_t SXML_CHAR;
@@ -48,6 +50,7 @@ extern "C" {
 	#define sx_strdup wcsdup
 	#define sx_strchr wcschr
 	#define sx_strrchr wcsrchr
+	#define sx_memchr wmemchr
 	#define sx_strcpy wcscpy
 	#define sx_strncpy wcsncpy
 	#define sx_strcat wcscat
@@ -74,6 +77,7 @@ extern "C" {
 	#define sx_strdup __sx_strdup
 	#define sx_strchr strchr
 	#define sx_strrchr strrchr
+	#define sx_memchr memchr
 	#define sx_strcpy strcpy
 	#define sx_strncpy strncpy
 	#define sx_strcat strcat
@@ -106,6 +110,14 @@ extern "C" {
 #define MEM_INCR_RLA (256*sizeof(SXML_CHAR)) /* Initial buffer size and increment for memory reallocations */
 #endif
 
+#ifndef SXMLC_PARALLEL_MIN_CHUNK
+#define SXMLC_PARALLEL_MIN_CHUNK (1024*1024) /* Minimum number of characters parsed by each thread in 'XMLDoc_parse_file_parallel_DOM' */
+#endif
+
+#ifndef SXMLC_BLOCK_SIZE
+#define SXMLC_BLOCK_SIZE (64*1024) /* Number of characters read at once from files by the parser */
+#endif
+
 #ifndef false
 #define false 0
 #endif
@@ -123,14 +135,30 @@ extern "C" {
  */
 typedef struct _DataSourceBuffer {
 	const SXML_CHAR* buf;
-	int cur_pos;
+	size_t cur_pos;
 } DataSourceBuffer;
 
 typedef FILE* DataSourceFile;
 
+/*
+ User-defined data source, read by blocks (e.g. from a decompressor, a ring buffer, shared memory...).
+ 'read' should copy at most 'n' characters into 'buf' and return the number of characters copied.
+ It should return 0 only at the end of data or on error.
+ 'eof' should return 'true' when the end of data has been reached. It is used to know whether
+ 'read' returning 0 is an error ('eof' returns 'false') or not. It can be NULL, in which case
+ 'read' returning 0 is always the end of data.
+ 'ctx' is a user-given pointer that will be given back to 'read' and 'eof'.
+ */
+typedef struct _DataSourceUser {
+	size_t (*read)(void* ctx, SXML_CHAR* buf, size_t n);
+	int (*eof)(void* ctx);
+	void* ctx;
+} DataSourceUser;
+
 typedef enum _DataSourceType {
 	DATA_SOURCE_FILE = 0,
 	DATA_SOURCE_BUFFER,
+	DATA_SOURCE_USER,
 	DATA_SOURCE_MAX
 } DataSourceType;
 
@@ -165,6 +193,9 @@ typedef struct _XMLAttribute {
 	SXML_CHAR* name;
 	SXML_CHAR* value;
 	int active;
+	int escaped;	/* 'true' when escape sequences of 'value' have not been converted yet (see 'XMLAttribute_get_value') */
+	const SXML_CHAR* ns_uri;		/* Namespace URI, NULL if none or not resolved (see 'XMLContext.namespaces') */
+	const SXML_CHAR* local_name;	/* Name without its prefix (pointing inside 'name'), NULL if namespaces are not resolved */
 } XMLAttribute;
 
 /* Constant to know whether a struct has been initialized (XMLNode or XMLDoc) */
@@ -175,6 +206,8 @@ typedef struct _XMLAttribute {
  */
 typedef struct _XMLNode {
 	SXML_CHAR* tag;				/* Tag name */
+	const SXML_CHAR* ns_uri;	/* Namespace URI, NULL if none or not resolved (see 'XMLContext.namespaces') */
+	const SXML_CHAR* local_name;	/* Tag name without its prefix (pointing inside 'tag'), NULL if namespaces are not resolved */
 	SXML_CHAR* text;			/* Text inside the node */
 	XMLAttribute* attributes;
 	int n_attributes;
@@ -185,6 +218,7 @@ typedef struct _XMLNode {
 	
 	TagType tag_type;	/* Node type ('TAG_FATHER', 'TAG_SELF' or 'TAG_END') */
 	int active;		/* 'true' to tell that node is active and should be displayed by 'XMLDoc_print' */
+	int interned;	/* 'true' when 'tag' and attribute names are shared with other nodes of the document (see 'XMLContext.intern_names') */
 
 	void* user;	/* Pointer for user data associated to the node */
 
@@ -208,6 +242,8 @@ typedef struct _XMLDoc {
 	XMLNode** nodes;		/* Nodes of the document, including prolog, comments and root nodes */
 	int n_nodes;			/* Number of nodes in 'nodes' */
 	int i_root;				/* Index of first root node in 'nodes', -1 if document is empty */
+	struct _InternTable* names;	/* Tag and attribute names shared by nodes of the document (see 'XMLContext.intern_names'), NULL if not used */
+	struct _InternTable* ns_uris;	/* Namespace URIs of nodes of the document (see 'XMLContext.namespaces'), NULL if not used */
 
 	/* Keep 'init_value' as the last member */
 	int init_value;	/* Initialized to 'XML_INIT_DONE' to indicate that document has been initialized properly */
@@ -239,6 +275,109 @@ int XML_get_nb_registered_user_tags(void);
  */
 int XML_get_registered_user_tag(TagType tag_type);
 
+/* --- XMLContext --- */
+
+/*
+ Struct defining "special" tags such as "<? ?>" or "<![CDATA[ ]]/>".
+ These tags are considered having a start and an end with some data in between that will
+ be stored in the 'tag' member of an XMLNode.
+ The 'tag_type' member is a constant that is associated to such tag.
+ All 'len_*' members are basically the "sx_strlen()" of 'start' and 'end' members.
+ */
+typedef struct _Tag {
+	TagType tag_type;
+	SXML_CHAR* start;
+	int len_start;
+	SXML_CHAR* end;
+	int len_end;
+} _TAG;
+
+/*
+ Node of the prefix tree of user tags starts, used to find the user tag starting a string in
+ as many steps as there are characters in its start, whatever the number of user tags.
+ */
+typedef struct _TagTrie {
+	SXML_CHAR c;	/* Character of this node */
+	int child;		/* Index of the first node below this one, -1 if none */
+	int next;		/* Index of the next node at the same level, -1 if none */
+	int i_tag;		/* Index of the first tag which start ends with this node, -1 if none */
+	int min_tag;	/* Smallest tag index of this node and all nodes below it */
+} _TAG_TRIE;
+
+typedef struct _SpecialTag {
+	_TAG *tags;
+	int n_tags;
+	_TAG_TRIE* trie;	/* Prefix tree of 'tags' starts (without their '<'), 'trie[0]' being the root. Rebuilt when tags are (un)registered */
+	int n_trie;
+} SPECIAL_TAG;
+
+/*
+ What the parser does with spaces of texts (see 'XMLContext.text_spaces').
+ */
+typedef enum _TextSpaces {
+	TEXT_SPACES_KEEP = 0,	/* Texts are given as they are */
+	TEXT_SPACES_SKIP,		/* Texts made only of spaces (e.g. indentation) are dropped */
+	TEXT_SPACES_TRIM		/* Same as TEXT_SPACES_SKIP, other texts being given without their leading and trailing spaces */
+} TextSpaces;
+
+/*
+ Parsing and searching context. It holds the settings that are otherwise global (user tags,
+ search matching function), so that several parses and searches can run at the same time
+ (e.g. in different threads) with different settings, without locks.
+ A context is initialized by 'XMLContext_init' and freed by 'XMLContext_free'. Parse and
+ search functions do not modify it, so it can be shared between threads once set up.
+ Functions taking a context ('*_ctx') use global settings when it is NULL.
+ Memory functions are only used for the parser working memory: nodes are still allocated by
+ '__malloc' so that documents are freed by 'XMLDoc_free'. Printing functions still use global
+ user tags.
+ Namespaces are resolved while parsing when 'namespaces' is 'true': the parser keeps the prefixes
+ declared by 'xmlns' and 'xmlns:prefix' attributes of the nodes being parsed, and fills 'ns_uri'
+ and 'local_name' of nodes (including end nodes) and attributes given to callbacks.
+ Unprefixed nodes are in the default namespace, unprefixed attributes are in no namespace. Prefix
+ 'xml' is predefined and 'xmlns' attributes are in the "http://www.w3.org/2000/xmlns/" namespace.
+ 'ns_uri' is left NULL when a prefix is not declared.
+ Namespace URIs are stored once by the parser, and once by each document built by DOM parsing
+ ('XMLDoc.ns_uris', freed by 'XMLDoc_free'): nodes of a same parse or document are in the same
+ namespace when their 'ns_uri' are the same pointer. 'ns_uri' of nodes given to callbacks (or by
+ 'XMLReader_node') are only valid until the end of the parse (or 'XMLReader_free').
+ */
+typedef struct _XMLContext {
+	SPECIAL_TAG user_tags;		/* User tags, see 'XMLContext_register_user_tag' (global user tags are NOT used) */
+	int (*regexpr_compare)(SXML_CHAR* str, SXML_CHAR* pattern);	/* Matching function used by searches ('regstrcmp' if NULL) */
+	void* (*mem_realloc)(void* mem, size_t sz);	/* Allocator for parser working memory (data blocks, texts), '__realloc' if NULL */
+	void (*mem_free)(void* mem);				/* Release of 'mem_realloc' memory, '__free' if NULL */
+	int max_depth;				/* Maximum number of nested nodes (i.e. depth of a node, 1 for the root node, with or without children), 0 for no limit */
+	size_t max_token_len;		/* Maximum number of characters of a text or a tag, 0 for no limit */
+	int lazy_values;			/* 'true' to leave escape sequences in attribute values of nodes given to SAX callbacks (and 'XMLReader_node'), see 'XMLAttribute_get_value' */
+	int check_utf8;				/* 'true' to check that texts and tags are valid UTF-8 (see 'utf8_check'), ignored when 'SXMLC_UNICODE' is defined */
+	TextSpaces text_spaces;		/* Spaces of texts dropped by the tokenizer, before any callback or copy */
+	int namespaces;				/* 'true' to resolve namespaces of nodes and attributes given to callbacks ('ns_uri' and 'local_name' members, see above) */
+	int intern_names;			/* 'true' for DOM parsing to store each tag and attribute name once per document (see 'XMLDoc.names') */
+
+	/* Keep 'init_value' as the last member */
+	int init_value;	/* Initialized to 'XML_INIT_DONE' to indicate that context has been initialized properly */
+} XMLContext;
+
+/*
+ Initialize 'ctx' with default settings: no user tags, 'regstrcmp' matching, default allocator,
+ no limits, attribute values converted while parsing, no UTF-8 check, texts kept as they are, namespaces not resolved and names not interned.
+ Return 'false' when 'ctx' is NULL.
+ */
+int XMLContext_init(XMLContext* ctx);
+
+/*
+ Free the memory used by 'ctx' (registered user tags).
+ Return 'false' when 'ctx' is NULL or was not initialized.
+ */
+int XMLContext_free(XMLContext* ctx);
+
+/*
+ Same as 'XML_register_user_tag', 'XML_unregister_user_tag' and 'XML_get_registered_user_tag'
+ on the user tags of context 'ctx'.
+ */
+int XMLContext_register_user_tag(XMLContext* ctx, TagType tag_type, SXML_CHAR* start, SXML_CHAR* end);
+int XMLContext_unregister_user_tag(XMLContext* ctx, int i_tag);
+int XMLContext_get_registered_user_tag(const XMLContext* ctx, TagType tag_type);
 
 typedef enum _ParseError {
 	PARSE_ERR_NONE = 0,
@@ -247,7 +386,9 @@ typedef enum _ParseError {
 	PARSE_ERR_SYNTAX = -3,
 	PARSE_ERR_EOF = -4,
 	PARSE_ERR_TEXT_OUTSIDE_NODE = -5, /* During DOM loading */
-	PARSE_ERR_UNEXPECTED_NODE_END = -6 /* During DOM loading */
+	PARSE_ERR_UNEXPECTED_NODE_END = -6, /* During DOM loading */
+	PARSE_ERR_LIMIT = -7, /* A limit of the 'XMLContext' was exceeded */
+	PARSE_ERR_ENCODING = -8 /* Invalid UTF-8 sequence (see 'XMLContext.check_utf8') */
 } ParseError;
 
 /*
@@ -271,13 +412,37 @@ typedef struct _SAX_Data {
 	const SXML_CHAR* name;
 	int line_num;
 	void* user;
+
+	/*
+	 Position of the text or tag of the current event, as offsets (in SXML_CHAR, i.e. bytes
+	 unless 'SXMLC_UNICODE' is defined) from the start of the parsed data: 'start_pos' is the
+	 offset of its first character, 'end_pos' the offset of the character following it.
+	 'column' (starting at 1) is the column of its first character.
+	 The end event of a node without children has the same position as its start event.
+	 */
+	int64_t start_pos;
+	int64_t end_pos;
+	int column;
 } SAX_Data;
 
+/*
+ Value returned by 'start_node' (or 'all_event' for 'XML_EVENT_START_NODE') to skip the children
+ of the node starting: the parser only looks for tag ends up to the end of the node, counting
+ nested nodes, without reading them or calling any callback (skipped data is not checked either,
+ e.g. by 'XMLContext.check_utf8' or 'XMLContext.max_depth'). The end of the node is then given to
+ 'end_node' as usual.
+ It has no effect on nodes without children (e.g. '<tag/>').
+ */
+#define SAX_SKIP_CHILDREN 2
+
 /*
  User callbacks used for SAX parsing. Return values of these callbacks should be 0 to stop parsing.
  Members can be set to NULL to disable handling of some events.
  All parameters are pointers to structures that will no longer be available after callback returns.
  It is recommended that the callback uses the information and stores it in its own data structure.
+ In particular, tag and attribute strings of nodes given to callbacks are not allocated but stored
+ in a buffer of the parser, reused for each tag: they should not be freed (nor the node given to
+ 'XMLNode_free') and should be copied (e.g. with 'XMLNode_dup') to be kept.
  WARNING! SAX PARSING DOES NOT CHECK FOR XML INTEGRITY! e.g. a tag end without a matching tag start
  will not be detected by the parser and should be detected by the callbacks instead.
  */
@@ -292,6 +457,7 @@ typedef struct _SAX_Callbacks {
 	 If any, attributes can be read from 'node->attributes'.
 	 N.B. '<tag/>' will trigger an immediate call to the 'end_node' callback
 	 after the 'start_node' callback.
+	 Return 'SAX_SKIP_CHILDREN' to go directly to the end of the node.
 	 */
 	int (*start_node)(const XMLNode* node, SAX_Data* sd);
 
@@ -384,6 +550,59 @@ int DOMXMLDoc_doc_end(SAX_Data* dom);
  */
 int SAX_Callbacks_init_DOM(SAX_Callbacks* sax);
 
+/*
+ Record streaming: for documents made of a (long) list of "records", each record node is
+ built as a small DOM tree (by the DOM callbacks) and given to a callback once complete.
+ The tree is freed when the callback returns, so memory use only depends on the size of
+ a record, not on the size of the document.
+ Records are nodes which tag is 'tag' or, when 'tag' is NULL, nodes for which 'match' returns
+ 'true'. Records are not searched for inside other records.
+ To use it, initialize a 'RecordStream' with 'RecordStream_init' and call any SAX parsing
+ function with callbacks initialized by 'SAX_Callbacks_init_records' and the 'RecordStream'
+ as 'user'.
+ */
+typedef struct _RecordStream {
+	const SXML_CHAR* tag;	/* Tag of record nodes, or NULL to use 'match' */
+
+	/*
+	 Called on each node start (outside of records) when 'tag' is NULL, to tell whether 'node' is a
+	 record. 'node' has no text and no children yet but its 'father' is set: fathers are nodes opened
+	 before 'node', without text nor children.
+	 Should return 'true' when 'node' is a record.
+	 */
+	int (*match)(const XMLNode* node, void* match_data);
+	void* match_data;
+
+	/*
+	 Called when 'record' is complete. 'record->father' is set as for 'match'.
+	 'record' belongs to the stream: it is freed after the callback returns, unless it was
+	 detached by setting 'rs->record' to NULL (it should then be freed by 'XMLNode_free' and '__free').
+	 'sd->user' is the 'RecordStream'.
+	 Should return 'false' to stop parsing.
+	 */
+	int (*on_record)(XMLNode* record, SAX_Data* sd);
+	void* user;			/* User data, for 'on_record' */
+	int text_as_nodes;	/* Store text inside records as TAG_TEXT nodes */
+
+	ParseError error;	/* Error that stopped parsing, 'PARSE_ERR_NONE' if none */
+
+	XMLNode* record;	/* For internal use (record given to 'on_record') */
+	XMLNode* path;		/* For internal use (last node opened outside of records, linked to its fathers) */
+	XMLDoc doc;			/* For internal use (record being built) */
+	DOM_through_SAX dom;	/* For internal use (record builder) */
+} RecordStream;
+
+/*
+ Initialize 'rs' to call 'on_record' for each node 'tag' (see 'RecordStream' for other settings).
+ Return 'false' when 'rs' is NULL.
+ */
+int RecordStream_init(RecordStream* rs, const SXML_CHAR* tag, int (*on_record)(XMLNode* record, SAX_Data* sd), void* user);
+
+/*
+ Initialize 'sax' with record streaming callbacks, to be used with a 'RecordStream' as 'user'.
+ */
+int SAX_Callbacks_init_records(SAX_Callbacks* sax);
+
 /* --- XMLNode methods --- */
 
 /*
@@ -397,6 +616,15 @@ int XML_parse_attribute_to(const SXML_CHAR* str, int to, XMLAttribute* xmlattr);
 
 #define XML_parse_attribute(str, xmlattr) XML_parse_attribute_to(str, -1, xmlattr)
 
+/*
+ Return the value of 'xmlattr', converting its escape sequences (e.g. '&amp;') first if it was not
+ done yet ('xmlattr->escaped' is 'true'). This happens for nodes given to SAX callbacks when
+ parsing with a context which 'lazy_values' is 'true': values are then only converted when (and if)
+ they are needed, and values without '&' are never converted.
+ Return NULL when 'xmlattr' is NULL.
+ */
+const SXML_CHAR* XMLAttribute_get_value(XMLAttribute* xmlattr);
+
 /*
  Reads a string that is supposed to be an xml tag like '<tag (attribName="attribValue")* [/]>' or '</tag>'.
  Fills the 'xmlnode' structure with the tag name and its attributes.
@@ -429,6 +657,8 @@ int XMLNode_free(XMLNode* node);
 /*
  Free XMLNode 'dst' and copy 'src' to 'dst', along with its children if specified.
  If 'src' is NULL, 'dst' is freed and initialized.
+ Interned names of 'src' are copied, so that 'dst' does not depend on the document of 'src',
+ except for 'ns_uri' members which point to the same strings as in 'src' (see 'XMLContext.namespaces').
  */
 int XMLNode_copy(XMLNode* dst, const XMLNode* src, int copy_children);
 
@@ -487,6 +717,8 @@ int XMLNode_get_attribute_count(const XMLNode* node);
 /*
  Search for the active attribute 'attr_name' in 'node', starting from index 'isearch'
  and returns its index, or -1 if not found or error.
+ When names are interned (see 'XMLContext.intern_names'), giving the name of an attribute of
+ another node of the document finds it without comparing strings.
  */
 int XMLNode_search_attribute(const XMLNode* node, const SXML_CHAR* attr_name, int isearch);
 
@@ -569,7 +801,8 @@ XMLNode* XMLNode_next(const XMLNode* node);
 int XMLDoc_init(XMLDoc* doc);
 
 /*
- Free an XML document.
+ Free an XML document, including its interned names (so nodes taken out of the document should
+ have been copied if they are 'interned').
  Return 'false' if 'doc' was not initialized.
  */
 int XMLDoc_free(XMLDoc* doc);
@@ -660,6 +893,12 @@ int XMLDoc_print_attr_sep(const XMLDoc* doc, FILE* f, const SXML_CHAR* tag_sep,
  */
 int XMLDoc_parse_file_DOM_text_as_nodes(const SXML_CHAR* filename, XMLDoc* doc, int text_as_nodes);
 
+/*
+ Same as 'XMLDoc_parse_file_DOM_text_as_nodes' using the settings of context 'ctx' (see 'XMLContext').
+ Nodes are allocated as usual, so the document is freed by 'XMLDoc_free' whatever the context.
+ */
+int XMLDoc_parse_file_DOM_ctx(const SXML_CHAR* filename, XMLDoc* doc, int text_as_nodes, const XMLContext* ctx);
+
 /* For backward compatibility */
 #define XMLDoc_parse_file_DOM(filename, doc) XMLDoc_parse_file_DOM_text_as_nodes(filename, doc, 0)
 
@@ -671,6 +910,8 @@ int XMLDoc_parse_file_DOM_text_as_nodes(const SXML_CHAR* filename, XMLDoc* doc,
  */
 int XMLDoc_parse_buffer_DOM_text_as_nodes(const SXML_CHAR* buffer, const SXML_CHAR* name, XMLDoc* doc, int text_as_nodes);
 
+int XMLDoc_parse_buffer_DOM_ctx(const SXML_CHAR* buffer, const SXML_CHAR* name, XMLDoc* doc, int text_as_nodes, const XMLContext* ctx);
+
 /* For backward compatibility */
 #define XMLDoc_parse_buffer_DOM(buffer, name, doc) XMLDoc_parse_buffer_DOM_text_as_nodes(buffer, name, doc, 0)
 
@@ -681,6 +922,12 @@ int XMLDoc_parse_buffer_DOM_text_as_nodes(const SXML_CHAR* buffer, const SXML_CH
  */
 int XMLDoc_parse_file_SAX(const SXML_CHAR* filename, const SAX_Callbacks* sax, void* user);
 
+/*
+ Same as 'XMLDoc_parse_file_SAX' using the settings of context 'ctx' (see 'XMLContext').
+ When a limit of 'ctx' is exceeded, parsing stops with error 'PARSE_ERR_LIMIT'.
+ */
+int XMLDoc_parse_file_SAX_ctx(const SXML_CHAR* filename, const SAX_Callbacks* sax, void* user, const XMLContext* ctx);
+
 /*
  Parse an XML document from a memory buffer 'buffer' that can be given a name 'name',
  calling SAX callbacks given in the 'sax' structure.
@@ -689,11 +936,300 @@ int XMLDoc_parse_file_SAX(const SXML_CHAR* filename, const SAX_Callbacks* sax, v
  */
 int XMLDoc_parse_buffer_SAX(const SXML_CHAR* buffer, const SXML_CHAR* name, const SAX_Callbacks* sax, void* user);
 
+int XMLDoc_parse_buffer_SAX_ctx(const SXML_CHAR* buffer, const SXML_CHAR* name, const SAX_Callbacks* sax, void* user, const XMLContext* ctx);
+
+/*
+ Same as 'XMLDoc_parse_buffer_SAX' but the buffer is given by its length 'len' (in SXML_CHAR)
+ instead of being NUL-terminated: it can be a part of a bigger buffer and is parsed in place,
+ without copy. NUL characters inside 'buffer' are not considered as the end of data.
+ Return 'false' in case of error (memory, malformed document), 'true' otherwise.
+ */
+int XMLDoc_parse_buffer_len_SAX_ctx(const SXML_CHAR* buffer, size_t len, const SXML_CHAR* name, const SAX_Callbacks* sax, void* user, const XMLContext* ctx);
+
+#define XMLDoc_parse_buffer_len_SAX(buffer, len, name, sax, user) XMLDoc_parse_buffer_len_SAX_ctx(buffer, len, name, sax, user, NULL)
+
+/*
+ Same as 'XMLDoc_parse_buffer_DOM_text_as_nodes' but the buffer is given by its length 'len'
+ (see 'XMLDoc_parse_buffer_len_SAX').
+ */
+int XMLDoc_parse_buffer_len_DOM_ctx(const SXML_CHAR* buffer, size_t len, const SXML_CHAR* name, XMLDoc* doc, int text_as_nodes, const XMLContext* ctx);
+
+#define XMLDoc_parse_buffer_len_DOM_text_as_nodes(buffer, len, name, doc, text_as_nodes) XMLDoc_parse_buffer_len_DOM_ctx(buffer, len, name, doc, text_as_nodes, NULL)
+
+#define XMLDoc_parse_buffer_len_DOM(buffer, len, name, doc) XMLDoc_parse_buffer_len_DOM_text_as_nodes(buffer, len, name, doc, 0)
+
+/*
+ Parse an XML document read by blocks from user-defined data source 'source' (that can be
+ given a name 'name'), calling SAX callbacks given in the 'sax' structure.
+ Data is read directly into the parser buffer, by blocks of about 'SXMLC_BLOCK_SIZE' characters.
+ 'user' is a user-given pointer that will be given back to all callbacks.
+ Return 'false' in case of error (memory or read error, malformed document), 'true' otherwise.
+ */
+int XMLDoc_parse_source_SAX_ctx(const DataSourceUser* source, const SXML_CHAR* name, const SAX_Callbacks* sax, void* user, const XMLContext* ctx);
+
+#define XMLDoc_parse_source_SAX(source, name, sax, user) XMLDoc_parse_source_SAX_ctx(source, name, sax, user, NULL)
+
+/*
+ Same as 'XMLDoc_parse_source_SAX' using the DOM implementation.
+ */
+int XMLDoc_parse_source_DOM_ctx(const DataSourceUser* source, const SXML_CHAR* name, XMLDoc* doc, int text_as_nodes, const XMLContext* ctx);
+
+#define XMLDoc_parse_source_DOM_text_as_nodes(source, name, doc, text_as_nodes) XMLDoc_parse_source_DOM_ctx(source, name, doc, text_as_nodes, NULL)
+
+#define XMLDoc_parse_source_DOM(source, name, doc) XMLDoc_parse_source_DOM_text_as_nodes(source, name, doc, 0)
+
+/*
+ Parse an XML document from the 'n' bytes of 'data' (e.g. a file read or mapped in memory), which
+ encoding is given by its BOM: UTF-16 and UTF-32 (big or little endian) documents are transcoded
+ at once to SXML_CHAR encoding (see 'XML_transcode') before being parsed. Without BOM (or with
+ a UTF-8 one), 'data' is parsed in place as with 'XMLDoc_parse_buffer_len_SAX_ctx' (it is decoded
+ as UTF-8 when 'SXMLC_UNICODE' is defined).
+ Return 'false' in case of error (memory, malformed document), 'true' otherwise.
+ */
+int XMLDoc_parse_bytes_SAX_ctx(const void* data, size_t n, const SXML_CHAR* name, const SAX_Callbacks* sax, void* user, const XMLContext* ctx);
+
+#define XMLDoc_parse_bytes_SAX(data, n, name, sax, user) XMLDoc_parse_bytes_SAX_ctx(data, n, name, sax, user, NULL)
+
+/*
+ Same as 'XMLDoc_parse_bytes_SAX_ctx' using the DOM implementation.
+ */
+int XMLDoc_parse_bytes_DOM_ctx(const void* data, size_t n, const SXML_CHAR* name, XMLDoc* doc, int text_as_nodes, const XMLContext* ctx);
+
+#define XMLDoc_parse_bytes_DOM(data, n, name, doc) XMLDoc_parse_bytes_DOM_ctx(data, n, name, doc, 0, NULL)
+
+/*
+ Same as 'XMLDoc_parse_file_SAX' but the file is memory-mapped and tokenized in place, instead
+ of being read through a 'FILE*'. Only the characters given to callbacks (tags, attributes, text)
+ are copied, which is much faster on big files.
+ On systems without 'mmap' (or when 'SXMLC_UNICODE' is defined), it falls back to 'XMLDoc_parse_file_SAX'.
+ Return 'false' in case of error (memory or unavailable filename, malformed document), 'true' otherwise.
+ */
+int XMLDoc_parse_file_mmap_SAX_ctx(const SXML_CHAR* filename, const SAX_Callbacks* sax, void* user, const XMLContext* ctx);
+
+#define XMLDoc_parse_file_mmap_SAX(filename, sax, user) XMLDoc_parse_file_mmap_SAX_ctx(filename, sax, user, NULL)
+
+/*
+ Same as 'XMLDoc_parse_file_DOM_text_as_nodes' but the file is memory-mapped (see 'XMLDoc_parse_file_mmap_SAX').
+ */
+int XMLDoc_parse_file_mmap_DOM_ctx(const SXML_CHAR* filename, XMLDoc* doc, int text_as_nodes, const XMLContext* ctx);
+
+#define XMLDoc_parse_file_mmap_DOM_text_as_nodes(filename, doc, text_as_nodes) XMLDoc_parse_file_mmap_DOM_ctx(filename, doc, text_as_nodes, NULL)
+
+#define XMLDoc_parse_file_mmap_DOM(filename, doc) XMLDoc_parse_file_mmap_DOM_text_as_nodes(filename, doc, 0)
+
+/*
+ Same as 'XMLDoc_parse_file_mmap_DOM_text_as_nodes' but the file is split in 'n_threads' chunks
+ that are parsed in parallel ('n_threads' <= 0 means one thread per processor). Each chunk
+ should be at least 'SXMLC_PARALLEL_MIN_CHUNK' characters long, so small files are parsed
+ by the calling thread only.
+ Nodes are then linked together in a single document, as if it was parsed sequentially (same
+ document, same errors and line numbers). Each chunk starts on the first '<' after its share
+ of the file, where the previous chunk stops. When that '<' is inside a comment, CDATA or attribute
+ value (which cannot be known in advance), the chunk is parsed again from the end of the previous
+ one; texts between tags (e.g. indentation) do not cause it.
+ Threads are created with 'pthread' (link with '-pthread'). When 'SXMLC_NO_THREADS' is defined
+ or on systems without 'mmap', it falls back to 'XMLDoc_parse_file_mmap_DOM_text_as_nodes'.
+ Return 'false' in case of error (memory or unavailable filename, malformed document), 'true' otherwise.
+ */
+int XMLDoc_parse_file_parallel_DOM_ctx(const SXML_CHAR* filename, XMLDoc* doc, int text_as_nodes, int n_threads, const XMLContext* ctx);
+
+#define XMLDoc_parse_file_parallel_DOM_text_as_nodes(filename, doc, text_as_nodes, n_threads) XMLDoc_parse_file_parallel_DOM_ctx(filename, doc, text_as_nodes, n_threads, NULL)
+#define XMLDoc_parse_file_parallel_DOM(filename, doc, n_threads) XMLDoc_parse_file_parallel_DOM_ctx(filename, doc, 0, n_threads, NULL)
+
+/*
+ Load the 'n' files 'paths' into documents 'docs' ('docs[i]' for 'paths[i]', all initialized
+ by 'XMLDoc_init'), with a pool of 'n_threads' threads ('n_threads' <= 0 means one thread per
+ processor), the calling thread being one of them.
+ Files are dealt to threads by decreasing size; a thread done with its own files takes the
+ remaining ones of the others, so that many small files are parsed as fast as a few big ones.
+ When 'status' is not NULL, 'status[i]' is set to 'true' if 'paths[i]' was loaded, 'false'
+ otherwise (in which case 'docs[i]' is empty).
+ When 'SXMLC_NO_THREADS' is defined or on systems without 'mmap', files are parsed one after the other.
+ Return the number of files loaded successfully ('n' when all were).
+ */
+int XMLDoc_parse_files_parallel_DOM_ctx(const SXML_CHAR* const* paths, int n, XMLDoc* docs, int text_as_nodes, int* status, int n_threads, const XMLContext* ctx);
+
+#define XMLDoc_parse_files_parallel(paths, n, docs, status, n_threads) XMLDoc_parse_files_parallel_DOM_ctx(paths, n, docs, 0, status, n_threads, NULL)
+
+/*
+ Same as 'XMLDoc_parse_files_parallel' calling SAX callbacks 'sax' for each file. 'sd->name'
+ tells which file callbacks are called for.
+ 'users' is NULL or an array of 'n_threads' user pointers: 'users[i]' is given to all callbacks
+ called by thread 'i', so that callbacks do not need locks to gather data. 'n_threads' should be
+ positive.
+ Return the number of files parsed successfully.
+ */
+int XMLDoc_parse_files_parallel_SAX_ctx(const SXML_CHAR* const* paths, int n, const SAX_Callbacks* sax, void** users, int* status, int n_threads, const XMLContext* ctx);
+
+#define XMLDoc_parse_files_parallel_SAX(paths, n, sax, users, status, n_threads) XMLDoc_parse_files_parallel_SAX_ctx(paths, n, sax, users, status, n_threads, NULL)
+
 /*
  Parse an XML file using the DOM implementation.
  */
 #define XMLDoc_parse_file XMLDOC_parse_file_DOM
 
+/* --- Incremental parsing --- */
+
+/*
+ Incremental ("push") parser, used when the document is not available at once (e.g. it comes
+ from a socket or a decompressor): data is given in chunks of any size through 'XMLParser_feed',
+ and SAX callbacks are called as soon as texts and tags are complete.
+ A tag or text split between two chunks is resumed when the next chunk arrives.
+ To build a DOM, use 'SAX_Callbacks_init_DOM' and a 'DOM_through_SAX' as 'user'.
+ */
+typedef struct _XMLParser XMLParser;
+
+/*
+ Create an incremental parser calling SAX callbacks given in 'sax', for a document that can be
+ given a name 'name', with parsing context 'ctx' (see 'XMLContext', NULL for global settings).
+ 'sax', 'name' and 'ctx' are not copied and should remain valid until 'XMLParser_free'.
+ 'user' is a user-given pointer that will be given back to all callbacks.
+ The 'start_doc' callback is called here.
+ Return the parser, or NULL on memory error.
+ */
+XMLParser* XMLParser_create_ctx(const SAX_Callbacks* sax, const SXML_CHAR* name, void* user, const XMLContext* ctx);
+
+#define XMLParser_create(sax, name, user) XMLParser_create_ctx(sax, name, user, NULL)
+
+/*
+ Parse the next 'len' characters 'chunk' of the document. 'chunk' is parsed in place and
+ does not need to be NUL-terminated; only the characters of an incomplete text or tag at
+ its end are kept until the next call.
+ Return 'false' when parsing is over (error, or a callback asked to stop), in which case
+ subsequent calls do nothing. 'XMLParser_finish' should still be called.
+ */
+int XMLParser_feed(XMLParser* parser, const SXML_CHAR* chunk, size_t len);
+
+/*
+ Tell 'parser' there is no more data: remaining characters are parsed and the 'end_doc'
+ callback is called.
+ Return 'false' in case of error (memory, malformed or truncated document), 'true' otherwise.
+ */
+int XMLParser_finish(XMLParser* parser);
+
+/*
+ Free the memory used by 'parser'. It can be called before 'XMLParser_finish' to abort parsing,
+ in which case 'end_doc' callback is not called.
+ */
+int XMLParser_free(XMLParser* parser);
+
+/* --- Pull parsing --- */
+
+/*
+ Pull parser (or "cursor"), an alternative to SAX callbacks: the document is read event by event
+ with 'XMLReader_next', the caller keeping control of the loop (it can stop at any time or skip
+ whole nodes).
+ Node and text given by the reader are borrowed: they are only valid until the next call
+ to 'XMLReader_next' and should be copied to be kept.
+ Readers opened by '*_ctx' functions use parsing context 'ctx' (see 'XMLContext'), that should
+ remain valid until 'XMLReader_free'.
+ */
+typedef struct _XMLReader XMLReader;
+
+/*
+ Create a reader on file 'filename'.
+ Return the reader, or NULL on error (memory or unavailable filename).
+ */
+XMLReader* XMLReader_open_file_ctx(const SXML_CHAR* filename, const XMLContext* ctx);
+
+#define XMLReader_open_file(filename) XMLReader_open_file_ctx(filename, NULL)
+
+/*
+ Create a reader on NUL-terminated memory buffer 'buffer' that can be given a name 'name'.
+ 'buffer' and 'name' are not copied and should remain valid until 'XMLReader_free'.
+ Return the reader, or NULL on memory error.
+ */
+XMLReader* XMLReader_open_buffer_ctx(const SXML_CHAR* buffer, const SXML_CHAR* name, const XMLContext* ctx);
+
+#define XMLReader_open_buffer(buffer, name) XMLReader_open_buffer_ctx(buffer, name, NULL)
+
+/*
+ Create a reader on memory buffer 'buffer' of 'len' characters, that does not need to be
+ NUL-terminated (see 'XMLDoc_parse_buffer_len_SAX').
+ Return the reader, or NULL on memory error.
+ */
+XMLReader* XMLReader_open_buffer_len_ctx(const SXML_CHAR* buffer, size_t len, const SXML_CHAR* name, const XMLContext* ctx);
+
+#define XMLReader_open_buffer_len(buffer, len, name) XMLReader_open_buffer_len_ctx(buffer, len, name, NULL)
+
+/*
+ Create a reader on user-defined data source 'source' (see 'XMLDoc_parse_source_SAX').
+ 'source' is not copied and should remain valid until 'XMLReader_free'.
+ Return the reader, or NULL on memory error.
+ */
+XMLReader* XMLReader_open_source_ctx(const DataSourceUser* source, const SXML_CHAR* name, const XMLContext* ctx);
+
+#define XMLReader_open_source(source, name) XMLReader_open_source_ctx(source, name, NULL)
+
+/*
+ Read the next event of the document:
+	XML_EVENT_START_NODE: a node was read (node is given by 'XMLReader_node'). Comments, CDATA,
+		prolog, ... are also nodes, with 'tag_type' set accordingly. Nodes with no children
+		(i.e. 'tag_type' is not 'TAG_FATHER') are followed by an 'XML_EVENT_END_NODE'.
+	XML_EVENT_END_NODE: end of a node (given by 'XMLReader_node').
+	XML_EVENT_TEXT: text read (given by 'XMLReader_text').
+	XML_EVENT_END_DOC: end of document was reached.
+	XML_EVENT_ERROR: an error occurred (given by 'XMLReader_error').
+ Once 'XML_EVENT_END_DOC' or 'XML_EVENT_ERROR' is returned, all subsequent calls return it.
+ */
+XMLEvent XMLReader_next(XMLReader* reader);
+
+/*
+ Skip all children of the node that was just started (i.e. last event was 'XML_EVENT_START_NODE'),
+ up to and including its end, only looking for tag ends (see 'SAX_SKIP_CHILDREN'). Next call to 'XMLReader_next' will return the event following the
+ node end. Does nothing if last event was not 'XML_EVENT_START_NODE'.
+ Return 'false' if the end of the node could not be reached (error or end of document).
+ */
+int XMLReader_skip(XMLReader* reader);
+
+/*
+ Return the node read by the last 'XML_EVENT_START_NODE' or 'XML_EVENT_END_NODE' event,
+ or NULL if last event was another one.
+ For end nodes ("</tag>"), only 'tag' is relevant.
+ */
+const XMLNode* XMLReader_node(const XMLReader* reader);
+
+/*
+ Return the text read by the last 'XML_EVENT_TEXT' event, or NULL if last event was another one.
+ The text is NOT NUL-terminated: its length is stored in 'len' (if not NULL).
+ As in SAX callbacks, the text is not unescaped.
+ */
+const SXML_CHAR* XMLReader_text(const XMLReader* reader, size_t* len);
+
+/*
+ Return the depth of the node given by the last 'XML_EVENT_START_NODE' or 'XML_EVENT_END_NODE'
+ event (1 for the root node), the same for both events whether the node has children or not.
+ For other events, return the number of nodes started and not ended yet (i.e. the depth of
+ the father of a text).
+ */
+int XMLReader_depth(const XMLReader* reader);
+
+/*
+ Return the current line number in the document.
+ */
+int XMLReader_line(const XMLReader* reader);
+
+/*
+ Return the column of the first character of the current event.
+ */
+int XMLReader_column(const XMLReader* reader);
+
+/*
+ Get the offsets of the current event (see 'SAX_Data'). 'start_pos' or 'end_pos' can be NULL.
+ Return 'false' when 'reader' is NULL.
+ */
+int XMLReader_position(const XMLReader* reader, int64_t* start_pos, int64_t* end_pos);
+
+/*
+ Return the error that stopped the reader ('PARSE_ERR_NONE' if none).
+ */
+ParseError XMLReader_error(const XMLReader* reader);
+
+/*
+ Free the reader (and close the file it was reading, if any).
+ */
+int XMLReader_free(XMLReader* reader);
+
 
 
 /* --- Utility functions --- */
@@ -704,11 +1240,18 @@ int XMLDoc_parse_buffer_SAX(const SXML_CHAR* buffer, const SXML_CHAR* name, cons
  */
 int _bgetc(DataSourceBuffer* ds);
 int _beob(DataSourceBuffer* ds);
+
+/*
+ Same as '_bgetc' and '_beob' for user-defined data sources (one character is read at a time).
+ */
+int _ugetc(DataSourceUser* ds);
+int _ueob(DataSourceUser* ds);
 /*
  Reads a line from data source 'in', eventually (re-)allocating a given buffer 'line'.
  Characters read will be stored in 'line' starting at 'i0' (this allows multiple calls to
  'read_line_alloc' on the same 'line' buffer without overwriting it at each call).
- 'in_type' specifies the type of data source to be read: 'in' is 'FILE*' if 'in_type'
+ 'in_type' specifies the type of data source to be read: 'in' is 'FILE*' if 'in_type' is 'DATA_SOURCE_FILE',
+ 'DataSourceBuffer*' if it is 'DATA_SOURCE_BUFFER' or 'DataSourceUser*' if it is 'DATA_SOURCE_USER'.
  'sz_line' is the size of the buffer 'line' if previously allocated. 'line' can point
  to NULL, in which case it will be allocated '*sz_line' bytes. After the function returns,
  '*sz_line' is the actual buffer size. This allows multiple calls to this function using the
@@ -768,7 +1311,7 @@ typedef enum _BOM_TYPE {
 	BOM_UTF_8 = 0xefbbbf,
 	BOM_UTF_16BE = 0xfeff,
 	BOM_UTF_16LE = 0xfffe,
-	BOM_UTF_32BE = 0x0000feff,
+	BOM_UTF_32BE = 0x0100feff, /* Bytes are 0x0000feff, which would be the same value as BOM_UTF_16BE */
 	BOM_UTF_32LE = 0xfffe0000
 } BOM_TYPE;
 /*
@@ -784,6 +1327,8 @@ BOM_TYPE freadBOM(FILE* f, unsigned char* bom, int* sz_bom);
 /*
  Replace occurrences of special HTML characters escape sequences (e.g. '&amp;') found in 'html'
  by its character equivalent (e.g. '&') into 'str'.
+ Numeric character references (e.g. '&#233;' or '&#x1F600;') are decoded as well, in UTF-8 (or as
+ 'wchar_t' if 'SXMLC_UNICODE' is defined). Unknown or invalid sequences are left as they are.
  If 'html' and 'str' are the same pointer replacement is made in 'str' itself, overwriting it.
  If 'str' is NULL, replacement is made into 'html', overwriting it.
  Returns 'str' (or 'html' if 'str' was NULL).
@@ -814,6 +1359,50 @@ int strlen_html(SXML_CHAR* str);
  */
 int fprintHTML(FILE* f, SXML_CHAR* str);
 
+/*
+ UTF-8 support when 'SXMLC_UNICODE' is not defined: characters are then bytes, so UTF-8 documents
+ are parsed and stored as they are (without the memory and 'fgetwc' costs of 'wchar_t'), their
+ validity being checked while parsing when 'XMLContext.check_utf8' is 'true'. Strings can be
+ converted to wide strings when needed.
+ */
+
+/*
+ Return the number of bytes at the beginning of the 'n' bytes of 'str' that are valid UTF-8
+ ('n' when all of them are). Overlong forms, surrogates and code points above U+10FFFF are invalid.
+ ASCII characters are checked by blocks of 16 with SSE2 when available.
+ */
+size_t utf8_check(const char* str, size_t n);
+
+/*
+ Return the number of 'wchar_t' needed to convert UTF-8 'str' (without the NUL terminator).
+ Characters above U+FFFF take 2 'wchar_t' (surrogate pair) when 'wchar_t' is 16 bits.
+ Invalid bytes are counted as one character each (U+FFFD).
+ Return 0 if 'str' is NULL.
+ */
+size_t utf8_wcslen(const char* str);
+
+/*
+ Convert UTF-8 string 'str' into wide string 'wcs', replacing invalid bytes by U+FFFD.
+ 'wcs' should have room for 'utf8_wcslen(str)+1' characters. If it is NULL, it is allocated to
+ the exact size and should be freed by the caller.
+ Return 'wcs', or NULL if 'str' is NULL or on memory error.
+ */
+wchar_t* utf8_to_wcs(const char* str, wchar_t* wcs);
+
+/*
+ Transcode the 'n' bytes of 'src', encoded as 'enc' (UTF-16 or UTF-32, big or little endian),
+ to SXML_CHAR encoding (UTF-8, or 'wchar_t' when 'SXMLC_UNICODE' is defined) into 'dst'.
+ 'dst' should have room for '3*n/2' characters ('n/2' when 'SXMLC_UNICODE' is defined).
+ Invalid characters (e.g. unpaired surrogates) are replaced by U+FFFD. Transcoding stops before
+ a character which bytes are not all in 'src', so that 'src' can be transcoded by blocks:
+ the number of bytes transcoded is stored in '*n_used'. ASCII characters of UTF-16 are copied by
+ blocks of 16 with SSE2 when available.
+ 'enc' BOM_NONE and BOM_UTF_8 mean UTF-8, which is copied as it is (or decoded when
+ 'SXMLC_UNICODE' is defined, 'dst' having then room for 'n' characters).
+ Return the number of characters written to 'dst' (not NUL-terminated).
+ */
+size_t XML_transcode(const unsigned char* src, size_t n, BOM_TYPE enc, SXML_CHAR* dst, size_t* n_used);
+
 /*
  Checks whether 'str' corresponds to 'pattern'.
  'pattern' can use wildcads such as '*' (any potentially empty string) or
@@ -0,0 +1,225 @@
+/*
+	Copyright (c) 2010, Matthieu Labas
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without modification,
+	are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	   this list of conditions and the following disclaimer in the documentation
+	   and/or other materials provided with the distribution.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+	IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+	INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+	NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+	PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+	WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+	OF SUCH DAMAGE.
+
+	The views and conclusions contained in the software and documentation are those of the
+	authors and should not be interpreted as representing official policies, either expressed
+	or implied, of the FreeBSD Project.
+*/
+#ifndef _SXMLC_HPP_
+#define _SXMLC_HPP_
+
+/*
+ C++ front end (C++11): 'sxml::parse' reads a document with the tokenizer of the pull parser
+ ('XMLReader') and gives its events to a handler object known at compile time, instead of
+ calling the function pointers of 'SAX_Callbacks'. Event methods of the handler are called
+ directly (and can be inlined), and events the handler does not implement are not dispatched.
+ Only the C files have to be compiled: this header has no translation unit.
+ */
+
+#include <type_traits>
+#include <utility>
+#include "sxmlc.h"
+
+namespace sxml {
+
+/*
+ Data sources given to 'parse'. They only keep pointers, that should remain valid until
+ 'parse' returns.
+ */
+
+/* File 'filename' (see 'XMLReader_open_file'). */
+struct file {
+	const SXML_CHAR* filename;
+
+	explicit file(const SXML_CHAR* filename) : filename(filename) {}
+	XMLReader* open(const XMLContext* ctx) const { return XMLReader_open_file_ctx(filename, ctx); }
+};
+
+/* Memory buffer of 'len' characters, that does not need to be NUL-terminated (see 'XMLReader_open_buffer_len'). */
+struct buffer {
+	const SXML_CHAR* data;
+	size_t len;
+	const SXML_CHAR* name;
+
+	buffer(const SXML_CHAR* data, size_t len, const SXML_CHAR* name = NULL) : data(data), len(len), name(name) {}
+	XMLReader* open(const XMLContext* ctx) const { return XMLReader_open_buffer_len_ctx(data, len, name, ctx); }
+};
+
+/* User-defined data source (see 'XMLReader_open_source'). */
+struct source {
+	const DataSourceUser* src;
+	const SXML_CHAR* name;
+
+	explicit source(const DataSourceUser* src, const SXML_CHAR* name = NULL) : src(src), name(name) {}
+	XMLReader* open(const XMLContext* ctx) const { return XMLReader_open_source_ctx(src, name, ctx); }
+};
+
+namespace detail {
+
+/*
+ 'has_<event>' traits tell whether handler 'H' has a method '<event>' accepting 'args'.
+ */
+#define SXMLC_HANDLER_TRAIT(event, args) \
+	template <class H> auto test_##event(int) -> decltype(std::declval<H&>().event args, char()); \
+	template <class H> long test_##event(...); \
+	template <class H> struct has_##event { static const bool value = (sizeof(test_##event<H>(0)) == sizeof(char)); };
+
+SXMLC_HANDLER_TRAIT(start_doc, ((XMLReader*)NULL))
+SXMLC_HANDLER_TRAIT(end_doc, ((XMLReader*)NULL))
+SXMLC_HANDLER_TRAIT(start_node, ((const XMLNode*)NULL, (XMLReader*)NULL))
+SXMLC_HANDLER_TRAIT(end_node, ((const XMLNode*)NULL, (XMLReader*)NULL))
+SXMLC_HANDLER_TRAIT(new_text, ((const SXML_CHAR*)NULL, (size_t)0, (XMLReader*)NULL))
+SXMLC_HANDLER_TRAIT(on_error, (PARSE_ERR_NONE, (XMLReader*)NULL))
+
+#undef SXMLC_HANDLER_TRAIT
+
+/*
+ Call the event method of 'h' and return its result when it exists, otherwise return 'true' (i.e. continue).
+ Overloads are selected on the 'has_<event>' trait so that missing methods are never named.
+ */
+#define SXMLC_HANDLER_CALL(event, params, args) \
+	template <class H> inline typename std::enable_if<has_##event<H>::value, int>::type event params { return static_cast<int>(h.event args); } \
+	template <class H, class... A> inline typename std::enable_if<!has_##event<H>::value, int>::type event(H&, A&&...) { return true; }
+
+SXMLC_HANDLER_CALL(start_doc, (H& h, XMLReader* r), (r))
+SXMLC_HANDLER_CALL(end_doc, (H& h, XMLReader* r), (r))
+SXMLC_HANDLER_CALL(start_node, (H& h, const XMLNode* n, XMLReader* r), (n, r))
+SXMLC_HANDLER_CALL(end_node, (H& h, const XMLNode* n, XMLReader* r), (n, r))
+SXMLC_HANDLER_CALL(new_text, (H& h, const SXML_CHAR* t, size_t len, XMLReader* r), (t, len, r))
+SXMLC_HANDLER_CALL(on_error, (H& h, ParseError e, XMLReader* r), (e, r))
+
+#undef SXMLC_HANDLER_CALL
+
+/* Closes the reader when 'parse' returns. */
+struct reader_guard {
+	XMLReader* reader;
+
+	explicit reader_guard(XMLReader* reader) : reader(reader) {}
+	~reader_guard() { if (reader != NULL) (void)XMLReader_free(reader); }
+};
+
+} /* namespace detail */
+
+/*
+ Parse 'src' ('sxml::file', 'sxml::buffer' or 'sxml::source'), with context 'ctx' (can be NULL),
+ giving its events to 'handler'.
+ 'Handler' can implement any of the following methods, those it does not implement being skipped
+ at compile time. As with 'SAX_Callbacks', they return 'false' (or 0) to stop parsing:
+	start_doc(XMLReader* reader): called before parsing the document.
+	start_node(const XMLNode* node, XMLReader* reader): a node was read (see 'XML_EVENT_START_NODE').
+		Returning 'SAX_SKIP_CHILDREN' skips the node children, 'end_node' being called next.
+	end_node(const XMLNode* node, XMLReader* reader): end of a node, also called for nodes
+		with no children (see 'XML_EVENT_END_NODE').
+	new_text(const SXML_CHAR* text, size_t len, XMLReader* reader): text read. It is NOT
+		NUL-terminated nor unescaped (see 'XMLReader_text').
+	on_error(ParseError error_num, XMLReader* reader): an error stopped parsing. The line can
+		be retrieved by 'XMLReader_line(reader)'.
+	end_doc(XMLReader* reader): called after parsing, even on error, if 'start_doc' did not stop it.
+ 'reader' gives the position of the event ('XMLReader_line', 'XMLReader_depth', ...), node and
+ text are only valid during the call.
+ Return 'false' on error or if the handler stopped parsing, 'true' otherwise.
+ */
+template <class Handler, class Source>
+inline bool parse(const Source& src, Handler& handler, const XMLContext* ctx = NULL)
+{
+	detail::reader_guard guard(src.open(ctx));
+	XMLReader* reader = guard.reader;
+	const SXML_CHAR* text;
+	size_t len;
+	int rc;
+	bool ret = true;
+
+	if (reader == NULL)
+		return false;
+
+	if (!detail::start_doc(handler, reader))
+		return false;
+
+	for (;;) {
+		switch (XMLReader_next(reader)) {
+			case XML_EVENT_START_NODE:
+				if (!detail::has_start_node<Handler>::value)
+					break;
+				rc = detail::start_node(handler, XMLReader_node(reader), reader);
+				if (!rc)
+					ret = false;
+				else if (rc == SAX_SKIP_CHILDREN && XMLReader_node(reader)->tag_type == TAG_FATHER) {
+					/* 'XMLReader_skip' reads the node end, given to 'end_node' as SAX parsing does */
+					if (!XMLReader_skip(reader))
+						continue;
+					if (detail::has_end_node<Handler>::value && !detail::end_node(handler, XMLReader_node(reader), reader))
+						ret = false;
+				}
+				break;
+
+			case XML_EVENT_END_NODE:
+				if (detail::has_end_node<Handler>::value && !detail::end_node(handler, XMLReader_node(reader), reader))
+					ret = false;
+				break;
+
+			case XML_EVENT_TEXT:
+				if (detail::has_new_text<Handler>::value) {
+					text = XMLReader_text(reader, &len);
+					if (!detail::new_text(handler, text, len, reader))
+						ret = false;
+				}
+				break;
+
+			case XML_EVENT_END_DOC:
+				return detail::end_doc(handler, reader);
+
+			default: /* XML_EVENT_ERROR */
+				(void)detail::on_error(handler, XMLReader_error(reader), reader);
+				(void)detail::end_doc(handler, reader);
+				return false;
+		}
+		if (!ret)
+			break;
+	}
+
+	/* Stopped by the handler */
+	(void)detail::end_doc(handler, reader);
+
+	return false;
+}
+
+/*
+ Same as 'parse', with a default-constructed handler that is returned in 'handler' (can be NULL).
+ */
+template <class Handler, class Source>
+inline bool parse(const Source& src, Handler* handler = NULL, const XMLContext* ctx = NULL)
+{
+	Handler h;
+	bool ret = parse(src, h, ctx);
+
+	if (handler != NULL)
+		*handler = std::move(h);
+
+	return ret;
+}
+
+} /* namespace sxml */
+
+#endif
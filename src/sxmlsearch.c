@@ -60,6 +60,7 @@ int XMLSearch_init(XMLSearch* search)
 
 	search->tag = NULL;
 	search->text = NULL;
+	search->ns_uri = NULL;
 	search->attributes = NULL;
 	search->n_attributes = 0;
 	search->next = NULL;
@@ -82,6 +83,11 @@ int XMLSearch_free(XMLSearch* search, int free_next)
 		search->tag = NULL;
 	}
 
+	if (search->ns_uri != NULL) {
+		__free(search->ns_uri);
+		search->ns_uri = NULL;
+	}
+
 	if (search->attributes != NULL) {
 		for (i = 0; i < search->n_attributes; i++) {
 			if (search->attributes[i].name != NULL)
@@ -139,6 +145,22 @@ int XMLSearch_search_set_text(XMLSearch* search, const SXML_CHAR* text)
 	return (search->text != NULL);
 }
 
+int XMLSearch_search_set_ns(XMLSearch* search, const SXML_CHAR* ns_uri)
+{
+	if (search == NULL)
+		return false;
+
+	if (search->ns_uri != NULL) {
+		__free(search->ns_uri);
+		search->ns_uri = NULL;
+	}
+	if (ns_uri == NULL)
+		return true;
+
+	search->ns_uri = sx_strdup(ns_uri);
+	return (search->ns_uri != NULL);
+}
+
 int XMLSearch_search_add_attribute(XMLSearch* search, const SXML_CHAR* attr_name, const SXML_CHAR* attr_value, int value_equal)
 {
 	int i;
@@ -173,6 +195,9 @@ int XMLSearch_search_add_attribute(XMLSearch* search, const SXML_CHAR* attr_name
 	pt[i].name = name;
 	pt[i].value = value;
 	pt[i].active = value_equal;
+	pt[i].escaped = false;
+	pt[i].ns_uri = NULL;
+	pt[i].local_name = NULL;
 
 	search->n_attributes = i+1;
 	search->attributes = pt;
@@ -436,8 +461,27 @@ int XMLSearch_init_from_XPath(const SXML_CHAR* xpath, XMLSearch* search)
 	return true;
 }
 
-static int _attribute_matches(XMLAttribute* to_test, XMLAttribute* pattern)
+/*
+ Matching function to use with context 'ctx' (global one if 'ctx' is NULL).
+ */
+static REGEXPR_COMPARE _search_compare(const XMLContext* ctx)
+{
+	if (ctx == NULL)
+		return regstrcmp_search;
+
+	return (ctx->regexpr_compare != NULL ? ctx->regexpr_compare : regstrcmp);
+}
+
+/* Size of the buffer where escape sequences of attribute values are converted for searches */
+#define SZ_VALUE_BUF 128
+
+static int _attribute_matches(const XMLAttribute* to_test, XMLAttribute* pattern, REGEXPR_COMPARE cmp)
 {
+	SXML_CHAR buf[SZ_VALUE_BUF];
+	SXML_CHAR* value;
+	size_t len;
+	int ret;
+
 	if (to_test == NULL && pattern == NULL)
 		return true;
 
@@ -449,7 +493,7 @@ static int _attribute_matches(XMLAttribute* to_test, XMLAttribute* pattern)
 		return true;
 
 	/* Test on name fails => no match */
-	if (!regstrcmp_search(to_test->name, pattern->name))
+	if (!cmp(to_test->name, pattern->name))
 		return false;
 
 	/* No test on value => match */
@@ -457,10 +501,77 @@ static int _attribute_matches(XMLAttribute* to_test, XMLAttribute* pattern)
 		return true;
 
 	/* Test on value according to pattern "equal" attribute */
-	return regstrcmp_search(to_test->value, pattern->value) == pattern->active ? true : false;
+	if (!to_test->escaped || to_test->value == NULL)
+		return cmp(to_test->value, pattern->value) == pattern->active ? true : false;
+
+	/* Convert escape sequences of a lazy value (see 'XMLAttribute_get_value') into a copy, so that
+	   searched nodes are not modified. Converted value is never longer than 'to_test->value' */
+	len = sx_strlen(to_test->value);
+	value = (len < SZ_VALUE_BUF ? buf : (SXML_CHAR*)__malloc((len + 1) * sizeof(SXML_CHAR)));
+	if (value == NULL)
+		return false;
+	(void)html2str(to_test->value, value);
+	ret = (cmp(value, pattern->value) == pattern->active ? true : false);
+	if (value != buf)
+		__free(value);
+
+	return ret;
 }
 
-int XMLSearch_node_matches(const XMLNode* node, const XMLSearch* search)
+/*
+ Results of the tag test of a search on interned tags (see 'XMLContext.intern_names'), indexed
+ by tag address: all nodes of a document sharing a tag share its address.
+ */
+#define TAG_CACHE_SIZE 16
+typedef struct _TagCache {
+	const SXML_CHAR* tags[TAG_CACHE_SIZE];
+	char matches[TAG_CACHE_SIZE];
+	const SXML_CHAR* ns_uri;	/* Last 'ns_uri' of a node found in the namespace of the search */
+} _TagCache;
+
+/*
+ Test the namespace of 'node' against the one of 'search'. 'cache' can be NULL.
+ Nodes of a same document share their 'ns_uri' pointers, so URIs are compared only once
+ per document.
+ */
+static int _ns_matches(const XMLNode* node, const XMLSearch* search, _TagCache* cache)
+{
+	if (node->ns_uri == NULL)
+		return false;
+	if (cache != NULL && node->ns_uri == cache->ns_uri)
+		return true;
+	if (sx_strcmp(node->ns_uri, search->ns_uri))
+		return false;
+	if (cache != NULL)
+		cache->ns_uri = node->ns_uri;
+
+	return true;
+}
+
+/*
+ Test the tag of 'node' against 'search' (its local name when a namespace is searched).
+ 'cache' can be NULL.
+ */
+static int _tag_matches(const XMLNode* node, const XMLSearch* search, REGEXPR_COMPARE cmp, _TagCache* cache)
+{
+	const SXML_CHAR* tag = (search->ns_uri != NULL ? node->local_name : node->tag);
+	int i, match;
+
+	if (cache == NULL || !node->interned)
+		return cmp((SXML_CHAR*)tag, search->tag);
+
+	i = (int)(((size_t)node->tag / sizeof(SXML_CHAR*)) % TAG_CACHE_SIZE);
+	if (cache->tags[i] == node->tag)
+		return cache->matches[i];
+
+	match = (cmp((SXML_CHAR*)tag, search->tag) ? true : false);
+	cache->tags[i] = node->tag;
+	cache->matches[i] = (char)match;
+
+	return match;
+}
+
+static int _node_matches(const XMLNode* node, const XMLSearch* search, REGEXPR_COMPARE cmp, _TagCache* cache)
 {
 	int i, j;
 
@@ -474,12 +585,14 @@ int XMLSearch_node_matches(const XMLNode* node, const XMLSearch* search)
 	if (node->tag_type != TAG_FATHER && node->tag_type != TAG_SELF)
 		return false;
 
-	/* Check tag */
-	if (search->tag != NULL && !regstrcmp_search(node->tag, search->tag))
+	/* Check namespace, then local name instead of tag */
+	if (search->ns_uri != NULL && !_ns_matches(node, search, cache))
+		return false;
+	if (search->tag != NULL && !_tag_matches(node, search, cmp, cache)) /* Check tag */
 		return false;
 
 	/* Check text */
-	if (search->text != NULL && !regstrcmp_search(node->text, search->text))
+	if (search->text != NULL && !cmp(node->text, search->text))
 		return false;
 
 	/* Check attributes */
@@ -488,7 +601,7 @@ int XMLSearch_node_matches(const XMLNode* node, const XMLSearch* search)
 			for (j = 0; j < node->n_attributes; j++) {
 				if (!node->attributes[j].active)
 					continue;
-				if (_attribute_matches(&node->attributes[j], &search->attributes[i]))
+				if (_attribute_matches(&node->attributes[j], &search->attributes[i], cmp))
 					break;
 			}
 			if (j >= node->n_attributes) /* All attributes where scanned without a successful match */
@@ -498,7 +611,7 @@ int XMLSearch_node_matches(const XMLNode* node, const XMLSearch* search)
 
 	/* 'node' matches 'search'. If there is a father search, its father must match it */
 	if (search->prev != NULL)
-		return XMLSearch_node_matches(node->father, search->prev);
+		return _node_matches(node->father, search->prev, cmp, NULL);
 
 	/* TODO: Should a node match if search has no more 'prev' search and node father is still below the initial search ?
 	 Depends if XPath started with "//" (=> yes) or "/" (=> no).
@@ -507,13 +620,27 @@ int XMLSearch_node_matches(const XMLNode* node, const XMLSearch* search)
 	return true;
 }
 
-XMLNode* XMLSearch_next(const XMLNode* from, XMLSearch* search)
+int XMLSearch_node_matches_ctx(const XMLNode* node, const XMLSearch* search, const XMLContext* ctx)
+{
+	return _node_matches(node, search, _search_compare(ctx), NULL);
+}
+
+int XMLSearch_node_matches(const XMLNode* node, const XMLSearch* search)
+{
+	return _node_matches(node, search, regstrcmp_search, NULL);
+}
+
+XMLNode* XMLSearch_next_ctx(const XMLNode* from, XMLSearch* search, const XMLContext* ctx)
 {
 	XMLNode* node;
+	REGEXPR_COMPARE cmp = _search_compare(ctx);
+	_TagCache cache;
 
 	if (search == NULL || from == NULL)
 		return NULL;
 
+	memset(&cache, 0, sizeof(cache));
+
 	/* Go down the last child search as fathers will be tested recursively by the 'XMLSearch_node_matches' function */
 	for (; search->next != NULL; search = search->next) ;
 
@@ -523,7 +650,7 @@ XMLNode* XMLSearch_next(const XMLNode* from, XMLSearch* search)
 		search->stop_at = XMLNode_next_sibling(from);
 
 	for (node = XMLNode_next(from); node != search->stop_at; node = XMLNode_next(node)) { /* && node != NULL */
-		if (!XMLSearch_node_matches(node, search))
+		if (!_node_matches(node, search, cmp, &cache))
 			continue;
 
 		/* 'node' is a matching node */
@@ -533,12 +660,30 @@ XMLNode* XMLSearch_next(const XMLNode* from, XMLSearch* search)
 			return node;
 
 		/* Run the search on 'node' children */
-		return XMLSearch_next(node, search->next);
+		return XMLSearch_next_ctx(node, search->next, ctx);
 	}
 
 	return NULL;
 }
 
+XMLNode* XMLSearch_next(const XMLNode* from, XMLSearch* search)
+{
+	return XMLSearch_next_ctx(from, search, NULL);
+}
+
+int XMLSearch_record_matches(const XMLNode* node, void* search)
+{
+	const XMLSearch* s = (const XMLSearch*)search;
+
+	if (s == NULL)
+		return false;
+
+	/* Fathers are tested by the last search of the chain */
+	for (; s->next != NULL; s = s->next) ;
+
+	return XMLSearch_node_matches(node, s);
+}
+
 static SXML_CHAR* _get_XPath(const XMLNode* node, SXML_CHAR** xpath)
 {
 	int i, n, brackets, sz_xpath;
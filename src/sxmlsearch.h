@@ -69,6 +69,12 @@ typedef struct _XMLSearch {
 	 */
 	SXML_CHAR* text;
 
+	/*
+	 Search for nodes in this namespace (see 'XMLSearch_search_set_ns').
+	 'tag' is then matched against the local name of nodes. If NULL, namespaces are not checked.
+	 */
+	SXML_CHAR* ns_uri;
+
 	/*
 	 Next search to perform on children of a node matching current struct.
 	 Used to search for nodes children of specific nodes (used in XPath queries).
@@ -93,6 +99,8 @@ typedef int (*REGEXPR_COMPARE)(SXML_CHAR* str, SXML_CHAR* pattern);
  'fct' prototype is 'int fct(SXML_CHAR* str, SXML_CHAR* pattern)' where 'str' is the string to
  evaluate the match for and 'pattern' the pattern. It should return 'true' (=1) when
  'str' matches 'pattern' and 'false' (=0) when it does not.
+ This setting is global: use a context ('XMLContext') and '*_ctx' search functions to
+ have different matching functions in different threads.
  Return the previous function used for matching.
  */
 REGEXPR_COMPARE XMLSearch_set_regexpr_compare(REGEXPR_COMPARE fct);
@@ -152,6 +160,16 @@ int XMLSearch_search_remove_attribute(XMLSearch* search, int i_attr);
  */
 int XMLSearch_search_set_text(XMLSearch* search, const SXML_CHAR* text);
 
+/*
+ Set the search based on namespace URI 'ns_uri' (which is copied): matching
+ nodes should have been parsed with namespaces resolved (see 'XMLContext.namespaces') and be in
+ namespace 'ns_uri', their local name (instead of their tag) being matched against 'search->tag'.
+ Searching for '(URI, local name)' is then made by 'XMLSearch_search_set_tag(search, local_name)'.
+ 'ns_uri' should be NULL to search for nodes in any namespace.
+ Return 'true' upon successful completion, 'false' for memory error.
+ */
+int XMLSearch_search_set_ns(XMLSearch* search, const SXML_CHAR* ns_uri);
+
 /*
  Set an additional search on children nodes of a previously matching node.
  Search struct are chained to finally return the node matching the last search struct,
@@ -199,6 +217,12 @@ int XMLSearch_init_from_XPath(const SXML_CHAR* xpath, XMLSearch* search);
  */
 int XMLSearch_node_matches(const XMLNode* node, const XMLSearch* search);
 
+/*
+ Same as 'XMLSearch_node_matches' using the matching function of context 'ctx' (see 'XMLContext')
+ instead of the global one set by 'XMLSearch_set_regexpr_compare'.
+ */
+int XMLSearch_node_matches_ctx(const XMLNode* node, const XMLSearch* search, const XMLContext* ctx);
+
 /*
  Search next matching node, according to search parameters given by 'search'.
  Search starts from node 'from' by scanning all its children, and going up to siblings,
@@ -217,6 +241,18 @@ int XMLSearch_node_matches(const XMLNode* node, const XMLSearch* search);
  */
 XMLNode* XMLSearch_next(const XMLNode* from, XMLSearch* search);
 
+/*
+ Same as 'XMLSearch_next' using the matching function of context 'ctx'.
+ */
+XMLNode* XMLSearch_next_ctx(const XMLNode* from, XMLSearch* search, const XMLContext* ctx);
+
+/*
+ Matching function to be used as 'match' member of a 'RecordStream', with an 'XMLSearch*' as
+ 'match_data': records are nodes matching the search (e.g. initialized by 'XMLSearch_init_from_XPath').
+ As the text of a node is not known yet when it is matched, searches on text never match.
+ */
+int XMLSearch_record_matches(const XMLNode* node, void* search);
+
 /*
  Get 'node' XPath-like equivalent: 'tag[.="text", @attribute="value", ...]', potentially
  including father nodes XPathes.